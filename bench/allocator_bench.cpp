@@ -0,0 +1,353 @@
+// Microbenchmarks of standard containers running on every allocator in the library, with
+// std::allocator as the baseline.
+//
+//     allocator_bench [--json] [n]
+//
+// Every benchmark performs n operations on a fresh allocator and reports the best of a few
+// runs as CSV (or JSON with --json): the time per operation, the allocations per
+// operation, the peak number of bytes the containers held at once, and for the
+// buffer-based allocators the number of bytes taken from the buffer, which includes
+// padding and memory that is never reused.
+#include "counting_allocator.h"
+#include "lazy/memory/buffer_allocator.h"
+#include "lazy/memory/concurrent_buffer_manager.h"
+#include "lazy/memory/pool_manager.h"
+#include "lazy/memory/thread_cache_manager.h"
+#include "lazy/memory/tlsf_manager.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// big enough for the workloads that strand memory in a high-watermark buffer
+const std::size_t arena_size = 256 * 1024 * 1024;
+
+const int repetitions = 5;
+
+// how much of its buffer a manager has handed out
+template <typename Manager>
+std::size_t arena_bytes(const void* manager)
+{
+    const Manager& m = *static_cast<const Manager*>(manager);
+    return m.buffer_size() - m.available();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// allocators under test
+////////////////////////////////////////////////////////////////////////////////
+struct std_mode
+{
+    template <typename T>
+    struct allocator
+    {
+        typedef std::allocator<T> type;
+    };
+
+    static const char* name() { return "std"; }
+
+    explicit std_mode(std::vector<char>&) {}
+
+    template <typename T>
+    std::allocator<T> make() { return std::allocator<T>(); }
+
+    void watch(bench::counters&) const {}
+};
+
+template <typename Manager>
+struct manager_mode
+{
+    template <typename T>
+    struct allocator
+    {
+        typedef lazy::memory::buffer_allocator<T, Manager> type;
+    };
+
+    explicit manager_mode(std::vector<char>& buffer) :
+        m_manager(&buffer[0], buffer.size())
+    {
+        // NOP
+    }
+
+    template <typename T>
+    typename allocator<T>::type make() { return typename allocator<T>::type(m_manager); }
+
+    void watch(bench::counters& c) const
+    {
+        c.arena = &m_manager;
+        c.arena_bytes = &arena_bytes<Manager>;
+    }
+
+    Manager m_manager;
+};
+
+struct buffer_mode : public manager_mode<lazy::memory::buffer_manager>
+{
+    static const char* name() { return "buffer"; }
+    explicit buffer_mode(std::vector<char>& buffer) : manager_mode(buffer) {}
+};
+
+struct pool_mode : public manager_mode<lazy::memory::pool_manager>
+{
+    static const char* name() { return "pool"; }
+    explicit pool_mode(std::vector<char>& buffer) : manager_mode(buffer) {}
+};
+
+struct tlsf_mode : public manager_mode<lazy::memory::tlsf_manager>
+{
+    static const char* name() { return "tlsf"; }
+    explicit tlsf_mode(std::vector<char>& buffer) : manager_mode(buffer) {}
+};
+
+struct concurrent_mode : public manager_mode<lazy::memory::concurrent_buffer_manager>
+{
+    static const char* name() { return "concurrent"; }
+    explicit concurrent_mode(std::vector<char>& buffer) : manager_mode(buffer) {}
+};
+
+struct thread_cache_mode : public manager_mode<lazy::memory::thread_cache_manager>
+{
+    static const char* name() { return "thread_cache"; }
+    explicit thread_cache_mode(std::vector<char>& buffer) : manager_mode(buffer) {}
+};
+
+// a small stack-sized buffer that grows from the heap
+struct growable_mode
+{
+    template <typename T>
+    struct allocator
+    {
+        typedef lazy::memory::buffer_allocator<T> type;
+    };
+
+    static const char* name() { return "growable"; }
+
+    explicit growable_mode(std::vector<char>&) :
+        m_manager(m_buffer, sizeof(m_buffer), lazy::memory::growth_policy::heap())
+    {
+        // NOP
+    }
+
+    template <typename T>
+    typename allocator<T>::type make() { return typename allocator<T>::type(m_manager); }
+
+    void watch(bench::counters& c) const
+    {
+        c.arena = &m_manager;
+        c.arena_bytes = &arena_bytes<lazy::memory::buffer_manager>;
+    }
+
+    char m_buffer[4096];
+    lazy::memory::buffer_manager m_manager;
+};
+
+template <typename Mode, typename T>
+struct counted
+{
+    typedef bench::counting_allocator<typename Mode::template allocator<T>::type> type;
+};
+
+template <typename Mode, typename T>
+typename counted<Mode, T>::type make_allocator(Mode& mode, bench::counters& c)
+{
+    return typename counted<Mode, T>::type(mode.template make<T>(), c);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// workloads
+////////////////////////////////////////////////////////////////////////////////
+template <typename Mode>
+void raw_allocate(Mode& mode, bench::counters& c, std::size_t n)
+{
+    typedef typename counted<Mode, long>::type allocator_type;
+    allocator_type allocator(make_allocator<Mode, long>(mode, c));
+    std::vector<long*> pointers(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        pointers[i] = allocator.allocate(1);
+    }
+    for (std::size_t i = n; i > 0; --i) {
+        allocator.deallocate(pointers[i - 1], 1);
+    }
+}
+
+template <typename Mode>
+void vector_push_back(Mode& mode, bench::counters& c, std::size_t n)
+{
+    typedef typename counted<Mode, int>::type allocator_type;
+    std::vector<int, allocator_type> vec(make_allocator<Mode, int>(mode, c));
+    for (std::size_t i = 0; i < n; ++i) {
+        vec.push_back(static_cast<int>(i));
+    }
+}
+
+template <typename Mode>
+void map_insert(Mode& mode, bench::counters& c, std::size_t n)
+{
+    typedef std::pair<const int, int> value_type;
+    typedef typename counted<Mode, value_type>::type allocator_type;
+    std::map<int, int, std::less<int>, allocator_type> m(std::less<int>(),
+        make_allocator<Mode, value_type>(mode, c));
+    for (std::size_t i = 0; i < n; ++i) {
+        // scatter the keys a bit so the tree has to work
+        const int key = static_cast<int>((i * 2654435761u) % n);
+        m.insert(value_type(key, key));
+    }
+}
+
+template <typename Mode>
+void list_churn(Mode& mode, bench::counters& c, std::size_t n)
+{
+    typedef typename counted<Mode, int>::type allocator_type;
+    std::list<int, allocator_type> l(make_allocator<Mode, int>(mode, c));
+    for (std::size_t i = 0; i < n; ++i) {
+        l.push_back(static_cast<int>(i));
+        if (l.size() > 64) {
+            l.pop_front();
+        }
+    }
+}
+
+template <typename Mode>
+void string_append(Mode& mode, bench::counters& c, std::size_t n)
+{
+    typedef typename counted<Mode, char>::type allocator_type;
+    typedef std::basic_string<char, std::char_traits<char>, allocator_type> string_type;
+    string_type str(make_allocator<Mode, char>(mode, c));
+    for (std::size_t i = 0; i < n; ++i) {
+        str.push_back(static_cast<char>('a' + i % 26));
+    }
+}
+
+template <typename Mode>
+void unordered_map_build(Mode& mode, bench::counters& c, std::size_t n)
+{
+    typedef std::pair<const int, int> value_type;
+    typedef typename counted<Mode, value_type>::type allocator_type;
+    std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, allocator_type> m(
+        0, std::hash<int>(), std::equal_to<int>(), make_allocator<Mode, value_type>(mode, c));
+    for (std::size_t i = 0; i < n; ++i) {
+        m.insert(value_type(static_cast<int>(i), static_cast<int>(i)));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// driver
+////////////////////////////////////////////////////////////////////////////////
+struct result
+{
+    const char* benchmark;
+    const char* allocator;
+    std::size_t n;
+    double ns_per_op;
+    double allocs_per_op;
+    std::size_t peak_bytes;
+    std::size_t peak_arena_bytes;
+};
+
+template <typename Mode>
+result run(const char* benchmark, void (*workload)(Mode&, bench::counters&, std::size_t),
+    std::vector<char>& arena, std::size_t n)
+{
+    result r = { benchmark, Mode::name(), n, 0, 0, 0, 0 };
+    for (int rep = 0; rep < repetitions; ++rep) {
+        bench::counters c;
+        std::unique_ptr<Mode> mode(new Mode(arena));
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        workload(*mode, c, n);
+        const std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+        const double ns = std::chrono::duration<double, std::nano>(stop - start).count() / n;
+        if (rep == 0 || ns < r.ns_per_op) {
+            r.ns_per_op = ns;
+        }
+    }
+
+    // one more run that isn't timed, sampling the arena after every allocation
+    bench::counters c;
+    std::unique_ptr<Mode> mode(new Mode(arena));
+    mode->watch(c);
+    workload(*mode, c, n);
+    r.allocs_per_op = static_cast<double>(c.allocations) / n;
+    r.peak_bytes = c.peak_bytes;
+    r.peak_arena_bytes = c.peak_arena_bytes;
+    return r;
+}
+
+template <typename Mode>
+void run_all(std::vector<result>& results, std::vector<char>& arena, std::size_t n)
+{
+    results.push_back(run<Mode>("raw_allocate", &raw_allocate<Mode>, arena, n));
+    results.push_back(run<Mode>("vector_push_back", &vector_push_back<Mode>, arena, n));
+    results.push_back(run<Mode>("map_insert", &map_insert<Mode>, arena, n));
+    results.push_back(run<Mode>("list_churn", &list_churn<Mode>, arena, n));
+    results.push_back(run<Mode>("string_append", &string_append<Mode>, arena, n));
+    results.push_back(run<Mode>("unordered_map_build", &unordered_map_build<Mode>, arena, n));
+}
+
+void print_csv(const std::vector<result>& results)
+{
+    std::printf("benchmark,allocator,n,ns_per_op,allocs_per_op,peak_bytes,peak_arena_bytes\n");
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const result& r = results[i];
+        std::printf("%s,%s,%zu,%.3f,%.4f,%zu,%zu\n", r.benchmark, r.allocator, r.n,
+            r.ns_per_op, r.allocs_per_op, r.peak_bytes, r.peak_arena_bytes);
+    }
+}
+
+void print_json(const std::vector<result>& results)
+{
+    std::printf("[\n");
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const result& r = results[i];
+        std::printf("  {\"benchmark\": \"%s\", \"allocator\": \"%s\", \"n\": %zu, "
+            "\"ns_per_op\": %.3f, \"allocs_per_op\": %.4f, \"peak_bytes\": %zu, "
+            "\"peak_arena_bytes\": %zu}%s\n", r.benchmark, r.allocator, r.n, r.ns_per_op,
+            r.allocs_per_op, r.peak_bytes, r.peak_arena_bytes, i + 1 < results.size() ? "," : "");
+    }
+    std::printf("]\n");
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    bool json = false;
+    std::size_t n = 100000;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else {
+            n = std::strtoul(argv[i], 0, 10);
+        }
+    }
+    if (n == 0) {
+        std::fprintf(stderr, "usage: %s [--json] [n]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<char> arena(arena_size);
+    std::vector<result> results;
+    run_all<std_mode>(results, arena, n);
+    run_all<buffer_mode>(results, arena, n);
+    run_all<growable_mode>(results, arena, n);
+    run_all<pool_mode>(results, arena, n);
+    run_all<tlsf_mode>(results, arena, n);
+    run_all<concurrent_mode>(results, arena, n);
+    run_all<thread_cache_mode>(results, arena, n);
+
+    if (json) {
+        print_json(results);
+    } else {
+        print_csv(results);
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+// Allocation throughput of one buffer shared by 1..N threads.
+//
+//     concurrent_buffer_manager_bench [max_threads] [ops_per_thread]
+//
+// Prints one CSV row per manager and thread count.
+#include "lazy/memory/buffer_manager.h"
+#include "lazy/memory/concurrent_buffer_manager.h"
+#include "lazy/memory/thread_cache_manager.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const size_t chunk_size = 16;
+
+// a buffer_manager behind a mutex, which is what sharing one used to take
+class locked_buffer_manager
+{
+public:
+    locked_buffer_manager(void* buffer, size_t buffer_size) :
+        m_manager(buffer, buffer_size)
+    {
+        // NOP
+    }
+
+    void* allocate(size_t n, size_t alignment)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_manager.allocate(n, alignment);
+    }
+
+private:
+    std::mutex m_mutex;
+    lazy::memory::buffer_manager m_manager;
+};
+
+template <typename Manager>
+double run(Manager& manager, size_t alignment, int num_threads, size_t ops)
+{
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.push_back(std::thread([&manager, &ready, &go, alignment, ops]() {
+            ++ready;
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            for (size_t i = 0; i < ops; ++i) {
+                void* volatile p = manager.allocate(chunk_size, alignment);
+                (void)p;
+            }
+        }));
+    }
+    while (ready.load() != num_threads) {
+        std::this_thread::yield();
+    }
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    go.store(true);
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    const std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count();
+}
+
+void report(const char* name, int num_threads, size_t ops, double ns)
+{
+    const double total = static_cast<double>(ops) * num_threads;
+    // ns_per_op is wall time divided by all operations, i.e. the inverse of throughput
+    std::printf("%s,%d,%zu,%.2f,%.2f\n", name, num_threads, ops * num_threads,
+        ns / total, total / ns * 1000.0);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    int max_threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (argc > 1) {
+        max_threads = std::atoi(argv[1]);
+    }
+    if (max_threads < 1) {
+        max_threads = 1;
+    }
+    size_t ops = 200000;
+    if (argc > 2) {
+        ops = std::strtoul(argv[2], 0, 10);
+    }
+
+    std::printf("manager,threads,ops,ns_per_op,mops_per_sec\n");
+    for (int num_threads = 1; num_threads <= max_threads; ++num_threads) {
+        // padding to 64 bytes at worst for every chunk, plus a partly used chunk of
+        // thread_cache_manager per thread
+        std::vector<char> buffer(num_threads * (ops * 64 + 2 * 64 * 1024));
+        {
+            lazy::memory::concurrent_buffer_manager manager(&buffer[0], buffer.size());
+            report("concurrent_fetch_add", num_threads, ops,
+                run(manager, 1, num_threads, ops));
+        }
+        {
+            lazy::memory::concurrent_buffer_manager manager(&buffer[0], buffer.size());
+            report("concurrent_cas", num_threads, ops,
+                run(manager, 64, num_threads, ops));
+        }
+        {
+            lazy::memory::thread_cache_manager manager(&buffer[0], buffer.size());
+            report("thread_cache", num_threads, ops, run(manager, 1, num_threads, ops));
+        }
+        {
+            locked_buffer_manager manager(&buffer[0], buffer.size());
+            report("mutex", num_threads, ops, run(manager, 1, num_threads, ops));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+// An allocator adaptor that counts what the allocator underneath is asked for, so every
+// allocator in the benchmarks reports allocations and peak bytes the same way.
+#ifndef __LAZY_BENCH_COUNTING_ALLOCATOR_H__
+#define __LAZY_BENCH_COUNTING_ALLOCATOR_H__
+
+#include <cstddef>
+#include <memory>
+
+namespace bench {
+
+// \brief what a counting_allocator and its rebound copies have seen
+struct counters
+{
+    counters() :
+        allocations(0), live_bytes(0), peak_bytes(0), peak_arena_bytes(0), arena(0),
+        arena_bytes(0)
+    {
+        // NOP
+    }
+
+    std::size_t allocations;
+    std::size_t live_bytes;
+    std::size_t peak_bytes;
+
+    // \brief the most arena_bytes returned after any allocation
+    std::size_t peak_arena_bytes;
+
+    // \brief passed to arena_bytes
+    const void* arena;
+
+    // \brief how much of its arena the allocator underneath has taken, 0 if it has none.
+    // it is sampled after every allocation, since the arena has usually shrunk back by the
+    // time the workload is done.
+    std::size_t (*arena_bytes)(const void* arena);
+};
+
+template <typename Alloc>
+class counting_allocator : public Alloc
+{
+public:
+    typedef std::allocator_traits<Alloc> traits_type;
+    typedef typename traits_type::value_type value_type;
+    typedef typename traits_type::pointer pointer;
+    typedef typename traits_type::size_type size_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef counting_allocator<typename traits_type::template rebind_alloc<U> > other;
+    };
+
+    counting_allocator(const Alloc& alloc, counters& c) :
+        Alloc(alloc),
+        m_counters(&c)
+    {
+        // NOP
+    }
+
+    template <typename Other>
+    counting_allocator(const counting_allocator<Other>& alloc) :
+        Alloc(alloc),
+        m_counters(alloc.get_counters())
+    {
+        // NOP
+    }
+
+    pointer allocate(size_type n)
+    {
+        pointer p = Alloc::allocate(n);
+        ++m_counters->allocations;
+        m_counters->live_bytes += n * sizeof(value_type);
+        if (m_counters->live_bytes > m_counters->peak_bytes) {
+            m_counters->peak_bytes = m_counters->live_bytes;
+        }
+        if (m_counters->arena_bytes) {
+            const std::size_t arena_bytes = m_counters->arena_bytes(m_counters->arena);
+            if (arena_bytes > m_counters->peak_arena_bytes) {
+                m_counters->peak_arena_bytes = arena_bytes;
+            }
+        }
+        return p;
+    }
+
+    void deallocate(pointer p, size_type n)
+    {
+        m_counters->live_bytes -= n * sizeof(value_type);
+        Alloc::deallocate(p, n);
+    }
+
+    counters* get_counters() const
+    {
+        return m_counters;
+    }
+
+private:
+    counters* m_counters;
+};
+
+} // namespace bench
+
+#endif // __LAZY_BENCH_COUNTING_ALLOCATOR_H__
@@ -23,102 +23,180 @@
 #define __LAZY_BUFFER_ALLOCATOR_H__
 
 #include <cstdlib>
+#include <type_traits>
+#include <typeinfo>
 #include <lazy/memory/buffer_manager.h>
 
 namespace lazy {
 namespace memory {
 
+// \brief whether buffer_allocator should tell a Manager what type every allocation is for
+// by calling record_type(typeid(T), bytes, allocated).  false unless a Manager asks for it,
+// see instrumented_manager, so nothing is done for the others.
+template <typename Manager>
+struct records_types : public std::false_type
+{
+};
+
 // This is a memory allocator that uses stack memory, and then falls back to the heap
-// when the stack memory is exhausted.  This is a high-watermark allocator that does not reuse
-// freed blocks, so you return memory letting your objects go out of scope.
+// when the stack memory is exhausted if its manager is given a growth_policy, or throws
+// std::bad_alloc if it isn't.  This is a high-watermark allocator that does not reuse
+// freed blocks, except for the most recent one, so you return memory letting your
+// objects go out of scope.
 // This class was created by a desire to stop people from reinventing the wheel reimplementing
 // STL classes cos they don't like the way the STL uses memory, as well as by John Wellbelove's
 // fixed_allocator.
 // http://www.codeguru.com/cpp/article.php/c18503/C-Programming-Stack-Allocators-for-STL-Containers.htm
-template <typename T>
+//
+// The way memory is cut up is left to the Manager, which is buffer_manager unless you want
+// something else.  A Manager needs allocate(n, alignment), deallocate(p, n), try_expand(p,
+// n, new_n) and max_size().
+//
+// The allocator itself is just a pointer to the Manager, so it is cheap to keep in every
+// container and to copy and rebind.  Allocators compare equal if they allocate from the
+// same Manager, and a container that is move-assigned or swapped takes its allocator
+// along, so neither has to copy elements from one buffer to another.
+template <typename T, typename Manager = buffer_manager>
 class buffer_allocator
 {
+    template <typename U, typename OtherManager>
+    friend class buffer_allocator;
+
+    template <typename U, typename V, typename OtherManager>
+    friend bool operator==(const buffer_allocator<U, OtherManager>&,
+        const buffer_allocator<V, OtherManager>&) noexcept;
+
 public:
     typedef T value_type;
-    typedef buffer_manager::size_type size_type;
+    typedef typename Manager::size_type size_type;
     typedef std::ptrdiff_t difference_type;
     typedef T* pointer;
     typedef const T* const_pointer;
     typedef T& reference;
     typedef const T& const_reference;
+    typedef Manager manager_type;
+
+    // \brief containers that are moved or swapped take the allocator with them, so their
+    // elements can stay where they are.  copies get the allocator of the container they
+    // are assigned to, and a copy-constructed container shares the original's manager.
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    // \brief two allocators are only interchangeable if they share a manager
+    typedef std::false_type is_always_equal;
 
     // \brief I don't know what rebind is for.
     template <typename U>
     struct rebind
     {
-        typedef buffer_allocator<U> other;
+        typedef buffer_allocator<U, Manager> other;
     };
 
     // \brief default ctor that doesn't do anything meaningful.  Don't use it.
-    buffer_allocator() throw();
+    buffer_allocator() noexcept;
 
     // \brief ctor
-    // \param[in] buffer  the array to allocate memory from
-    // \param[in] buffer_size  the size of the array in bytes
-    buffer_allocator(void* buffer, size_type buffer_size) throw();
+    // \param[in] manager  the manager to allocate from, which has to outlive this object
+    //                     and its copies
+    explicit buffer_allocator(Manager& manager) noexcept;
 
     // \brief copy ctor
-    buffer_allocator(const buffer_allocator&) throw();
+    buffer_allocator(const buffer_allocator&) noexcept;
 
     // \brief rebind ctor
     template <typename U>
-    buffer_allocator(const buffer_allocator<U>& alloc) throw();
+    buffer_allocator(const buffer_allocator<U, Manager>& alloc) noexcept;
 
     // \brief dtor
-    ~buffer_allocator() throw();
+    ~buffer_allocator() noexcept;
 
     // \brief Returns the address of the supplied object
-    pointer address(reference x) const;
+    pointer address(reference x) const noexcept;
 
     // \brief Returns the address of the supplied object
-    const_pointer address(const_reference x) const;
+    const_pointer address(const_reference x) const noexcept;
 
-    // \brief Allocates the memory for 'n' objects. Pointer cp is ignored
+    // \brief Allocates the memory for 'n' objects aligned for T. Pointer cp is ignored
     // \param[in] n  the number of objects to allocate
     // \param[in] cp unused
     pointer allocate(size_type n, const_pointer cp = 0);
 
-    // \brief Releases the previously allocated resource
+    // \brief Allocates the memory for 'n' objects aligned for T, but returns 0 instead of
+    // throwing std::bad_alloc if there isn't enough.  Containers don't call this, it is
+    // for code that would rather degrade gracefully.  The Manager needs try_allocate(n,
+    // alignment) for this.
+    // \param[in] n  the number of objects to allocate
+    pointer try_allocate(size_type n);
+
+    // \brief Releases the previously allocated resource.  The memory is only reused if
+    // it was the most recent allocation from the buffer.
     void deallocate(pointer p, size_type n);
 
+    // \brief Tries to grow or shrink the most recent allocation in place
+    // \param[in] p  the allocation
+    // \param[in] n  the number of objects it currently holds
+    // \param[in] new_n  the number of objects it needs to hold
+    // \return true if the allocation now holds new_n objects
+    bool try_expand(pointer p, size_type n, size_type new_n);
+
     // \brief Returns the maximum size that the container may grow to
-    size_type max_size() const throw();
+    size_type max_size() const noexcept;
 
-    // \brief Constructs an instance of the object
-    void construct(pointer p, const value_type& x);
+    // \brief Constructs an object in place from whatever its ctor takes, so emplacing or
+    // moving an element into a container doesn't make a copy of it on the way
+    // \param[in] p  where to construct the object
+    // \param[in] args  forwarded to U's ctor
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args);
 
-    // \brief Releases the resources owned by the object pointed to
-    void destroy(pointer p);
+    // \brief Releases the resources owned by the object pointed to.  Does nothing for
+    // trivially destructible types, so clearing a container of them is free.
+    template <typename U>
+    void destroy(U* p) noexcept;
+
+    // \brief Releases the resources owned by 'n' consecutive objects, see destroy()
+    // \param[in] p  the first object
+    // \param[in] n  the number of objects
+    template <typename U>
+    void destroy(U* p, size_type n) noexcept;
 
     // \brief gets the buffer_manager
-    buffer_manager& get_buffer_manager() const;
+    Manager& get_buffer_manager() const noexcept;
 
 protected:
-    // \brief reference to the buffer manager that is actively being used
-    buffer_manager& m_buffer_manager;
+    // \brief the buffer manager that is actively being used
+    Manager* m_buffer_manager;
 
 private:
-    // \brief the space for a buffer_manager object if this object isn't copy-constructed
-    buffer_manager m_buffer_manager_storage;
-};
+    // \brief runs the dtors of 'n' consecutive objects
+    template <typename U>
+    static void destroy(U* p, size_type n, std::false_type) noexcept;
 
-// these are a necessary evil cos some STL classes (e.g. std::basic_string uses them)
-template<typename T, typename U>
-bool operator==(const buffer_allocator<T>&, const buffer_allocator<U>&);
+    // \brief trivially destructible objects don't need their dtors run
+    template <typename U>
+    static void destroy(U* p, size_type n, std::true_type) noexcept;
+
+    // \brief counts live allocations in debug builds for managers built on buffer_manager
+    void track_live(int delta, std::true_type);
+
+    // \brief other managers don't keep count
+    void track_live(int delta, std::false_type);
 
-template<typename T>
-bool operator==(const buffer_allocator<T>&, const buffer_allocator<T>&);
+    // \brief tells the manager what type the bytes were allocated or deallocated for
+    void record_type(size_type bytes, bool allocated, std::true_type);
+
+    // \brief managers that don't care about types are left alone
+    void record_type(size_type bytes, bool allocated, std::false_type);
+};
 
-template<typename T, typename U>
-bool operator!=(const buffer_allocator<T>&, const buffer_allocator<U>&);
+// \brief allocators are equal if memory allocated by one can be deallocated by the other,
+// i.e. if they allocate from the same manager
+template<typename T, typename U, typename Manager>
+bool operator==(const buffer_allocator<T, Manager>&, const buffer_allocator<U, Manager>&) noexcept;
 
-template<typename T>
-bool operator!=(const buffer_allocator<T>&, const buffer_allocator<T>&);
+template<typename T, typename U, typename Manager>
+bool operator!=(const buffer_allocator<T, Manager>&, const buffer_allocator<U, Manager>&) noexcept;
 
 } // namespace memory
 } // namespace lazy
@@ -22,140 +22,221 @@
 #ifndef __LAZY_BUFFER_ALLOCATOR_TCC__
 #define __LAZY_BUFFER_ALLOCATOR_TCC__
 
+#include <cassert>
 #include <bits/functexcept.h>
+#include <type_traits>
+#include <utility>
 
 namespace lazy {
 namespace memory {
 ////////////////////////////////////////////////////////////////////////////////
 // buffer_allocator
 ////////////////////////////////////////////////////////////////////////////////
-template <typename T>
-inline buffer_allocator<T>::buffer_allocator() throw() :
-    m_buffer_manager(m_buffer_manager_storage),
-    m_buffer_manager_storage(0, 0)
+template <typename T, typename Manager>
+inline buffer_allocator<T, Manager>::buffer_allocator() noexcept :
+    m_buffer_manager(0)
 {
     // NOP
 }
 
-template <typename T>
-inline buffer_allocator<T>::buffer_allocator(void* buffer,
-        typename buffer_allocator<T>::size_type buffer_size) throw() :
-    m_buffer_manager(m_buffer_manager_storage),
-    m_buffer_manager_storage(buffer, buffer_size)
+template <typename T, typename Manager>
+inline buffer_allocator<T, Manager>::buffer_allocator(Manager& manager) noexcept :
+    m_buffer_manager(&manager)
 {
     // NOP
 }
 
-template <typename T>
-inline buffer_allocator<T>::buffer_allocator(const buffer_allocator<T>& alloc) throw() :
-    m_buffer_manager(alloc.get_buffer_manager()),
-    m_buffer_manager_storage(0, 0)
+template <typename T, typename Manager>
+inline buffer_allocator<T, Manager>::buffer_allocator(const buffer_allocator<T, Manager>& alloc) noexcept :
+    m_buffer_manager(alloc.m_buffer_manager)
 {
     // NOP
 }
 
-template <typename T>
+template <typename T, typename Manager>
 template <typename U>
-inline buffer_allocator<T>::buffer_allocator(const buffer_allocator<U>& alloc) throw() :
-    m_buffer_manager(alloc.get_buffer_manager()),
-    m_buffer_manager_storage(0, 0)
+inline buffer_allocator<T, Manager>::buffer_allocator(const buffer_allocator<U, Manager>& alloc) noexcept :
+    m_buffer_manager(alloc.m_buffer_manager)
 {
     // NOP
 }
 
-template <typename T>
-inline buffer_allocator<T>::~buffer_allocator() throw()
+template <typename T, typename Manager>
+inline buffer_allocator<T, Manager>::~buffer_allocator() noexcept
 {
     // NOP
 }
 
-template <typename T>
-inline typename buffer_allocator<T>::pointer buffer_allocator<T>::address(
-    typename buffer_allocator<T>::reference x) const
+template <typename T, typename Manager>
+inline typename buffer_allocator<T, Manager>::pointer buffer_allocator<T, Manager>::address(
+    typename buffer_allocator<T, Manager>::reference x) const noexcept
 {
     return &x;
 }
 
-template <typename T>
-inline typename buffer_allocator<T>::const_pointer buffer_allocator<T>::address(
-    typename buffer_allocator<T>::const_reference x) const
+template <typename T, typename Manager>
+inline typename buffer_allocator<T, Manager>::const_pointer buffer_allocator<T, Manager>::address(
+    typename buffer_allocator<T, Manager>::const_reference x) const noexcept
 {
     return &x;
 }
 
-template <typename T>
-inline typename buffer_allocator<T>::pointer buffer_allocator<T>::allocate(
-    typename buffer_allocator<T>::size_type n, typename buffer_allocator<T>::const_pointer)
+template <typename T, typename Manager>
+inline typename buffer_allocator<T, Manager>::pointer buffer_allocator<T, Manager>::allocate(
+    typename buffer_allocator<T, Manager>::size_type n, typename buffer_allocator<T, Manager>::const_pointer)
 {
-    // assuming that sizeof() rounds up, so m_bytes_allocated will always be in the
-    // multiple to ensure alignment.
+    // n * sizeof(T) would wrap around to a small request that succeeds
+    if (n > max_size()) {
+        std::__throw_bad_alloc();
+    }
+    // sizeof() being a multiple of alignof() is not enough since rebound allocators of
+    // other types share the same buffer, so ask the manager to align for us.
     const size_type bytes = n * sizeof(T);
-    pointer const cursor = static_cast<pointer>(m_buffer_manager.allocate(bytes));
+    pointer const cursor = static_cast<pointer>(m_buffer_manager->allocate(bytes, alignof(T)));
+#ifndef NDEBUG
+    track_live(1, std::is_base_of<buffer_manager, Manager>());
+#endif
+    record_type(bytes, true, records_types<Manager>());
     return cursor;
 }
 
-template <typename T>
-inline void buffer_allocator<T>::deallocate(typename buffer_allocator<T>::pointer p,
-    typename buffer_allocator<T>::size_type n)
+template <typename T, typename Manager>
+inline typename buffer_allocator<T, Manager>::pointer buffer_allocator<T, Manager>::try_allocate(
+    typename buffer_allocator<T, Manager>::size_type n)
 {
-    // Do not attempt to return memory buffer cos we are a high-watermark allocator.
-    // NOP?  TODO is it really noop or do we have to call the destructor?
+    if (n > static_cast<size_type>(-1) / sizeof(T)) {
+        return 0;
+    }
+    const size_type bytes = n * sizeof(T);
+    pointer const cursor = static_cast<pointer>(m_buffer_manager->try_allocate(bytes, alignof(T)));
+    if (!cursor) {
+        return 0;
+    }
+#ifndef NDEBUG
+    track_live(1, std::is_base_of<buffer_manager, Manager>());
+#endif
+    record_type(bytes, true, records_types<Manager>());
+    return cursor;
 }
 
-template <typename T>
-inline typename buffer_allocator<T>::size_type buffer_allocator<T>::max_size() const throw()
+template <typename T, typename Manager>
+inline void buffer_allocator<T, Manager>::deallocate(typename buffer_allocator<T, Manager>::pointer p,
+    typename buffer_allocator<T, Manager>::size_type n)
 {
-    return static_cast<size_type>(m_buffer_manager.buffer_size() / sizeof(T));
+    // We are a high-watermark allocator, but the manager can still roll the cursor back
+    // if this happens to be the last thing allocated.  Destructors are called by the
+    // container through destroy(), not here.
+    m_buffer_manager->deallocate(p, n * sizeof(T));
+#ifndef NDEBUG
+    track_live(-1, std::is_base_of<buffer_manager, Manager>());
+#endif
+    record_type(n * sizeof(T), false, records_types<Manager>());
 }
 
-template <typename T>
-inline void buffer_allocator<T>::construct(typename buffer_allocator<T>::pointer p,
-   const  typename buffer_allocator<T>::value_type& x)
+template <typename T, typename Manager>
+inline bool buffer_allocator<T, Manager>::try_expand(typename buffer_allocator<T, Manager>::pointer p,
+    typename buffer_allocator<T, Manager>::size_type n, typename buffer_allocator<T, Manager>::size_type new_n)
 {
-    ::new ((void*)p) value_type(x);
+    if (new_n > max_size()) {
+        return false;
+    }
+    return m_buffer_manager->try_expand(p, n * sizeof(T), new_n * sizeof(T));
 }
 
-template <typename T>
-inline void buffer_allocator<T>::destroy(typename buffer_allocator<T>::pointer p)
+template <typename T, typename Manager>
+inline typename buffer_allocator<T, Manager>::size_type buffer_allocator<T, Manager>::max_size() const noexcept
 {
-    p->~T();
+    return static_cast<size_type>(m_buffer_manager->max_size() / sizeof(T));
 }
 
-template <typename T>
-inline buffer_manager& buffer_allocator<T>::get_buffer_manager() const
+template <typename T, typename Manager>
+template <typename U, typename... Args>
+inline void buffer_allocator<T, Manager>::construct(U* p, Args&&... args)
 {
-    return m_buffer_manager;
+    ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
 }
 
-////////////////////////////////////////////////////////////////////////////////
-// operators
-////////////////////////////////////////////////////////////////////////////////
-template<typename T, typename U>
-inline bool operator==(const buffer_allocator<T>&, const buffer_allocator<U>&)
+template <typename T, typename Manager>
+template <typename U>
+inline void buffer_allocator<T, Manager>::destroy(U* p) noexcept
+{
+    destroy(p, 1, std::is_trivially_destructible<U>());
+}
+
+template <typename T, typename Manager>
+template <typename U>
+inline void buffer_allocator<T, Manager>::destroy(U* p,
+    typename buffer_allocator<T, Manager>::size_type n) noexcept
+{
+    destroy(p, n, std::is_trivially_destructible<U>());
+}
+
+template <typename T, typename Manager>
+template <typename U>
+inline void buffer_allocator<T, Manager>::destroy(U* p,
+    typename buffer_allocator<T, Manager>::size_type n, std::false_type) noexcept
+{
+    for (size_type i = 0; i < n; ++i) {
+        p[i].~U();
+    }
+}
+
+template <typename T, typename Manager>
+template <typename U>
+inline void buffer_allocator<T, Manager>::destroy(U*,
+    typename buffer_allocator<T, Manager>::size_type, std::true_type) noexcept
 {
-    // doing what std::allocator does
-    return true;
+    // NOP
+}
+
+template <typename T, typename Manager>
+inline Manager& buffer_allocator<T, Manager>::get_buffer_manager() const noexcept
+{
+    return *m_buffer_manager;
+}
+
+template <typename T, typename Manager>
+inline void buffer_allocator<T, Manager>::track_live(int delta, std::true_type)
+{
+    buffer_manager& manager = *m_buffer_manager;
+    assert(delta > 0 || manager.m_live > 0);
+    manager.m_live += delta;
+}
+
+template <typename T, typename Manager>
+inline void buffer_allocator<T, Manager>::track_live(int, std::false_type)
+{
+    // NOP
 }
 
-template<typename T>
-inline bool operator==(const buffer_allocator<T>&, const buffer_allocator<T>&)
+template <typename T, typename Manager>
+inline void buffer_allocator<T, Manager>::record_type(
+    typename buffer_allocator<T, Manager>::size_type bytes, bool allocated, std::true_type)
 {
-    // doing what std::allocator does
-    return true;
+    m_buffer_manager->record_type(typeid(T), bytes, allocated);
 }
 
-template<typename T, typename U>
-inline bool operator!=(const buffer_allocator<T>&, const buffer_allocator<U>&)
+template <typename T, typename Manager>
+inline void buffer_allocator<T, Manager>::record_type(
+    typename buffer_allocator<T, Manager>::size_type, bool, std::false_type)
+{
+    // NOP
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// operators
+////////////////////////////////////////////////////////////////////////////////
+template<typename T, typename U, typename Manager>
+inline bool operator==(const buffer_allocator<T, Manager>& a, const buffer_allocator<U, Manager>& b) noexcept
 {
-    // doing what std::allocator does
-    return false;
+    // memory can only be deallocated by the manager it came from
+    return a.m_buffer_manager == b.m_buffer_manager;
 }
 
-template<typename T>
-inline bool operator!=(const buffer_allocator<T>&, const buffer_allocator<T>&)
+template<typename T, typename U, typename Manager>
+inline bool operator!=(const buffer_allocator<T, Manager>& a, const buffer_allocator<U, Manager>& b) noexcept
 {
-    // doing what std::allocator does
-    return false;
+    return !(a == b);
 }
 
 } // namespace memory
@@ -22,47 +22,353 @@
 #ifndef __LAZY_BUFFER_MANAGER_H__
 #define __LAZY_BUFFER_MANAGER_H__
 
+#include <cstdio>
 #include <cstdlib>
+#include <lazy/memory/poison.h>
 
 namespace lazy {
 namespace memory {
 
-// \brief manages the allocation of memory from the buffer
+template <typename T, typename Manager>
+class buffer_allocator;
+
+// \brief tells a buffer_manager where to get more memory from once its buffer runs out.
+// blocks are requested from the upstream with geometrically increasing sizes, chained
+// together, and all handed back when the buffer_manager is destroyed.
+struct growth_policy
+{
+    typedef std::size_t size_type;
+
+    // \brief gets a block of memory from upstream, returns 0 on failure
+    typedef void* (*allocate_type)(size_type n, void* context);
+
+    // \brief returns a block obtained with allocate_type to upstream
+    typedef void (*deallocate_type)(void* p, size_type n, void* context);
+
+    // \brief grows with malloc() and free()
+    // \param[in] initial_block_size  size of the first block taken from the heap
+    static growth_policy heap(size_type initial_block_size = 4096);
+
+    // \brief upstream allocation function, or 0 if the buffer must not grow
+    allocate_type allocate;
+
+    // \brief upstream deallocation function
+    deallocate_type deallocate;
+
+    // \brief passed to allocate and deallocate as is
+    void* context;
+
+    // \brief size of the first block taken from upstream.  each block after that is
+    // twice the size of the one before it.
+    size_type initial_block_size;
+};
+
+class buffer_manager;
+
+// \brief tells a buffer_manager what to do when neither its buffer nor its growth_policy
+// can satisfy an allocation: fail, which makes allocate() throw std::bad_alloc and
+// try_allocate() return 0, fall back to the heap, or abort with a diagnostic.  growing is
+// what a growth_policy is for, which is tried first.  chunks the handler hands out are
+// only given back when the buffer_manager is reset, rewound past them or destroyed.
+struct overflow_handler
+{
+    typedef std::size_t size_type;
+
+    // \brief gets a block of n bytes for a chunk of 'request' bytes that didn't fit,
+    // returns 0 on failure
+    typedef void* (*allocate_type)(size_type n, size_type request,
+        const buffer_manager& manager, void* context);
+
+    // \brief returns a block obtained with allocate_type
+    typedef void (*deallocate_type)(void* p, size_type n, void* context);
+
+    // \brief gives up, which is what a buffer_manager does unless told otherwise
+    static overflow_handler fail();
+
+    // \brief falls back to malloc() and free()
+    // \param[in] log  where to write a line about every chunk taken from the heap, or 0
+    static overflow_handler heap(std::FILE* log = 0);
+
+    // \brief writes how much was asked for and how much of the buffer is used to stderr,
+    // then calls std::abort()
+    static overflow_handler abort();
+
+    // \brief the handler, or 0 to fail
+    allocate_type allocate;
+
+    // \brief releases what the handler handed out, may be 0 if it never does
+    deallocate_type deallocate;
+
+    // \brief passed to allocate and deallocate as is
+    void* context;
+};
+
+// \brief manages the allocation of memory from the buffer.
+//
+// under AddressSanitizer, or valgrind with the annotations compiled in, everything in
+// the buffer that hasn't been handed out is poisoned, and so is every chunk once it is
+// deallocated or rewound over, so a container running into memory it doesn't own is
+// caught even though it is all one array.  see poison.h.
 class buffer_manager
 {
+    template <typename T, typename Manager>
+    friend class buffer_allocator;
+
+protected:
+    struct block_header;
+
 public:
     typedef std::size_t size_type;
 
+    // \brief a position in the buffer that can be rewound to, see mark()
+    class marker
+    {
+        friend class buffer_manager;
+
+        block_header* m_chain;
+        block_header* m_overflow_chain;
+        char* m_block;
+        size_type m_block_size;
+        size_type m_bytes_allocated;
+        size_type m_capacity;
+        size_type m_next_block_size;
+        size_type m_live;
+    };
+
     // \brief ctor
     // \param[in] buffer  pointer to the buffer to use for allocation
     // \param[in] buffer_size  size of the buffer.  make sure they match.
-    buffer_manager(void* buffer, size_type buffer_size);
+    // \param[in] alignment  the minimum alignment of every chunk handed out.  must be a
+    //                        power of 2, e.g. 64 to keep every chunk cache-line aligned.
+    buffer_manager(void* buffer, size_type buffer_size, size_type alignment = 1);
+
+    // \brief ctor for a buffer that grows from upstream when it runs out
+    // \param[in] buffer  pointer to the buffer to use for allocation first
+    // \param[in] buffer_size  size of the buffer.  make sure they match.
+    // \param[in] growth  where the blocks come from once the buffer is exhausted
+    // \param[in] alignment  the minimum alignment of every chunk handed out
+    buffer_manager(void* buffer, size_type buffer_size, const growth_policy& growth,
+        size_type alignment = 1);
 
-    // \brief copy ctor
-    // \param[in] source  the source
-    buffer_manager(const buffer_manager& source);
+    // \brief dtor, returns every block chained from upstream
+    ~buffer_manager();
 
-    // \brief the buffer size in this class
+    // \brief the buffer size in this class, including the blocks chained from upstream
     size_type buffer_size() const;
 
-    // \brief the amount of space remaining in buffer
+    // \brief the amount of space remaining in the block being allocated from
     size_type available() const;
 
-    // \brief allocates a chunk of memory of requested size
+    // \brief the number of bytes taken from the buffer and the blocks chained from upstream,
+    // including alignment padding and the tails of blocks that were left behind on growth
+    size_type used() const;
+
+    // \brief the largest number of bytes that could ever be handed out
+    size_type max_size() const;
+
+    // \brief whether this manager grows from upstream once the buffer runs out
+    bool growable() const;
+
+    // \brief the minimum alignment of the chunks handed out
+    size_type alignment() const;
+
+    // \brief allocates a chunk of memory of requested size, aligned to the minimum alignment
     // \param[in] n   size of chunk in bytes
-    //
-    // TODO are byte sizes in multiples of 4 or 8?
     void* allocate(size_type n);
 
+    // \brief allocates a chunk of memory of requested size and alignment.  the cursor is
+    // padded forward so the chunk starts on the boundary, and the padding counts against
+    // the buffer.
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to.  the minimum alignment
+    //                        of this manager wins if it is bigger.
+    void* allocate(size_type n, size_type alignment);
+
+    // \brief allocates a chunk like allocate() does, but returns 0 instead of throwing
+    // std::bad_alloc if neither the buffer, the growth_policy nor the overflow_handler
+    // can satisfy it
+    // \param[in] n   size of chunk in bytes
+    void* try_allocate(size_type n);
+
+    // \brief allocates a chunk like allocate() does, but returns 0 instead of throwing
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* try_allocate(size_type n, size_type alignment);
+
+    // \brief sets what to do once the buffer and the growth_policy can't satisfy an
+    // allocation.  has to be done before the handler could have been called, since the
+    // chunks the old one handed out are released with the new one.
+    // \param[in] handler  see overflow_handler
+    void set_overflow_handler(const overflow_handler& handler);
+
+    // \brief allocates a contiguous run of 'count' chunks of n bytes in one go, with a
+    // single bounds check.  chunk i starts at the run plus i * stride(n, alignment), so
+    // every chunk is aligned like allocate(n, alignment) would have aligned it.
+    // \param[in] count  the number of chunks
+    // \param[in] n   size of each chunk in bytes
+    // \param[in] alignment  power of 2 every chunk must be aligned to
+    // \return the first chunk
+    void* allocate_run(size_type count, size_type n, size_type alignment);
+
+    // \brief allocates 'count' chunks of n bytes in one go, see allocate_run().  each
+    // chunk can be deallocated on its own, though only the last one is reclaimed.
+    // \param[out] chunks  receives the chunks in address order, must hold count pointers
+    // \param[in] count  the number of chunks
+    // \param[in] n   size of each chunk in bytes
+    // \param[in] alignment  power of 2 every chunk must be aligned to
+    void allocate_batch(void** chunks, size_type count, size_type n, size_type alignment);
+
+    // \brief the distance between consecutive chunks of a run
+    // \param[in] n   size of each chunk in bytes
+    // \param[in] alignment  power of 2 every chunk must be aligned to
+    size_type stride(size_type n, size_type alignment) const;
+
+    // \brief returns a chunk to the buffer.  only the most recent chunk can be reclaimed,
+    // by rolling the cursor back over it and the padding in front of it.  anything else
+    // stays allocated until the manager goes away.
+    // \param[in] p  the chunk
+    // \param[in] n  size of the chunk in bytes
+    void deallocate(void* p, size_type n);
+
+    // \brief tries to resize the most recent chunk in place
+    // \param[in] p  the chunk
+    // \param[in] n  current size of the chunk in bytes
+    // \param[in] new_n  the size the chunk needs to be
+    // \return true if the chunk now holds new_n bytes, false if it was left alone
+    bool try_expand(void* p, size_type n, size_type new_n);
+
+    // \brief remembers the current position of the cursor
+    marker mark() const;
+
+    // \brief releases everything allocated since the marker was taken in O(1), plus
+    // returning the blocks chained from upstream since then.  markers taken after this
+    // one become invalid.  debug builds assert that everything allocated since the marker
+    // through buffer_allocator has been deallocated, i.e. that no container still lives in
+    // the released memory.
+    // \param[in] m  marker obtained from mark() on this manager
+    void rewind(const marker& m);
+
+    // \brief releases everything, returning every block chained from upstream.  debug
+    // builds assert that no container allocated through buffer_allocator is still alive.
+    void reset();
+
 protected:
+    // \brief whether the chunk is the last one handed out of the current block
+    bool is_last(const void* p, size_type n) const;
+
+    // \brief header at the start of every block chained from upstream
+    struct block_header
+    {
+        // \brief the block chained before this one, or 0
+        block_header* previous;
+
+        // \brief number of bytes obtained from upstream, header included
+        size_type size;
+    };
+
+    // \brief the padding needed to align the cursor
+    size_type padding(size_type alignment) const;
+
+    // \brief takes a chunk from the block being allocated from, growing if it has to,
+    // false if that's not enough
+    bool bump(size_type n, size_type alignment, void*& chunk);
+
+    // \brief chains a new block from upstream that fits the chunk, false if it can't
+    bool grow(size_type n, size_type alignment);
+
+    // \brief asks the overflow_handler for a chunk, 0 if it can't
+    void* overflow(size_type n, size_type alignment);
+
+    // \brief returns the chained blocks up to, but not including, the given one
+    void release_chain(block_header* until);
+
+    // \brief returns the overflow_handler's blocks up to, but not including, the given one
+    void release_overflow(block_header* until);
+
+    // \brief size of the first block to get from upstream
+    size_type first_block_size() const;
+
     // \brief block of memory
     void* const m_buffer;
 
     // \brief buffer size
     const size_type m_buffer_size;
 
-    // \brief the number of bytes allocated
+    // \brief minimum alignment of the chunks handed out
+    const size_type m_alignment;
+
+    // \brief where to get blocks from once the buffer runs out
+    const growth_policy m_growth;
+
+    // \brief the block being allocated from, either m_buffer or the last chained block
+    char* m_block;
+
+    // \brief usable size of m_block
+    size_type m_block_size;
+
+    // \brief the number of bytes allocated from m_block
     size_type m_bytes_allocated;
+
+    // \brief the last chunk taken from m_block, or 0 once it has been reclaimed or the
+    // cursor has moved some other way
+    char* m_last_chunk;
+
+    // \brief m_bytes_allocated from before m_last_chunk and the padding in front of it
+    // were taken, which is where reclaiming it rolls the cursor back to
+    size_type m_last_offset;
+
+    // \brief the last block chained from upstream, or 0
+    block_header* m_chain;
+
+    // \brief what to do once neither the buffer nor m_growth can satisfy an allocation
+    overflow_handler m_overflow;
+
+    // \brief the last block handed out by m_overflow, or 0
+    block_header* m_overflow_chain;
+
+    // \brief usable bytes in the buffer and every chained block
+    size_type m_capacity;
+
+    // \brief size of the next block to get from upstream
+    size_type m_next_block_size;
+
+    // \brief bumped by rewind() and reset(), so anything caching chunks on top of this
+    // class can tell when they have been released from under it
+    size_type m_rewinds;
+
+    // \brief the number of allocations buffer_allocator handed to containers that have
+    // not been deallocated yet, only kept up to date in debug builds to catch rewinding
+    // over live containers
+    size_type m_live;
+
+private:
+    // \brief not copyable since we own the chained blocks, and two managers cutting up
+    // the same buffer would hand out the same memory twice.
+    buffer_manager(const buffer_manager&);
+    buffer_manager& operator=(const buffer_manager&);
+};
+
+// \brief rewinds a buffer_manager to where it was when this object was created, so
+// the scratch space used by a nested phase of work is released when it goes out of scope.
+class scoped_rewind
+{
+public:
+    // \brief ctor, marks the buffer
+    // \param[in] manager  the manager to rewind
+    explicit scoped_rewind(buffer_manager& manager);
+
+    // \brief dtor, rewinds the buffer
+    ~scoped_rewind();
+
+private:
+    scoped_rewind(const scoped_rewind&);
+    scoped_rewind& operator=(const scoped_rewind&);
+
+    // \brief the manager to rewind
+    buffer_manager& m_manager;
+
+    // \brief where to rewind to
+    const buffer_manager::marker m_marker;
 };
 
 } // namespace memory
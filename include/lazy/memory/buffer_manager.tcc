@@ -22,50 +22,507 @@
 #ifndef __LAZY_BUFFER_MANAGER_TCC__
 #define __LAZY_BUFFER_MANAGER_TCC__
 
+#include <cassert>
+#include <cstdlib>
+#include <stdint.h>
 #include <bits/functexcept.h>
 
 namespace lazy {
 namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// growth_policy
+////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+
+inline void* heap_allocate(growth_policy::size_type n, void*)
+{
+    return std::malloc(n);
+}
+
+inline void heap_deallocate(void* p, growth_policy::size_type, void*)
+{
+    std::free(p);
+}
+
+} // namespace detail
+
+inline growth_policy growth_policy::heap(growth_policy::size_type initial_block_size)
+{
+    growth_policy policy;
+    policy.allocate = &detail::heap_allocate;
+    policy.deallocate = &detail::heap_deallocate;
+    policy.context = 0;
+    policy.initial_block_size = initial_block_size;
+    return policy;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// overflow_handler
+////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+
+inline void* overflow_heap_allocate(overflow_handler::size_type n,
+    overflow_handler::size_type request, const buffer_manager& manager, void* context)
+{
+    if (context) {
+        std::fprintf(static_cast<std::FILE*>(context), "lazy::memory: buffer of %zu bytes "
+            "exhausted, taking %zu bytes from the heap\n", manager.buffer_size(), request);
+    }
+    return std::malloc(n);
+}
+
+inline void overflow_heap_deallocate(void* p, overflow_handler::size_type, void*)
+{
+    std::free(p);
+}
+
+inline void* overflow_abort(overflow_handler::size_type, overflow_handler::size_type request,
+    const buffer_manager& manager, void*)
+{
+    std::fprintf(stderr, "lazy::memory: out of memory allocating %zu bytes, %zu of %zu "
+        "bytes used\n", request, manager.used(), manager.buffer_size());
+    std::abort();
+}
+
+} // namespace detail
+
+inline overflow_handler overflow_handler::fail()
+{
+    overflow_handler handler;
+    handler.allocate = 0;
+    handler.deallocate = 0;
+    handler.context = 0;
+    return handler;
+}
+
+inline overflow_handler overflow_handler::heap(std::FILE* log)
+{
+    overflow_handler handler;
+    handler.allocate = &detail::overflow_heap_allocate;
+    handler.deallocate = &detail::overflow_heap_deallocate;
+    handler.context = log;
+    return handler;
+}
+
+inline overflow_handler overflow_handler::abort()
+{
+    overflow_handler handler;
+    handler.allocate = &detail::overflow_abort;
+    handler.deallocate = 0;
+    handler.context = 0;
+    return handler;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // buffer_manager
 ////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+
+inline growth_policy no_growth()
+{
+    growth_policy policy;
+    policy.allocate = 0;
+    policy.deallocate = 0;
+    policy.context = 0;
+    policy.initial_block_size = 0;
+    return policy;
+}
 
-// when you copy, you need to move the cursor in the buffer forward and give up some memory
-inline buffer_manager::buffer_manager(void* buffer, buffer_manager::size_type buffer_size) :
+} // namespace detail
+
+inline buffer_manager::buffer_manager(void* buffer, buffer_manager::size_type buffer_size,
+        buffer_manager::size_type alignment) :
     m_buffer(buffer),
     m_buffer_size(buffer_size),
-    m_bytes_allocated(0)
+    m_alignment(alignment),
+    m_growth(detail::no_growth()),
+    m_block(static_cast<char*>(buffer)),
+    m_block_size(buffer_size),
+    m_bytes_allocated(0),
+    m_last_chunk(0),
+    m_last_offset(0),
+    m_chain(0),
+    m_overflow(overflow_handler::fail()),
+    m_overflow_chain(0),
+    m_capacity(buffer_size),
+    m_next_block_size(0),
+    m_rewinds(0),
+    m_live(0)
 {
-    // NOP
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    detail::poison(buffer, buffer_size);
 }
 
-inline buffer_manager::buffer_manager(const buffer_manager& source) :
-    m_buffer(source.m_buffer),
-    m_buffer_size(source.m_buffer_size),
-    m_bytes_allocated(source.m_bytes_allocated)
+inline buffer_manager::buffer_manager(void* buffer, buffer_manager::size_type buffer_size,
+        const growth_policy& growth, buffer_manager::size_type alignment) :
+    m_buffer(buffer),
+    m_buffer_size(buffer_size),
+    m_alignment(alignment),
+    m_growth(growth),
+    m_block(static_cast<char*>(buffer)),
+    m_block_size(buffer_size),
+    m_bytes_allocated(0),
+    m_last_chunk(0),
+    m_last_offset(0),
+    m_chain(0),
+    m_overflow(overflow_handler::fail()),
+    m_overflow_chain(0),
+    m_capacity(buffer_size),
+    m_next_block_size(first_block_size()),
+    m_rewinds(0),
+    m_live(0)
 {
-    // NOP
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    assert(!growth.allocate || growth.deallocate);
+    detail::poison(buffer, buffer_size);
+}
+
+inline buffer_manager::~buffer_manager()
+{
+    release_overflow(0);
+    release_chain(0);
+    // the buffer goes back to whoever owns it the way it came
+    detail::unpoison(m_buffer, m_buffer_size);
 }
 
 inline buffer_manager::size_type buffer_manager::buffer_size() const
 {
-    return m_buffer_size;
+    return m_capacity;
 }
 
 inline buffer_manager::size_type buffer_manager::available() const
 {
-    return (m_buffer_size - m_bytes_allocated);
+    return (m_block_size - m_bytes_allocated);
+}
+
+inline buffer_manager::size_type buffer_manager::used() const
+{
+    // every block before the current one is spent, whether it was filled or not
+    return m_capacity - m_block_size + m_bytes_allocated;
+}
+
+inline buffer_manager::size_type buffer_manager::max_size() const
+{
+    return growable() ? static_cast<size_type>(-1) : m_buffer_size;
+}
+
+inline bool buffer_manager::growable() const
+{
+    return m_growth.allocate != 0;
+}
+
+inline buffer_manager::size_type buffer_manager::alignment() const
+{
+    return m_alignment;
 }
 
 inline void* buffer_manager::allocate(buffer_manager::size_type n)
 {
-    const size_type remains = available();
-    if (remains < n) {
+    return allocate(n, m_alignment);
+}
+
+inline void* buffer_manager::allocate(buffer_manager::size_type n,
+    buffer_manager::size_type alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if (alignment < m_alignment) {
+        alignment = m_alignment;
+    }
+    void* chunk;
+    if (bump(n, alignment, chunk)) {
+        return chunk;
+    }
+    chunk = overflow(n, alignment);
+    if (!chunk) {
+        std::__throw_bad_alloc();
+    }
+    return chunk;
+}
+
+inline void* buffer_manager::try_allocate(buffer_manager::size_type n)
+{
+    return try_allocate(n, m_alignment);
+}
+
+inline void* buffer_manager::try_allocate(buffer_manager::size_type n,
+    buffer_manager::size_type alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if (alignment < m_alignment) {
+        alignment = m_alignment;
+    }
+    void* chunk;
+    if (bump(n, alignment, chunk)) {
+        return chunk;
+    }
+    return overflow(n, alignment);
+}
+
+inline void buffer_manager::set_overflow_handler(const overflow_handler& handler)
+{
+    assert(!m_overflow_chain);
+    m_overflow = handler;
+}
+
+inline void* buffer_manager::allocate_run(buffer_manager::size_type count,
+    buffer_manager::size_type n, buffer_manager::size_type alignment)
+{
+    if (alignment < m_alignment) {
+        alignment = m_alignment;
+    }
+    const size_type step = stride(n, alignment);
+    if (count != 0 && step > static_cast<size_type>(-1) / count) {
         std::__throw_bad_alloc();
-    }   
-    void* cursor = static_cast<void*>(static_cast<char*>(m_buffer) + m_bytes_allocated);
-    m_bytes_allocated += n;
-    return cursor;
+    }
+    return allocate(step * count, alignment);
+}
+
+inline void buffer_manager::allocate_batch(void** chunks, buffer_manager::size_type count,
+    buffer_manager::size_type n, buffer_manager::size_type alignment)
+{
+    char* chunk = static_cast<char*>(allocate_run(count, n, alignment));
+    const size_type step = stride(n, alignment);
+    for (size_type i = 0; i < count; ++i, chunk += step) {
+        chunks[i] = chunk;
+    }
+}
+
+inline buffer_manager::size_type buffer_manager::stride(buffer_manager::size_type n,
+    buffer_manager::size_type alignment) const
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if (alignment < m_alignment) {
+        alignment = m_alignment;
+    }
+    // zero-sized chunks still need distinct addresses
+    if (n == 0) {
+        n = 1;
+    }
+    return (n + alignment - 1) & ~(alignment - 1);
+}
+
+inline void buffer_manager::deallocate(void* p, buffer_manager::size_type n)
+{
+    if (p == m_last_chunk && is_last(p, n)) {
+        m_bytes_allocated = m_last_offset;
+        m_last_chunk = 0;
+    } else if (is_last(p, n)) {
+        m_bytes_allocated -= n;
+    }
+    // chunks that aren't reclaimed are never handed out again either
+    detail::poison(p, n);
+}
+
+inline bool buffer_manager::try_expand(void* p, buffer_manager::size_type n,
+    buffer_manager::size_type new_n)
+{
+    if (!is_last(p, n)) {
+        return false;
+    }
+    const size_type offset = m_bytes_allocated - n;
+    if (new_n > m_block_size - offset) {
+        return false;
+    }
+    if (new_n > n) {
+        detail::unpoison(static_cast<char*>(p) + n, new_n - n);
+    } else {
+        detail::poison(static_cast<char*>(p) + new_n, n - new_n);
+    }
+    m_bytes_allocated = offset + new_n;
+    return true;
+}
+
+inline buffer_manager::marker buffer_manager::mark() const
+{
+    marker m;
+    m.m_chain = m_chain;
+    m.m_overflow_chain = m_overflow_chain;
+    m.m_block = m_block;
+    m.m_block_size = m_block_size;
+    m.m_bytes_allocated = m_bytes_allocated;
+    m.m_capacity = m_capacity;
+    m.m_next_block_size = m_next_block_size;
+    m.m_live = m_live;
+    return m;
+}
+
+inline void buffer_manager::rewind(const buffer_manager::marker& m)
+{
+    // rewinding forward means the marker was invalidated by an earlier rewind
+    assert(m.m_capacity <= m_capacity);
+    assert(m.m_block != m_block || m.m_bytes_allocated <= m_bytes_allocated);
+    // a container allocated after the marker is still alive.  containers allocated
+    // before it may have died in the meantime, so this can only be a lower bound.
+    assert(m_live <= m.m_live);
+    release_overflow(m.m_overflow_chain);
+    release_chain(m.m_chain);
+    m_block = m.m_block;
+    m_block_size = m.m_block_size;
+    m_bytes_allocated = m.m_bytes_allocated;
+    m_capacity = m.m_capacity;
+    m_next_block_size = m.m_next_block_size;
+    m_last_chunk = 0;
+    detail::poison(m_block + m_bytes_allocated, m_block_size - m_bytes_allocated);
+    ++m_rewinds;
+}
+
+inline void buffer_manager::reset()
+{
+    assert(m_live == 0);
+    release_overflow(0);
+    release_chain(0);
+    m_block = static_cast<char*>(m_buffer);
+    m_block_size = m_buffer_size;
+    m_bytes_allocated = 0;
+    m_last_chunk = 0;
+    m_capacity = m_buffer_size;
+    m_next_block_size = first_block_size();
+    detail::poison(m_buffer, m_buffer_size);
+    ++m_rewinds;
+}
+
+inline bool buffer_manager::is_last(const void* p, buffer_manager::size_type n) const
+{
+    // the size check keeps a chunk ending right where a chained block begins from
+    // being mistaken for the last one.
+    return n <= m_bytes_allocated &&
+        static_cast<const char*>(p) + n == m_block + m_bytes_allocated;
+}
+
+inline buffer_manager::size_type buffer_manager::padding(
+    buffer_manager::size_type alignment) const
+{
+    // pad on the actual address rather than the offset since nobody promised us the
+    // buffer itself is aligned.  the red zone goes in front of the padding.
+    const uintptr_t address = reinterpret_cast<uintptr_t>(m_block) + m_bytes_allocated +
+        detail::red_zone;
+    return static_cast<size_type>(detail::red_zone + (-address & (alignment - 1)));
+}
+
+inline bool buffer_manager::bump(buffer_manager::size_type n,
+    buffer_manager::size_type alignment, void*& chunk)
+{
+    size_type pad = padding(alignment);
+    const size_type remains = available();
+    if (remains < pad || remains - pad < n) {
+        if (!grow(n, alignment)) {
+            return false;
+        }
+        pad = padding(alignment);
+        if (m_block_size < pad || m_block_size - pad < n) {
+            return false;
+        }
+    }
+    chunk = static_cast<void*>(m_block + m_bytes_allocated + pad);
+    m_last_chunk = static_cast<char*>(chunk);
+    m_last_offset = m_bytes_allocated;
+    m_bytes_allocated += pad + n;
+    detail::unpoison(chunk, n);
+    return true;
+}
+
+inline bool buffer_manager::grow(buffer_manager::size_type n,
+    buffer_manager::size_type alignment)
+{
+    if (!growable()) {
+        return false;
+    }
+    // worst case padding is the red zone and alignment - 1 bytes after the header
+    const size_type overhead = sizeof(block_header) + detail::red_zone + alignment - 1;
+    if (n > static_cast<size_type>(-1) - overhead) {
+        return false;
+    }
+    size_type block_size = m_next_block_size;
+    if (block_size < n + overhead) {
+        block_size = n + overhead;
+    }
+    block_header* const block = static_cast<block_header*>(
+        m_growth.allocate(block_size, m_growth.context));
+    if (!block) {
+        return false;
+    }
+    block->previous = m_chain;
+    block->size = block_size;
+    m_chain = block;
+
+    // whatever is left at the end of the current block is abandoned
+    m_block = reinterpret_cast<char*>(block + 1);
+    m_block_size = block_size - sizeof(block_header);
+    m_bytes_allocated = 0;
+    m_capacity += m_block_size;
+    m_next_block_size = block_size * 2;
+    detail::poison(m_block, m_block_size);
+    return true;
+}
+
+inline void* buffer_manager::overflow(buffer_manager::size_type n,
+    buffer_manager::size_type alignment)
+{
+    if (!m_overflow.allocate) {
+        return 0;
+    }
+    const size_type overhead = sizeof(block_header) + alignment - 1;
+    if (n > static_cast<size_type>(-1) - overhead) {
+        return 0;
+    }
+    block_header* const block = static_cast<block_header*>(
+        m_overflow.allocate(n + overhead, n, *this, m_overflow.context));
+    if (!block) {
+        return 0;
+    }
+    block->previous = m_overflow_chain;
+    block->size = n + overhead;
+    m_overflow_chain = block;
+
+    // the block stands on its own, so the chunk is padded from wherever it starts
+    char* const chunk = reinterpret_cast<char*>(block + 1);
+    return chunk + (-reinterpret_cast<uintptr_t>(chunk) & (alignment - 1));
+}
+
+inline void buffer_manager::release_chain(buffer_manager::block_header* until)
+{
+    while (m_chain != until) {
+        assert(m_chain);
+        block_header* const previous = m_chain->previous;
+        detail::unpoison(m_chain, m_chain->size);
+        m_growth.deallocate(m_chain, m_chain->size, m_growth.context);
+        m_chain = previous;
+    }
+}
+
+inline void buffer_manager::release_overflow(buffer_manager::block_header* until)
+{
+    while (m_overflow_chain != until) {
+        assert(m_overflow_chain && m_overflow.deallocate);
+        block_header* const previous = m_overflow_chain->previous;
+        detail::unpoison(m_overflow_chain, m_overflow_chain->size);
+        m_overflow.deallocate(m_overflow_chain, m_overflow_chain->size, m_overflow.context);
+        m_overflow_chain = previous;
+    }
+}
+
+inline buffer_manager::size_type buffer_manager::first_block_size() const
+{
+    if (!growable()) {
+        return 0;
+    }
+    return m_growth.initial_block_size > 2 * m_buffer_size ?
+        m_growth.initial_block_size : 2 * m_buffer_size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// scoped_rewind
+////////////////////////////////////////////////////////////////////////////////
+inline scoped_rewind::scoped_rewind(buffer_manager& manager) :
+    m_manager(manager),
+    m_marker(manager.mark())
+{
+    // NOP
+}
+
+inline scoped_rewind::~scoped_rewind()
+{
+    m_manager.rewind(m_marker);
 }
 
 } // namespace memory
@@ -0,0 +1,100 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_BUFFER_RESOURCE_H__
+#define __LAZY_BUFFER_RESOURCE_H__
+
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <lazy/memory/buffer_manager.h>
+
+namespace lazy {
+namespace memory {
+
+// \brief grows a buffer_manager with blocks from a std::pmr::memory_resource
+// \param[in] upstream  where the blocks come from, which has to outlive the manager
+// \param[in] initial_block_size  size of the first block taken from upstream
+growth_policy resource_growth(std::pmr::memory_resource* upstream,
+    growth_policy::size_type initial_block_size = 4096);
+
+// \brief a std::pmr::memory_resource that allocates from a Manager, so std::pmr::vector,
+// std::pmr::map, std::pmr::string and friends can use a buffer without being templated
+// on buffer_allocator, and can be layered under std::pmr::unsynchronized_pool_resource.
+// it either allocates from a Manager you already have, or owns one over your buffer
+// that grows from an upstream resource once the buffer runs out, e.g.
+//
+//     char buffer[4096];
+//     lazy::memory::buffer_resource<> resource(buffer, sizeof(buffer),
+//         std::pmr::new_delete_resource());
+//     std::pmr::vector<int> v(&resource);
+//
+// like the Manager, it is not synchronized unless the Manager is.  chunks asked for with
+// a bigger alignment than the Manager's minimum are padded to it.
+template <typename Manager = buffer_manager>
+class buffer_resource : public std::pmr::memory_resource
+{
+public:
+    typedef typename Manager::size_type size_type;
+
+    // \brief ctor for allocating from a manager that is shared with other allocators
+    // \param[in] manager  the manager, which has to outlive this object
+    explicit buffer_resource(Manager& manager);
+
+    // \brief ctor for a buffer that is only used by this resource
+    // \param[in] buffer  the array to allocate memory from
+    // \param[in] buffer_size  the size of the array in bytes
+    // \param[in] upstream  where to get more memory from once the buffer is exhausted, or 0
+    //                      to throw std::bad_alloc instead
+    // \param[in] alignment  the minimum alignment of every allocation, see buffer_manager
+    buffer_resource(void* buffer, size_type buffer_size,
+        std::pmr::memory_resource* upstream = 0, size_type alignment = 1);
+
+    // \brief gets the buffer_manager
+    Manager& get_buffer_manager() const;
+
+protected:
+    // \brief allocates from the manager
+    virtual void* do_allocate(std::size_t bytes, std::size_t alignment);
+
+    // \brief returns the chunk to the manager, which only reclaims the last one
+    virtual void do_deallocate(void* p, std::size_t bytes, std::size_t alignment);
+
+    // \brief resources are equal if they allocate from the same manager
+    virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept;
+
+private:
+    buffer_resource(const buffer_resource&);
+    buffer_resource& operator=(const buffer_resource&);
+
+    // \brief the Manager if this object owns one, empty if it uses someone else's
+    std::optional<Manager> m_owned_manager;
+
+    // \brief the manager that is actively being used
+    Manager* const m_buffer_manager;
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "buffer_resource.tcc"
+
+#endif // __LAZY_BUFFER_RESOURCE_H__
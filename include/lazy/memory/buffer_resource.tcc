@@ -0,0 +1,117 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_BUFFER_RESOURCE_TCC__
+#define __LAZY_BUFFER_RESOURCE_TCC__
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// resource_growth
+////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+
+inline void* resource_allocate(growth_policy::size_type n, void* context)
+{
+    // growth_policy reports failure with 0 rather than an exception
+    try {
+        return static_cast<std::pmr::memory_resource*>(context)->allocate(n,
+            alignof(std::max_align_t));
+    } catch (const std::bad_alloc&) {
+        return 0;
+    }
+}
+
+inline void resource_deallocate(void* p, growth_policy::size_type n, void* context)
+{
+    static_cast<std::pmr::memory_resource*>(context)->deallocate(p, n,
+        alignof(std::max_align_t));
+}
+
+} // namespace detail
+
+inline growth_policy resource_growth(std::pmr::memory_resource* upstream,
+    growth_policy::size_type initial_block_size)
+{
+    growth_policy policy;
+    policy.allocate = &detail::resource_allocate;
+    policy.deallocate = &detail::resource_deallocate;
+    policy.context = upstream;
+    policy.initial_block_size = initial_block_size;
+    return policy;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// buffer_resource
+////////////////////////////////////////////////////////////////////////////////
+template <typename Manager>
+inline buffer_resource<Manager>::buffer_resource(Manager& manager) :
+    m_buffer_manager(&manager)
+{
+    // NOP
+}
+
+template <typename Manager>
+inline buffer_resource<Manager>::buffer_resource(void* buffer,
+        typename buffer_resource<Manager>::size_type buffer_size,
+        std::pmr::memory_resource* upstream,
+        typename buffer_resource<Manager>::size_type alignment) :
+    m_owned_manager(std::in_place, buffer, buffer_size,
+        upstream ? resource_growth(upstream) : detail::no_growth(), alignment),
+    m_buffer_manager(&*m_owned_manager)
+{
+    // NOP
+}
+
+template <typename Manager>
+inline Manager& buffer_resource<Manager>::get_buffer_manager() const
+{
+    return *m_buffer_manager;
+}
+
+template <typename Manager>
+inline void* buffer_resource<Manager>::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    return m_buffer_manager->allocate(bytes, alignment);
+}
+
+template <typename Manager>
+inline void buffer_resource<Manager>::do_deallocate(void* p, std::size_t bytes, std::size_t)
+{
+    m_buffer_manager->deallocate(p, bytes);
+}
+
+template <typename Manager>
+inline bool buffer_resource<Manager>::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept
+{
+    if (this == &other) {
+        return true;
+    }
+    const buffer_resource<Manager>* const resource =
+        dynamic_cast<const buffer_resource<Manager>*>(&other);
+    return resource && &resource->get_buffer_manager() == m_buffer_manager;
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_BUFFER_RESOURCE_TCC__
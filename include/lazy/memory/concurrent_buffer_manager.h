@@ -0,0 +1,148 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_CONCURRENT_BUFFER_MANAGER_H__
+#define __LAZY_CONCURRENT_BUFFER_MANAGER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+
+namespace lazy {
+namespace memory {
+
+// \brief manages the allocation of memory from a buffer shared by many threads without
+// locking.  the cursor is an atomic that allocations bump with a single fetch-add when
+// the chunk needs no more than the minimum alignment, or with a compare-and-swap loop
+// when it has to be padded to a bigger boundary.  chunk sizes are rounded up to the
+// minimum alignment so the cursor always stays on it.
+//
+// unlike buffer_manager, the buffer never grows, and once an allocation fails the buffer
+// is considered exhausted even if a smaller chunk would still have fit.
+class concurrent_buffer_manager
+{
+public:
+    typedef std::size_t size_type;
+
+    // \brief the default minimum alignment, which keeps every fundamental type on the
+    // fetch-add path
+    static const size_type default_alignment = alignof(std::max_align_t);
+
+    // \brief ctor
+    // \param[in] buffer  pointer to the buffer to use for allocation
+    // \param[in] buffer_size  size of the buffer.  make sure they match.
+    // \param[in] alignment  the minimum alignment of every chunk handed out.  must be a
+    //                        power of 2.
+    concurrent_buffer_manager(void* buffer, size_type buffer_size,
+        size_type alignment = default_alignment);
+
+    // \brief the buffer size in this class
+    size_type buffer_size() const;
+
+    // \brief the amount of space remaining in buffer
+    size_type available() const;
+
+    // \brief the number of bytes taken from the buffer, including the rounding
+    size_type used() const;
+
+    // \brief the largest number of bytes that could ever be handed out
+    size_type max_size() const;
+
+    // \brief the minimum alignment of the chunks handed out
+    size_type alignment() const;
+
+    // \brief allocates a chunk of memory of requested size, aligned to the minimum alignment
+    // \param[in] n   size of chunk in bytes
+    void* allocate(size_type n);
+
+    // \brief allocates a chunk of memory of requested size and alignment
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* allocate(size_type n, size_type alignment);
+
+    // \brief allocates a chunk like allocate() does, but returns 0 instead of throwing
+    // std::bad_alloc once the buffer runs out
+    // \param[in] n   size of chunk in bytes
+    void* try_allocate(size_type n);
+
+    // \brief allocates a chunk like allocate() does, but returns 0 instead of throwing
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* try_allocate(size_type n, size_type alignment);
+
+    // \brief returns a chunk to the buffer, which only reclaims it if no other thread
+    // allocated after it
+    // \param[in] p  the chunk
+    // \param[in] n  size of the chunk in bytes
+    void deallocate(void* p, size_type n);
+
+    // \brief tries to resize the most recent chunk in place
+    // \param[in] p  the chunk
+    // \param[in] n  current size of the chunk in bytes
+    // \param[in] new_n  the size the chunk needs to be
+    // \return true if the chunk now holds new_n bytes
+    bool try_expand(void* p, size_type n, size_type new_n);
+
+    // \brief releases everything.  this must not race with anything else.
+    void reset();
+
+protected:
+    // \brief rounds the chunk size up to the minimum alignment
+    size_type round_up(size_type n) const;
+
+    // \brief block of memory, moved up to the minimum alignment
+    char* const m_buffer;
+
+    // \brief buffer size from m_buffer on
+    const size_type m_buffer_size;
+
+    // \brief minimum alignment of the chunks handed out
+    const size_type m_alignment;
+
+    // \brief the number of bytes allocated, which only overshoots m_buffer_size for as long
+    // as racing requests take to give back what didn't fit
+    std::atomic<size_type> m_bytes_allocated;
+
+private:
+    concurrent_buffer_manager(const concurrent_buffer_manager&);
+    concurrent_buffer_manager& operator=(const concurrent_buffer_manager&);
+};
+
+namespace detail {
+
+// \brief bumps an atomic cursor over a buffer by a chunk padded to the alignment, which
+// is the slow path of concurrent_buffer_manager.  returns 0 if the chunk doesn't fit.
+// \param[in,out] cursor  the offset of the first free byte
+// \param[in] buffer  start of the buffer
+// \param[in] buffer_size  size of the buffer
+// \param[in] n  size of the chunk, already rounded up as needed
+// \param[in] alignment  power of 2 the chunk must be aligned to
+void* atomic_bump(std::atomic<std::size_t>& cursor, char* buffer, std::size_t buffer_size,
+    std::size_t n, std::size_t alignment);
+
+} // namespace detail
+
+} // namespace memory
+} // namespace lazy
+
+#include "concurrent_buffer_manager.tcc"
+
+#endif // __LAZY_CONCURRENT_BUFFER_MANAGER_H__
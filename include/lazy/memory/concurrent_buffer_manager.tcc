@@ -0,0 +1,195 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_CONCURRENT_BUFFER_MANAGER_TCC__
+#define __LAZY_CONCURRENT_BUFFER_MANAGER_TCC__
+
+#include <cassert>
+#include <stdint.h>
+#include <bits/functexcept.h>
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// detail
+////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+
+inline void* atomic_bump(std::atomic<std::size_t>& cursor, char* buffer,
+    std::size_t buffer_size, std::size_t n, std::size_t alignment)
+{
+    std::size_t offset = cursor.load(std::memory_order_relaxed);
+    for (;;) {
+        if (offset > buffer_size) {
+            return 0;
+        }
+        const uintptr_t address = reinterpret_cast<uintptr_t>(buffer) + offset;
+        const std::size_t padding = static_cast<std::size_t>(-address & (alignment - 1));
+        const std::size_t remains = buffer_size - offset;
+        if (remains < padding || remains - padding < n) {
+            return 0;
+        }
+        // on failure offset is reloaded with whatever another thread left behind
+        if (cursor.compare_exchange_weak(offset, offset + padding + n,
+                std::memory_order_relaxed)) {
+            return buffer + offset + padding;
+        }
+    }
+}
+
+inline char* align_buffer(void* buffer, std::size_t buffer_size, std::size_t alignment)
+{
+    const uintptr_t address = reinterpret_cast<uintptr_t>(buffer);
+    const std::size_t padding = static_cast<std::size_t>(-address & (alignment - 1));
+    return static_cast<char*>(buffer) + (padding < buffer_size ? padding : buffer_size);
+}
+
+inline std::size_t aligned_buffer_size(void* buffer, std::size_t buffer_size,
+    std::size_t alignment)
+{
+    return buffer_size - (align_buffer(buffer, buffer_size, alignment) -
+        static_cast<char*>(buffer));
+}
+
+} // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////
+// concurrent_buffer_manager
+////////////////////////////////////////////////////////////////////////////////
+inline concurrent_buffer_manager::concurrent_buffer_manager(void* buffer,
+        concurrent_buffer_manager::size_type buffer_size,
+        concurrent_buffer_manager::size_type alignment) :
+    m_buffer(detail::align_buffer(buffer, buffer_size, alignment)),
+    m_buffer_size(detail::aligned_buffer_size(buffer, buffer_size, alignment)),
+    m_alignment(alignment),
+    m_bytes_allocated(0)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+}
+
+inline concurrent_buffer_manager::size_type concurrent_buffer_manager::buffer_size() const
+{
+    return m_buffer_size;
+}
+
+inline concurrent_buffer_manager::size_type concurrent_buffer_manager::available() const
+{
+    const size_type allocated = m_bytes_allocated.load(std::memory_order_relaxed);
+    return allocated < m_buffer_size ? m_buffer_size - allocated : 0;
+}
+
+inline concurrent_buffer_manager::size_type concurrent_buffer_manager::used() const
+{
+    return m_buffer_size - available();
+}
+
+inline concurrent_buffer_manager::size_type concurrent_buffer_manager::max_size() const
+{
+    return m_buffer_size;
+}
+
+inline concurrent_buffer_manager::size_type concurrent_buffer_manager::alignment() const
+{
+    return m_alignment;
+}
+
+inline void* concurrent_buffer_manager::allocate(concurrent_buffer_manager::size_type n)
+{
+    return allocate(n, m_alignment);
+}
+
+inline void* concurrent_buffer_manager::allocate(concurrent_buffer_manager::size_type n,
+    concurrent_buffer_manager::size_type alignment)
+{
+    void* const cursor = try_allocate(n, alignment);
+    if (!cursor) {
+        std::__throw_bad_alloc();
+    }
+    return cursor;
+}
+
+inline void* concurrent_buffer_manager::try_allocate(concurrent_buffer_manager::size_type n)
+{
+    return try_allocate(n, m_alignment);
+}
+
+inline void* concurrent_buffer_manager::try_allocate(concurrent_buffer_manager::size_type n,
+    concurrent_buffer_manager::size_type alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    const size_type bytes = round_up(n);
+    // a request that can never fit must not move the cursor, or it could wrap around
+    if (bytes < n || bytes > m_buffer_size) {
+        return 0;
+    }
+    // the cursor is always on the minimum alignment, so no padding is needed.  a request that
+    // doesn't fit takes the slow path, which fails without moving the cursor past the end
+    const size_type allocated = m_bytes_allocated.load(std::memory_order_relaxed);
+    if (alignment <= m_alignment && allocated <= m_buffer_size
+        && m_buffer_size - allocated >= bytes) {
+        const size_type offset = m_bytes_allocated.fetch_add(bytes, std::memory_order_relaxed);
+        if (offset <= m_buffer_size && m_buffer_size - offset >= bytes) {
+            return m_buffer + offset;
+        }
+        // another thread got there first; give the bytes back unless someone bumped past us
+        size_type expected = offset + bytes;
+        m_bytes_allocated.compare_exchange_strong(expected, offset, std::memory_order_relaxed);
+        return 0;
+    }
+    return detail::atomic_bump(m_bytes_allocated, m_buffer, m_buffer_size, bytes, alignment);
+}
+
+inline void concurrent_buffer_manager::deallocate(void* p,
+    concurrent_buffer_manager::size_type n)
+{
+    const size_type offset = static_cast<char*>(p) - m_buffer;
+    size_type expected = offset + round_up(n);
+    m_bytes_allocated.compare_exchange_strong(expected, offset, std::memory_order_relaxed);
+}
+
+inline bool concurrent_buffer_manager::try_expand(void* p,
+    concurrent_buffer_manager::size_type n, concurrent_buffer_manager::size_type new_n)
+{
+    const size_type offset = static_cast<char*>(p) - m_buffer;
+    const size_type bytes = round_up(new_n);
+    if (bytes < new_n || bytes > m_buffer_size - offset) {
+        return false;
+    }
+    size_type expected = offset + round_up(n);
+    return m_bytes_allocated.compare_exchange_strong(expected, offset + bytes,
+        std::memory_order_relaxed);
+}
+
+inline void concurrent_buffer_manager::reset()
+{
+    m_bytes_allocated.store(0, std::memory_order_relaxed);
+}
+
+inline concurrent_buffer_manager::size_type concurrent_buffer_manager::round_up(
+    concurrent_buffer_manager::size_type n) const
+{
+    return (n + m_alignment - 1) & ~(m_alignment - 1);
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_CONCURRENT_BUFFER_MANAGER_TCC__
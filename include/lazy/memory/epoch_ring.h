@@ -0,0 +1,164 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_EPOCH_RING_H__
+#define __LAZY_EPOCH_RING_H__
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <lazy/memory/buffer_manager.h>
+
+namespace lazy {
+namespace memory {
+
+// \brief a ring of N arenas for pipelines, where the containers a stage builds for a
+// batch have to outlive the stage until every stage downstream is done with them, which
+// a single buffer_manager rewound after each batch can't do.  the buffer is cut into N
+// arenas of the same size, each cut up by its own Manager.
+//
+// every batch is an epoch.  begin() starts the next one in the next arena, and says how
+// many consumers have to retire() it before the arena can be used again.  when the ring
+// comes back around to an arena whose epoch has been retired, the arena is reset in
+// O(1), which frees everything allocated during that epoch at once.  if it hasn't been
+// retired yet, the pipeline is N batches deep and begin() fails until it is.
+//
+// one thread begins epochs and allocates from them.  consumers may retain() and retire()
+// them from any thread, as long as they hold a reference, and the last retire()
+// publishes whatever the consumers did to the arena's memory to the thread that reuses
+// it.  the producer doesn't need a reference to keep allocating from the current epoch,
+// since nothing resets it but the producer itself.
+template <std::size_t N, typename Manager = buffer_manager>
+class epoch_ring
+{
+public:
+    typedef typename Manager::size_type size_type;
+
+    // \brief numbers the epochs from 1 in the order they were begun
+    typedef unsigned long long epoch_type;
+
+    // \brief the number of arenas
+    static constexpr size_type arena_count = N;
+
+    // \brief ctor
+    // \param[in] buffer  pointer to the buffer to cut into arenas
+    // \param[in] buffer_size  size of the buffer.  make sure they match.
+    // \param[in] alignment  the minimum alignment of every chunk handed out, see Manager
+    epoch_ring(void* buffer, size_type buffer_size, size_type alignment = 1);
+
+    // \brief ctor for arenas that grow from upstream when they run out
+    // \param[in] buffer  pointer to the buffer to cut into arenas
+    // \param[in] buffer_size  size of the buffer.  make sure they match.
+    // \param[in] growth  where every arena gets blocks from once its part of the buffer
+    //                    is exhausted
+    // \param[in] alignment  the minimum alignment of every chunk handed out, see Manager
+    epoch_ring(void* buffer, size_type buffer_size, const growth_policy& growth,
+        size_type alignment = 1);
+
+    // \brief dtor, destroys the arenas whether their epochs were retired or not
+    ~epoch_ring();
+
+    // \brief the size of the part of the buffer each arena gets
+    size_type arena_size() const;
+
+    // \brief starts the next epoch in the next arena, which is reset first
+    // \param[in] consumers  the number of retire() calls it takes to recycle the arena
+    // \return the new epoch
+    // \throw std::bad_alloc if the arena's last epoch hasn't been retired yet
+    epoch_type begin(size_type consumers = 1);
+
+    // \brief starts the next epoch like begin() does, but returns false instead of
+    // throwing if the arena's last epoch hasn't been retired yet
+    // \param[out] epoch  receives the new epoch
+    // \param[in] consumers  the number of retire() calls it takes to recycle the arena
+    bool try_begin(epoch_type& epoch, size_type consumers = 1);
+
+    // \brief the latest epoch, or 0 before the first one
+    epoch_type current() const;
+
+    // \brief the arena an epoch allocates from
+    // \param[in] epoch  an epoch that hasn't been retired yet, or the current one
+    Manager& arena(epoch_type epoch);
+
+    // \brief adds consumers to an epoch.  the caller must hold a reference to it.
+    // \param[in] epoch  an epoch that hasn't been retired yet
+    // \param[in] consumers  the number of retire() calls to add
+    void retain(epoch_type epoch, size_type consumers = 1);
+
+    // \brief drops a reference to an epoch.  once every consumer has, the arena can be
+    // recycled by begin().
+    // \param[in] epoch  an epoch the caller holds a reference to
+    void retire(epoch_type epoch);
+
+    // \brief whether every consumer has retired the epoch, which includes the epochs
+    // whose arenas have been recycled since.  only the producer can rely on the answer
+    // staying true.
+    // \param[in] epoch  an epoch
+    bool retired(epoch_type epoch) const;
+
+protected:
+    static_assert(N > 0, "an epoch_ring needs at least one arena");
+
+    // \brief what the ring keeps for every arena
+    struct slot
+    {
+        // \brief the consumers that haven't retired the epoch yet
+        std::atomic<size_type> references;
+
+        // \brief the epoch the arena was last begun for, or 0
+        epoch_type epoch;
+    };
+
+    // \brief the arena an epoch goes in
+    static size_type index(epoch_type epoch);
+
+    // \brief the manager of an arena
+    Manager& manager(size_type index);
+
+    // \brief the part of the buffer an arena gets
+    void* part(size_type index) const;
+
+    // \brief the buffer
+    void* const m_buffer;
+
+    // \brief the size of the part of the buffer each arena gets
+    const size_type m_arena_size;
+
+    // \brief the arenas, constructed in place since Manager can't be default constructed
+    typename std::aligned_storage<sizeof(Manager), alignof(Manager)>::type m_managers[N];
+
+    // \brief the state of every arena
+    slot m_slots[N];
+
+    // \brief the latest epoch
+    epoch_type m_epoch;
+
+private:
+    epoch_ring(const epoch_ring&);
+    epoch_ring& operator=(const epoch_ring&);
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "epoch_ring.tcc"
+
+#endif // __LAZY_EPOCH_RING_H__
@@ -0,0 +1,190 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_EPOCH_RING_TCC__
+#define __LAZY_EPOCH_RING_TCC__
+
+#include <cassert>
+#include <new>
+#include <bits/functexcept.h>
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// epoch_ring
+////////////////////////////////////////////////////////////////////////////////
+template <std::size_t N, typename Manager>
+inline epoch_ring<N, Manager>::epoch_ring(void* buffer,
+        typename epoch_ring<N, Manager>::size_type buffer_size,
+        typename epoch_ring<N, Manager>::size_type alignment) :
+    m_buffer(buffer),
+    m_arena_size(buffer_size / N),
+    m_epoch(0)
+{
+    size_type i = 0;
+    try {
+        for (; i < N; ++i) {
+            new (&m_managers[i]) Manager(part(i), m_arena_size, alignment);
+            m_slots[i].references.store(0, std::memory_order_relaxed);
+            m_slots[i].epoch = 0;
+        }
+    } catch (...) {
+        while (i > 0) {
+            manager(--i).~Manager();
+        }
+        throw;
+    }
+}
+
+template <std::size_t N, typename Manager>
+inline epoch_ring<N, Manager>::epoch_ring(void* buffer,
+        typename epoch_ring<N, Manager>::size_type buffer_size, const growth_policy& growth,
+        typename epoch_ring<N, Manager>::size_type alignment) :
+    m_buffer(buffer),
+    m_arena_size(buffer_size / N),
+    m_epoch(0)
+{
+    size_type i = 0;
+    try {
+        for (; i < N; ++i) {
+            new (&m_managers[i]) Manager(part(i), m_arena_size, growth, alignment);
+            m_slots[i].references.store(0, std::memory_order_relaxed);
+            m_slots[i].epoch = 0;
+        }
+    } catch (...) {
+        while (i > 0) {
+            manager(--i).~Manager();
+        }
+        throw;
+    }
+}
+
+template <std::size_t N, typename Manager>
+inline epoch_ring<N, Manager>::~epoch_ring()
+{
+    for (size_type i = 0; i < N; ++i) {
+        manager(i).~Manager();
+    }
+}
+
+template <std::size_t N, typename Manager>
+inline typename epoch_ring<N, Manager>::size_type epoch_ring<N, Manager>::arena_size() const
+{
+    return m_arena_size;
+}
+
+template <std::size_t N, typename Manager>
+inline typename epoch_ring<N, Manager>::epoch_type epoch_ring<N, Manager>::begin(
+    typename epoch_ring<N, Manager>::size_type consumers)
+{
+    epoch_type epoch;
+    if (!try_begin(epoch, consumers)) {
+        std::__throw_bad_alloc();
+    }
+    return epoch;
+}
+
+template <std::size_t N, typename Manager>
+inline bool epoch_ring<N, Manager>::try_begin(
+    typename epoch_ring<N, Manager>::epoch_type& epoch,
+    typename epoch_ring<N, Manager>::size_type consumers)
+{
+    assert(consumers > 0);
+    const epoch_type next = m_epoch + 1;
+    slot& s = m_slots[index(next)];
+    // pairs with the release in retire(), so the consumers are done with the memory
+    // before it is handed out again
+    if (s.references.load(std::memory_order_acquire) != 0) {
+        return false;
+    }
+    manager(index(next)).reset();
+    s.epoch = next;
+    s.references.store(consumers, std::memory_order_relaxed);
+    m_epoch = next;
+    epoch = next;
+    return true;
+}
+
+template <std::size_t N, typename Manager>
+inline typename epoch_ring<N, Manager>::epoch_type epoch_ring<N, Manager>::current() const
+{
+    return m_epoch;
+}
+
+template <std::size_t N, typename Manager>
+inline Manager& epoch_ring<N, Manager>::arena(typename epoch_ring<N, Manager>::epoch_type epoch)
+{
+    assert(epoch != 0 && m_slots[index(epoch)].epoch == epoch);
+    return manager(index(epoch));
+}
+
+template <std::size_t N, typename Manager>
+inline void epoch_ring<N, Manager>::retain(typename epoch_ring<N, Manager>::epoch_type epoch,
+    typename epoch_ring<N, Manager>::size_type consumers)
+{
+    slot& s = m_slots[index(epoch)];
+    assert(s.epoch == epoch);
+    const size_type before = s.references.fetch_add(consumers, std::memory_order_relaxed);
+    assert(before > 0);
+    static_cast<void>(before);
+}
+
+template <std::size_t N, typename Manager>
+inline void epoch_ring<N, Manager>::retire(typename epoch_ring<N, Manager>::epoch_type epoch)
+{
+    slot& s = m_slots[index(epoch)];
+    assert(s.epoch == epoch);
+    const size_type before = s.references.fetch_sub(1, std::memory_order_release);
+    assert(before > 0);
+    static_cast<void>(before);
+}
+
+template <std::size_t N, typename Manager>
+inline bool epoch_ring<N, Manager>::retired(
+    typename epoch_ring<N, Manager>::epoch_type epoch) const
+{
+    const slot& s = m_slots[index(epoch)];
+    return s.epoch != epoch || s.references.load(std::memory_order_acquire) == 0;
+}
+
+template <std::size_t N, typename Manager>
+inline typename epoch_ring<N, Manager>::size_type epoch_ring<N, Manager>::index(
+    typename epoch_ring<N, Manager>::epoch_type epoch)
+{
+    return static_cast<size_type>((epoch - 1) % N);
+}
+
+template <std::size_t N, typename Manager>
+inline Manager& epoch_ring<N, Manager>::manager(typename epoch_ring<N, Manager>::size_type index)
+{
+    return *reinterpret_cast<Manager*>(&m_managers[index]);
+}
+
+template <std::size_t N, typename Manager>
+inline void* epoch_ring<N, Manager>::part(typename epoch_ring<N, Manager>::size_type index) const
+{
+    return static_cast<char*>(m_buffer) + index * m_arena_size;
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_EPOCH_RING_TCC__
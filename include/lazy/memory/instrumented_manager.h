@@ -0,0 +1,206 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_INSTRUMENTED_MANAGER_H__
+#define __LAZY_INSTRUMENTED_MANAGER_H__
+
+#include <cstdlib>
+#include <iosfwd>
+#include <typeinfo>
+#include <lazy/memory/buffer_allocator.h>
+#include <lazy/memory/buffer_manager.h>
+
+namespace lazy {
+namespace memory {
+
+// \brief a snapshot of what an instrumented_manager has been asked for
+struct allocation_statistics
+{
+    typedef std::size_t size_type;
+
+    // \brief number of buckets in the size histogram, one per power of 2
+    static const size_type histogram_size = sizeof(size_type) * 8;
+
+    // \brief number of types broken down separately.  the types seen after the table
+    // fills up are lumped together in the last entry, which has no type.
+    static const size_type max_types = 16;
+
+    // \brief what was allocated through buffer_allocator for one type
+    struct type_statistics
+    {
+        // \brief the type, or 0 for the types that did not fit in the table
+        const std::type_info* type;
+
+        // \brief number of allocations for this type
+        size_type allocations;
+
+        // \brief number of deallocations for this type
+        size_type deallocations;
+
+        // \brief bytes asked for by the allocations for this type
+        size_type bytes_requested;
+    };
+
+    // \brief number of allocations
+    size_type allocations;
+
+    // \brief number of deallocations
+    size_type deallocations;
+
+    // \brief number of chunks that were resized in place by try_expand()
+    size_type expansions;
+
+    // \brief number of allocations that threw
+    size_type failures;
+
+    // \brief bytes asked for by the allocations
+    size_type bytes_requested;
+
+    // \brief bytes the allocations took from the buffer, including alignment padding and
+    // the tails of blocks left behind on growth.  chunks recycled by a pool_manager take
+    // nothing.  compared to bytes_requested, this is the overhead of the manager.
+    size_type bytes_consumed;
+
+    // \brief bytes handed back through deallocate()
+    size_type bytes_released;
+
+    // \brief bytes taken from the buffer when the snapshot was taken, see used()
+    size_type used;
+
+    // \brief the highest used has ever been
+    size_type peak_used;
+
+    // \brief the buffer size when the snapshot was taken, so peak_used / buffer_size is how
+    // close the manager has come to running out
+    size_type buffer_size;
+
+    // \brief bucket i counts the allocations of [2^i, 2^(i + 1)) bytes, zero bytes included
+    // in bucket 0
+    size_type histogram[histogram_size];
+
+    // \brief number of entries used in types
+    size_type type_count;
+
+    // \brief allocations through buffer_allocator broken down by the type they were for,
+    // in the order the types were first seen
+    type_statistics types[max_types];
+};
+
+// \brief writes the statistics one metric per line as "name value", with the type
+// breakdown as "type.<name>.allocations value" and friends, for feeding to a metrics
+// pipeline or a log.
+// \param[in] os  where to write to
+// \param[in] stats  the snapshot to write
+// \param[in] prefix  put in front of every metric name, e.g. "arena.parser."
+void write_statistics(std::ostream& os, const allocation_statistics& stats,
+    const char* prefix = "");
+
+// \brief wraps a Manager and keeps allocation_statistics on everything it is asked for.
+// this is opt-in: allocators that use the Manager directly pay nothing, so the
+// instrumented one can be swapped in with a typedef, e.g.
+//
+//     typedef lazy::memory::instrumented_manager<lazy::memory::pool_manager> manager_type;
+//     typedef lazy::memory::buffer_allocator<node, manager_type> allocator_type;
+//
+// every Manager with a used() method can be wrapped.  buffer_allocator tells this class
+// the type of every allocation it makes, so the statistics can tell map nodes from bucket
+// arrays; allocations made on the manager directly show up in the totals only.
+//
+// the statistics are not synchronized, so a concurrent manager can only be instrumented
+// while one thread at a time uses it.  rewinding a buffer_manager is not counted as
+// deallocations, but shows up in used.
+template <typename Manager = buffer_manager>
+class instrumented_manager : public Manager
+{
+public:
+    typedef typename Manager::size_type size_type;
+
+    // \brief ctor, takes the same arguments as Manager
+    // \param[in] buffer  pointer to the buffer to use for allocation
+    // \param[in] buffer_size  size of the buffer.  make sure they match.
+    // \param[in] args  the rest of the arguments for the Manager ctor
+    template <typename... Args>
+    instrumented_manager(void* buffer, size_type buffer_size, const Args&... args);
+
+    // \brief allocates from Manager and counts it
+    // \param[in] n   size of chunk in bytes
+    void* allocate(size_type n);
+
+    // \brief allocates from Manager and counts it
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* allocate(size_type n, size_type alignment);
+
+    // \brief allocates from Manager without throwing and counts it, or the failure
+    // \param[in] n   size of chunk in bytes
+    void* try_allocate(size_type n);
+
+    // \brief allocates from Manager without throwing and counts it, or the failure
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* try_allocate(size_type n, size_type alignment);
+
+    // \brief returns a chunk to Manager and counts it
+    // \param[in] p  the chunk
+    // \param[in] n  size of the chunk in bytes
+    void deallocate(void* p, size_type n);
+
+    // \brief resizes a chunk in place through Manager and counts it if it worked
+    // \param[in] p  the chunk
+    // \param[in] n  current size of the chunk in bytes
+    // \param[in] new_n  the size the chunk needs to be
+    bool try_expand(void* p, size_type n, size_type new_n);
+
+    // \brief called by buffer_allocator after every allocation and deallocation it makes
+    // \param[in] type  the type allocated for
+    // \param[in] bytes  size of the chunk in bytes
+    // \param[in] allocated  true for an allocation, false for a deallocation
+    void record_type(const std::type_info& type, size_type bytes, bool allocated);
+
+    // \brief a copy of the statistics so far
+    allocation_statistics statistics() const;
+
+    // \brief starts counting from scratch, with the peak at the current usage
+    void reset_statistics();
+
+private:
+    // \brief counts an allocation of n bytes that moved usage from before on
+    void count_allocation(size_type n, size_type before);
+
+    // \brief the entry in the type table for the type, adding it if there is room
+    allocation_statistics::type_statistics& type_entry(const std::type_info& type);
+
+    // \brief what has been counted so far
+    allocation_statistics m_statistics;
+};
+
+// \brief every instrumented_manager wants to know the types buffer_allocator allocates
+template <typename Manager>
+struct records_types<instrumented_manager<Manager> > : public std::true_type
+{
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "instrumented_manager.tcc"
+
+#endif // __LAZY_INSTRUMENTED_MANAGER_H__
@@ -0,0 +1,249 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_INSTRUMENTED_MANAGER_TCC__
+#define __LAZY_INSTRUMENTED_MANAGER_TCC__
+
+#include <cstring>
+#include <cxxabi.h>
+#include <ostream>
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// instrumented_manager
+////////////////////////////////////////////////////////////////////////////////
+template <typename Manager>
+template <typename... Args>
+inline instrumented_manager<Manager>::instrumented_manager(void* buffer,
+        typename instrumented_manager<Manager>::size_type buffer_size, const Args&... args) :
+    Manager(buffer, buffer_size, args...)
+{
+    std::memset(&m_statistics, 0, sizeof(m_statistics));
+    m_statistics.peak_used = Manager::used();
+}
+
+template <typename Manager>
+inline void* instrumented_manager<Manager>::allocate(
+    typename instrumented_manager<Manager>::size_type n)
+{
+    const size_type before = Manager::used();
+    void* p;
+    try {
+        p = Manager::allocate(n);
+    } catch (...) {
+        ++m_statistics.failures;
+        throw;
+    }
+    count_allocation(n, before);
+    return p;
+}
+
+template <typename Manager>
+inline void* instrumented_manager<Manager>::allocate(
+    typename instrumented_manager<Manager>::size_type n,
+    typename instrumented_manager<Manager>::size_type alignment)
+{
+    const size_type before = Manager::used();
+    void* p;
+    try {
+        p = Manager::allocate(n, alignment);
+    } catch (...) {
+        ++m_statistics.failures;
+        throw;
+    }
+    count_allocation(n, before);
+    return p;
+}
+
+template <typename Manager>
+inline void* instrumented_manager<Manager>::try_allocate(
+    typename instrumented_manager<Manager>::size_type n)
+{
+    const size_type before = Manager::used();
+    void* const p = Manager::try_allocate(n);
+    if (!p) {
+        ++m_statistics.failures;
+        return 0;
+    }
+    count_allocation(n, before);
+    return p;
+}
+
+template <typename Manager>
+inline void* instrumented_manager<Manager>::try_allocate(
+    typename instrumented_manager<Manager>::size_type n,
+    typename instrumented_manager<Manager>::size_type alignment)
+{
+    const size_type before = Manager::used();
+    void* const p = Manager::try_allocate(n, alignment);
+    if (!p) {
+        ++m_statistics.failures;
+        return 0;
+    }
+    count_allocation(n, before);
+    return p;
+}
+
+template <typename Manager>
+inline void instrumented_manager<Manager>::deallocate(void* p,
+    typename instrumented_manager<Manager>::size_type n)
+{
+    Manager::deallocate(p, n);
+    ++m_statistics.deallocations;
+    m_statistics.bytes_released += n;
+}
+
+template <typename Manager>
+inline bool instrumented_manager<Manager>::try_expand(void* p,
+    typename instrumented_manager<Manager>::size_type n,
+    typename instrumented_manager<Manager>::size_type new_n)
+{
+    if (!Manager::try_expand(p, n, new_n)) {
+        return false;
+    }
+    ++m_statistics.expansions;
+    const size_type used = Manager::used();
+    if (used > m_statistics.peak_used) {
+        m_statistics.peak_used = used;
+    }
+    return true;
+}
+
+template <typename Manager>
+inline void instrumented_manager<Manager>::record_type(const std::type_info& type,
+    typename instrumented_manager<Manager>::size_type bytes, bool allocated)
+{
+    allocation_statistics::type_statistics& entry = type_entry(type);
+    if (allocated) {
+        ++entry.allocations;
+        entry.bytes_requested += bytes;
+    } else {
+        ++entry.deallocations;
+    }
+}
+
+template <typename Manager>
+inline allocation_statistics instrumented_manager<Manager>::statistics() const
+{
+    allocation_statistics snapshot = m_statistics;
+    snapshot.used = Manager::used();
+    snapshot.buffer_size = Manager::buffer_size();
+    return snapshot;
+}
+
+template <typename Manager>
+inline void instrumented_manager<Manager>::reset_statistics()
+{
+    std::memset(&m_statistics, 0, sizeof(m_statistics));
+    m_statistics.peak_used = Manager::used();
+}
+
+template <typename Manager>
+inline void instrumented_manager<Manager>::count_allocation(
+    typename instrumented_manager<Manager>::size_type n,
+    typename instrumented_manager<Manager>::size_type before)
+{
+    ++m_statistics.allocations;
+    m_statistics.bytes_requested += n;
+
+    const size_type used = Manager::used();
+    if (used > before) {
+        m_statistics.bytes_consumed += used - before;
+    }
+    if (used > m_statistics.peak_used) {
+        m_statistics.peak_used = used;
+    }
+
+    size_type bucket = 0;
+    while (n >>= 1) {
+        ++bucket;
+    }
+    ++m_statistics.histogram[bucket];
+}
+
+template <typename Manager>
+inline allocation_statistics::type_statistics& instrumented_manager<Manager>::type_entry(
+    const std::type_info& type)
+{
+    // a linear search is fine for the handful of types a manager usually sees, and the
+    // most recent type is checked first since containers allocate in runs
+    allocation_statistics::type_statistics* const types = m_statistics.types;
+    const size_type count = m_statistics.type_count;
+    for (size_type i = count; i > 0; --i) {
+        if (types[i - 1].type && *types[i - 1].type == type) {
+            return types[i - 1];
+        }
+    }
+    if (count < allocation_statistics::max_types - 1) {
+        types[count].type = &type;
+        ++m_statistics.type_count;
+        return types[count];
+    }
+    // everything else goes in the last entry
+    m_statistics.type_count = allocation_statistics::max_types;
+    types[allocation_statistics::max_types - 1].type = 0;
+    return types[allocation_statistics::max_types - 1];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// write_statistics
+////////////////////////////////////////////////////////////////////////////////
+inline void write_statistics(std::ostream& os, const allocation_statistics& stats,
+    const char* prefix)
+{
+    os << prefix << "allocations " << stats.allocations << '\n'
+       << prefix << "deallocations " << stats.deallocations << '\n'
+       << prefix << "expansions " << stats.expansions << '\n'
+       << prefix << "failures " << stats.failures << '\n'
+       << prefix << "bytes_requested " << stats.bytes_requested << '\n'
+       << prefix << "bytes_consumed " << stats.bytes_consumed << '\n'
+       << prefix << "bytes_released " << stats.bytes_released << '\n'
+       << prefix << "used " << stats.used << '\n'
+       << prefix << "peak_used " << stats.peak_used << '\n'
+       << prefix << "buffer_size " << stats.buffer_size << '\n';
+
+    // only the buckets that were hit, named after the smallest size they count, except
+    // that the first one counts zero byte allocations too
+    for (allocation_statistics::size_type i = 0; i < allocation_statistics::histogram_size; ++i) {
+        if (stats.histogram[i]) {
+            os << prefix << "histogram." << (allocation_statistics::size_type(1) << i) << ' '
+               << stats.histogram[i] << '\n';
+        }
+    }
+
+    for (allocation_statistics::size_type i = 0; i < stats.type_count; ++i) {
+        const allocation_statistics::type_statistics& entry = stats.types[i];
+        int status = 0;
+        char* demangled = entry.type ?
+            abi::__cxa_demangle(entry.type->name(), 0, 0, &status) : 0;
+        const char* name = !entry.type ? "other" : (demangled ? demangled : entry.type->name());
+        os << prefix << "type." << name << ".allocations " << entry.allocations << '\n'
+           << prefix << "type." << name << ".deallocations " << entry.deallocations << '\n'
+           << prefix << "type." << name << ".bytes_requested " << entry.bytes_requested << '\n';
+        std::free(demangled);
+    }
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_INSTRUMENTED_MANAGER_TCC__
@@ -0,0 +1,297 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_MAPPED_BUFFER_MANAGER_H__
+#define __LAZY_MAPPED_BUFFER_MANAGER_H__
+
+#include <cstdlib>
+#include <lazy/memory/buffer_manager.h>
+#include <lazy/memory/numa.h>
+
+namespace lazy {
+namespace memory {
+
+// \brief how a mapped_buffer_manager maps its memory
+struct mapping_policy
+{
+    typedef std::size_t size_type;
+
+    // \brief the pages backing the buffer
+    enum huge_pages_type
+    {
+        // \brief normal pages
+        no_huge_pages,
+
+        // \brief normal pages with madvise(MADV_HUGEPAGE), so the kernel backs them with
+        // transparent huge pages when it can
+        transparent_huge_pages,
+
+        // \brief MAP_HUGETLB pages from the huge page pool, falling back to transparent
+        // huge pages if the pool can't be mapped
+        explicit_huge_pages
+    };
+
+    // \brief how pages are handed back to the kernel
+    enum release_type
+    {
+        // \brief madvise(MADV_DONTNEED), the memory is freed right away and reads back
+        // as zeros
+        release_dontneed,
+
+        // \brief madvise(MADV_FREE), the memory is only freed when the kernel needs it,
+        // which is cheaper if the buffer is filled again soon.  falls back to
+        // MADV_DONTNEED where there is no MADV_FREE, and for huge page pool pages.
+        release_free
+    };
+
+    // \brief which NUMA nodes the pages backing the buffer come from.  nodes this process
+    // can't allocate from are ignored, and if that leaves none, or the kernel doesn't do
+    // NUMA, the buffer is placed by first touch.
+    enum numa_type
+    {
+        // \brief the node of the thread that touches a page first, which is what the
+        // kernel does unless told otherwise
+        numa_first_touch,
+
+        // \brief only the nodes in numa_nodes
+        numa_bind,
+
+        // \brief the nodes in numa_nodes in turn, page by page, which spreads the buffer
+        // evenly for workers on every socket
+        numa_interleave,
+
+        // \brief the first node in numa_nodes while it has memory to spare, and any other
+        // node after that
+        numa_preferred
+    };
+
+    // \brief normal pages
+    // \param[in] commit_size  how much memory to commit at once as the cursor advances
+    static mapping_policy pages(size_type commit_size = 1024 * 1024);
+
+    // \brief transparent huge pages, see transparent_huge_pages
+    // \param[in] commit_size  how much memory to commit at once, rounded up to huge pages
+    static mapping_policy transparent(size_type commit_size = 2 * 1024 * 1024);
+
+    // \brief huge pages from the huge page pool, see explicit_huge_pages
+    // \param[in] commit_size  how much memory to commit at once, rounded up to huge pages
+    static mapping_policy huge(size_type commit_size = 2 * 1024 * 1024);
+
+    // \brief normal pages bound to one NUMA node, see numa_bind
+    // \param[in] node  the node
+    // \param[in] commit_size  how much memory to commit at once as the cursor advances
+    static mapping_policy on_node(unsigned node, size_type commit_size = 1024 * 1024);
+
+    // \brief normal pages interleaved across NUMA nodes, see numa_interleave
+    // \param[in] nodes  the nodes, bit i for node i, or ~0 for all of them
+    // \param[in] commit_size  how much memory to commit at once as the cursor advances
+    static mapping_policy interleaved(unsigned long long nodes = ~0ull,
+        size_type commit_size = 1024 * 1024);
+
+    // \brief the pages backing the buffer
+    huge_pages_type huge_pages;
+
+    // \brief how pages are handed back on reset() and trim()
+    release_type release;
+
+    // \brief how much memory to commit at once as the cursor advances.  bigger steps mean
+    // fewer system calls, smaller ones less memory committed ahead of the cursor.
+    size_type commit_size;
+
+    // \brief which NUMA nodes the pages come from
+    numa_type numa;
+
+    // \brief the nodes for numa, bit i for node i
+    unsigned long long numa_nodes;
+};
+
+namespace detail {
+
+// \brief the huge page size assumed for alignment and rounding
+const std::size_t huge_page_size = 2 * 1024 * 1024;
+
+// \brief the address space reserved by a mapped_buffer_manager, which is a base class of
+// it so the mapping is made before and unmapped after the buffer_manager is done with it
+struct mapped_reservation
+{
+    // \brief maps the reservation, throws std::bad_alloc if it can't
+    // \param[in] hint  where to map the reservation
+    // \param[in] size  the size of the reservation, rounded up to whole pages
+    // \param[in] policy  how to map the reservation
+    mapped_reservation(void* hint, std::size_t size, const mapping_policy& policy);
+
+    // \brief unmaps the reservation
+    ~mapped_reservation();
+
+    // \brief maps the reservation with the huge pages the policy asks for
+    void map(void* hint, std::size_t size);
+
+    // \brief applies the NUMA policy to the reservation
+    void place();
+
+    // \brief the start of the reservation, or 0 if it is empty
+    char* m_reservation;
+
+    // \brief the size of the reservation
+    std::size_t m_reservation_size;
+
+    // \brief how the reservation is mapped, with the huge pages and NUMA placement the
+    // kernel agreed to
+    mapping_policy m_policy;
+};
+
+} // namespace detail
+
+// \brief a buffer_manager whose buffer is address space reserved with mmap() rather than
+// memory you provide.  the reservation is inaccessible until the cursor gets to it, and
+// is committed commit_size bytes at a time, so a multi-GB arena costs only what is used.
+// with huge pages, the reservation is aligned to huge pages so the TLB covers more of it.
+// reset() and trim() hand the pages back to the kernel but keep them committed, so
+// filling the buffer again costs page faults but no system calls.
+//
+// on machines with more than one NUMA node, the policy can bind or interleave the pages
+// across nodes before any of them is touched, so the buffer doesn't end up wherever the
+// thread that happened to fill it first was running.  see numa_arenas for an arena per
+// node.
+//
+// memory is committed by allocate() and try_expand() of this class, so buffer_manager is
+// a protected base: a mapped_buffer_manager doesn't convert to a buffer_manager reference
+// that would hand out chunks past the committed part of the buffer.  allocate through
+// buffer_allocator<T, mapped_buffer_manager> instead.
+class mapped_buffer_manager : private detail::mapped_reservation, protected buffer_manager
+{
+    template <typename T, typename Manager>
+    friend class buffer_allocator;
+
+public:
+    using buffer_manager::size_type;
+    using buffer_manager::marker;
+
+    // \brief ctor, reserves the buffer with normal pages
+    // \param[in] hint  where to map the buffer, passed to mmap() as a hint, usually 0
+    // \param[in] reserve_size  the size of the buffer, rounded up to whole pages
+    // \param[in] alignment  the minimum alignment of every chunk handed out
+    mapped_buffer_manager(void* hint, size_type reserve_size, size_type alignment = 1);
+
+    // \brief ctor
+    // \param[in] hint  where to map the buffer, passed to mmap() as a hint, usually 0
+    // \param[in] reserve_size  the size of the buffer, rounded up to whole pages
+    // \param[in] policy  how to map the buffer
+    // \param[in] alignment  the minimum alignment of every chunk handed out
+    mapped_buffer_manager(void* hint, size_type reserve_size, const mapping_policy& policy,
+        size_type alignment = 1);
+
+    using buffer_manager::buffer_size;
+    using buffer_manager::available;
+    using buffer_manager::used;
+    using buffer_manager::max_size;
+    using buffer_manager::growable;
+    using buffer_manager::alignment;
+    using buffer_manager::stride;
+    using buffer_manager::set_overflow_handler;
+    using buffer_manager::deallocate;
+    using buffer_manager::mark;
+    using buffer_manager::rewind;
+
+    // \brief the number of bytes at the start of the buffer that are accessible
+    size_type committed() const;
+
+    // \brief the pages backing the buffer, which is no_huge_pages if huge pages were
+    // asked for but the kernel refused
+    mapping_policy::huge_pages_type huge_pages() const;
+
+    // \brief the NUMA placement of the buffer, which is numa_first_touch if placement was
+    // asked for but none of the nodes could be used
+    mapping_policy::numa_type numa() const;
+
+    // \brief the nodes the buffer is placed on, bit i for node i, or 0 for first touch
+    unsigned long long numa_nodes() const;
+
+    // \brief commits memory as needed and allocates a chunk, see buffer_manager
+    // \param[in] n   size of chunk in bytes
+    void* allocate(size_type n);
+
+    // \brief commits memory as needed and allocates a chunk, see buffer_manager
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* allocate(size_type n, size_type alignment);
+
+    // \brief commits memory as needed and allocates a chunk, but returns 0 instead of
+    // throwing if it can't, see buffer_manager
+    // \param[in] n   size of chunk in bytes
+    void* try_allocate(size_type n);
+
+    // \brief commits memory as needed and allocates a chunk, but returns 0 instead of
+    // throwing if it can't, see buffer_manager
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* try_allocate(size_type n, size_type alignment);
+
+    // \brief commits memory as needed and allocates a run of chunks, see buffer_manager
+    // \param[in] count  the number of chunks
+    // \param[in] n   size of each chunk in bytes
+    // \param[in] alignment  power of 2 every chunk must be aligned to
+    void* allocate_run(size_type count, size_type n, size_type alignment);
+
+    // \brief commits memory as needed and allocates a batch of chunks, see buffer_manager
+    // \param[out] chunks  receives the chunks in address order, must hold count pointers
+    // \param[in] count  the number of chunks
+    // \param[in] n   size of each chunk in bytes
+    // \param[in] alignment  power of 2 every chunk must be aligned to
+    void allocate_batch(void** chunks, size_type count, size_type n, size_type alignment);
+
+    // \brief commits memory as needed and resizes the most recent chunk in place
+    // \param[in] p  the chunk
+    // \param[in] n  current size of the chunk in bytes
+    // \param[in] new_n  the size the chunk needs to be
+    bool try_expand(void* p, size_type n, size_type new_n);
+
+    // \brief releases everything and hands the pages back to the kernel
+    void reset();
+
+    // \brief hands the pages past the cursor back to the kernel, e.g. after a rewind()
+    void trim();
+
+protected:
+    // \brief makes sure the first n bytes of the buffer are accessible, false if the
+    // buffer isn't that big or the kernel won't commit them
+    bool commit(size_type n);
+
+    // \brief hands the committed pages from offset on back to the kernel
+    void release(size_type offset);
+
+    // \brief the size of the pages the buffer is committed and released in
+    size_type page_size() const;
+
+    // \brief the number of bytes at the start of the buffer that are accessible
+    size_type m_committed;
+
+private:
+    mapped_buffer_manager(const mapped_buffer_manager&);
+    mapped_buffer_manager& operator=(const mapped_buffer_manager&);
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "mapped_buffer_manager.tcc"
+
+#endif // __LAZY_MAPPED_BUFFER_MANAGER_H__
@@ -0,0 +1,377 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_MAPPED_BUFFER_MANAGER_TCC__
+#define __LAZY_MAPPED_BUFFER_MANAGER_TCC__
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <bits/functexcept.h>
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// mapping_policy
+////////////////////////////////////////////////////////////////////////////////
+inline mapping_policy mapping_policy::pages(mapping_policy::size_type commit_size)
+{
+    mapping_policy policy;
+    policy.huge_pages = no_huge_pages;
+    policy.release = release_dontneed;
+    policy.commit_size = commit_size;
+    policy.numa = numa_first_touch;
+    policy.numa_nodes = 0;
+    return policy;
+}
+
+inline mapping_policy mapping_policy::transparent(mapping_policy::size_type commit_size)
+{
+    mapping_policy policy = pages(commit_size);
+    policy.huge_pages = transparent_huge_pages;
+    return policy;
+}
+
+inline mapping_policy mapping_policy::huge(mapping_policy::size_type commit_size)
+{
+    mapping_policy policy = pages(commit_size);
+    policy.huge_pages = explicit_huge_pages;
+    return policy;
+}
+
+inline mapping_policy mapping_policy::on_node(unsigned node,
+    mapping_policy::size_type commit_size)
+{
+    mapping_policy policy = pages(commit_size);
+    policy.numa = numa_bind;
+    policy.numa_nodes = node < detail::max_numa_nodes ? 1ull << node : 0;
+    return policy;
+}
+
+inline mapping_policy mapping_policy::interleaved(unsigned long long nodes,
+    mapping_policy::size_type commit_size)
+{
+    mapping_policy policy = pages(commit_size);
+    policy.numa = numa_interleave;
+    policy.numa_nodes = nodes;
+    return policy;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// detail
+////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+
+inline std::size_t round_up_to(std::size_t n, std::size_t granularity)
+{
+    return (n + granularity - 1) / granularity * granularity;
+}
+
+inline std::size_t system_page_size()
+{
+    return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+inline mapped_reservation::mapped_reservation(void* hint, std::size_t size,
+        const mapping_policy& policy) :
+    m_reservation(0),
+    m_reservation_size(0),
+    m_policy(policy)
+{
+    if (size == 0) {
+        return;
+    }
+    map(hint, size);
+    place();
+}
+
+inline mapped_reservation::~mapped_reservation()
+{
+    if (m_reservation) {
+        munmap(m_reservation, m_reservation_size);
+    }
+}
+
+inline void mapped_reservation::map(void* hint, std::size_t size)
+{
+    // explicit huge pages are set aside when they are mapped rather than when they are
+    // touched, so running out of them fails here instead of crashing later
+    if (m_policy.huge_pages == mapping_policy::explicit_huge_pages) {
+        const std::size_t huge_size = round_up_to(size, huge_page_size);
+        void* p = mmap(hint, huge_size, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            m_reservation = static_cast<char*>(p);
+            m_reservation_size = huge_size;
+            return;
+        }
+        m_policy.huge_pages = mapping_policy::transparent_huge_pages;
+    }
+
+    if (m_policy.huge_pages == mapping_policy::transparent_huge_pages) {
+        // map a huge page too many and trim it off, so the reservation starts on a
+        // huge page boundary and every huge page in it can be backed by one
+        const std::size_t huge_size = round_up_to(size, huge_page_size);
+        void* p = mmap(hint, huge_size + huge_page_size, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) {
+            std::__throw_bad_alloc();
+        }
+        char* const mapping = static_cast<char*>(p);
+        char* const aligned = reinterpret_cast<char*>(
+            round_up_to(reinterpret_cast<uintptr_t>(mapping), huge_page_size));
+        if (aligned != mapping) {
+            munmap(mapping, aligned - mapping);
+        }
+        if (aligned + huge_size != mapping + huge_size + huge_page_size) {
+            munmap(aligned + huge_size, mapping + huge_page_size - aligned);
+        }
+        m_reservation = aligned;
+        m_reservation_size = huge_size;
+        if (madvise(m_reservation, m_reservation_size, MADV_HUGEPAGE) != 0) {
+            m_policy.huge_pages = mapping_policy::no_huge_pages;
+        }
+        return;
+    }
+
+    const std::size_t page_size = round_up_to(size, system_page_size());
+    void* p = mmap(hint, page_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+        -1, 0);
+    if (p == MAP_FAILED) {
+        std::__throw_bad_alloc();
+    }
+    m_reservation = static_cast<char*>(p);
+    m_reservation_size = page_size;
+}
+
+inline void mapped_reservation::place()
+{
+    int mode = MPOL_DEFAULT;
+    switch (m_policy.numa) {
+    case mapping_policy::numa_bind:
+        mode = MPOL_BIND;
+        break;
+    case mapping_policy::numa_interleave:
+        mode = MPOL_INTERLEAVE;
+        break;
+    case mapping_policy::numa_preferred:
+        mode = MPOL_PREFERRED;
+        break;
+    default:
+        break;
+    }
+    // nothing is committed yet, so every page will be faulted in under the policy
+    m_policy.numa_nodes &= numa_nodes();
+    if (mode == MPOL_DEFAULT || m_policy.numa_nodes == 0 ||
+            !bind_memory(m_reservation, m_reservation_size, mode, m_policy.numa_nodes)) {
+        m_policy.numa = mapping_policy::numa_first_touch;
+        m_policy.numa_nodes = 0;
+    }
+}
+
+} // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////
+// mapped_buffer_manager
+////////////////////////////////////////////////////////////////////////////////
+inline mapped_buffer_manager::mapped_buffer_manager(void* hint,
+        mapped_buffer_manager::size_type reserve_size,
+        mapped_buffer_manager::size_type alignment) :
+    detail::mapped_reservation(hint, reserve_size, mapping_policy::pages()),
+    buffer_manager(m_reservation, m_reservation_size, alignment),
+    m_committed(0)
+{
+    // NOP
+}
+
+inline mapped_buffer_manager::mapped_buffer_manager(void* hint,
+        mapped_buffer_manager::size_type reserve_size, const mapping_policy& policy,
+        mapped_buffer_manager::size_type alignment) :
+    detail::mapped_reservation(hint, reserve_size, policy),
+    buffer_manager(m_reservation, m_reservation_size, alignment),
+    m_committed(0)
+{
+    // NOP
+}
+
+inline mapped_buffer_manager::size_type mapped_buffer_manager::committed() const
+{
+    return m_committed;
+}
+
+inline mapping_policy::huge_pages_type mapped_buffer_manager::huge_pages() const
+{
+    return m_policy.huge_pages;
+}
+
+inline mapping_policy::numa_type mapped_buffer_manager::numa() const
+{
+    return m_policy.numa;
+}
+
+inline unsigned long long mapped_buffer_manager::numa_nodes() const
+{
+    return m_policy.numa_nodes;
+}
+
+inline void* mapped_buffer_manager::allocate(mapped_buffer_manager::size_type n)
+{
+    return allocate(n, m_alignment);
+}
+
+inline void* mapped_buffer_manager::allocate(mapped_buffer_manager::size_type n,
+    mapped_buffer_manager::size_type alignment)
+{
+    if (alignment < m_alignment) {
+        alignment = m_alignment;
+    }
+    // if it doesn't fit, buffer_manager throws
+    const size_type pad = padding(alignment);
+    const size_type remains = available();
+    if (remains >= pad && remains - pad >= n && !commit(m_bytes_allocated + pad + n)) {
+        std::__throw_bad_alloc();
+    }
+    return buffer_manager::allocate(n, alignment);
+}
+
+inline void* mapped_buffer_manager::try_allocate(mapped_buffer_manager::size_type n)
+{
+    return try_allocate(n, m_alignment);
+}
+
+inline void* mapped_buffer_manager::try_allocate(mapped_buffer_manager::size_type n,
+    mapped_buffer_manager::size_type alignment)
+{
+    if (alignment < m_alignment) {
+        alignment = m_alignment;
+    }
+    const size_type pad = padding(alignment);
+    const size_type remains = available();
+    if (remains >= pad && remains - pad >= n && !commit(m_bytes_allocated + pad + n)) {
+        return 0;
+    }
+    return buffer_manager::try_allocate(n, alignment);
+}
+
+inline void* mapped_buffer_manager::allocate_run(mapped_buffer_manager::size_type count,
+    mapped_buffer_manager::size_type n, mapped_buffer_manager::size_type alignment)
+{
+    if (alignment < m_alignment) {
+        alignment = m_alignment;
+    }
+    // if it doesn't fit, buffer_manager throws
+    const size_type step = stride(n, alignment);
+    if (count == 0 || step <= static_cast<size_type>(-1) / count) {
+        const size_type pad = padding(alignment);
+        const size_type remains = available();
+        if (remains >= pad && remains - pad >= step * count &&
+                !commit(m_bytes_allocated + pad + step * count)) {
+            std::__throw_bad_alloc();
+        }
+    }
+    return buffer_manager::allocate_run(count, n, alignment);
+}
+
+inline void mapped_buffer_manager::allocate_batch(void** chunks,
+    mapped_buffer_manager::size_type count, mapped_buffer_manager::size_type n,
+    mapped_buffer_manager::size_type alignment)
+{
+    char* chunk = static_cast<char*>(allocate_run(count, n, alignment));
+    const size_type step = stride(n, alignment);
+    for (size_type i = 0; i < count; ++i, chunk += step) {
+        chunks[i] = chunk;
+    }
+}
+
+inline bool mapped_buffer_manager::try_expand(void* p, mapped_buffer_manager::size_type n,
+    mapped_buffer_manager::size_type new_n)
+{
+    if (is_last(p, n) && new_n > n && new_n - n <= available() &&
+            !commit(m_bytes_allocated - n + new_n)) {
+        return false;
+    }
+    return buffer_manager::try_expand(p, n, new_n);
+}
+
+inline void mapped_buffer_manager::reset()
+{
+    buffer_manager::reset();
+    release(0);
+}
+
+inline void mapped_buffer_manager::trim()
+{
+    release(m_bytes_allocated);
+}
+
+inline bool mapped_buffer_manager::commit(mapped_buffer_manager::size_type n)
+{
+    if (n <= m_committed) {
+        return true;
+    }
+    if (n > m_buffer_size) {
+        return false;
+    }
+    const size_type page = page_size();
+    const size_type step = m_policy.commit_size > page ?
+        detail::round_up_to(m_policy.commit_size, page) : page;
+    size_type committed = detail::round_up_to(n - m_committed, step) + m_committed;
+    if (committed > m_buffer_size) {
+        committed = m_buffer_size;
+    }
+    if (mprotect(m_reservation + m_committed, committed - m_committed,
+            PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+    m_committed = committed;
+    return true;
+}
+
+inline void mapped_buffer_manager::release(mapped_buffer_manager::size_type offset)
+{
+    offset = detail::round_up_to(offset, page_size());
+    if (offset >= m_committed) {
+        return;
+    }
+    char* const begin = m_reservation + offset;
+    const size_type length = m_committed - offset;
+#ifdef MADV_FREE
+    // huge page pool pages can't be freed lazily, and huge_pages only stays
+    // explicit_huge_pages if the pool could be mapped
+    if (m_policy.release == mapping_policy::release_free &&
+            m_policy.huge_pages != mapping_policy::explicit_huge_pages &&
+            madvise(begin, length, MADV_FREE) == 0) {
+        return;
+    }
+#endif
+    madvise(begin, length, MADV_DONTNEED);
+}
+
+inline mapped_buffer_manager::size_type mapped_buffer_manager::page_size() const
+{
+    return m_policy.huge_pages == mapping_policy::no_huge_pages ?
+        detail::system_page_size() : detail::huge_page_size;
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_MAPPED_BUFFER_MANAGER_TCC__
@@ -0,0 +1,147 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_NODE_TRAITS_H__
+#define __LAZY_NODE_TRAITS_H__
+
+#include <cstdlib>
+#include <forward_list>
+#include <list>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace lazy {
+namespace memory {
+
+// \brief what a node-based container asks its allocator for per element, so buffers can be
+// sized at compile time instead of guessed.  the allocator is rebound to node_type and asked
+// for node_size bytes aligned to node_alignment for every element, e.g.
+//
+//     typedef std::map<int, double, std::less<int>, allocator_type> map_type;
+//     char buffer[100 * lazy::memory::node_traits<map_type>::node_size];
+//
+// buffer_allocator pads each node to node_alignment, so allow node_alignment - 1 bytes
+// on top of that unless the buffer is aligned.  the node types are libstdc++ internals,
+// which is what this library is built against.
+//
+// unordered containers also allocate an array of bucket_size bytes per bucket whenever
+// they rehash, and keep the old array until the new one has been filled.  see
+// sizing_manager for measuring that kind of thing rather than working it out.
+template <typename Container>
+struct node_traits;
+
+namespace detail {
+
+// \brief the sizes of a node type
+template <typename Node>
+struct node_traits_base
+{
+    typedef Node node_type;
+    static const std::size_t node_size = sizeof(Node);
+    static const std::size_t node_alignment = alignof(Node);
+};
+
+template <typename Node>
+const std::size_t node_traits_base<Node>::node_size;
+
+template <typename Node>
+const std::size_t node_traits_base<Node>::node_alignment;
+
+// \brief hashtable nodes, which cache the hash code unless hashing is cheap
+template <typename Value, typename Key, typename Hash>
+struct hash_node_traits_base :
+    public node_traits_base<std::__detail::_Hash_node<Value, std::__cache_default<Key, Hash>::value> >
+{
+    // \brief bytes per bucket in the bucket array
+    static const std::size_t bucket_size = sizeof(std::__detail::_Hash_node_base*);
+};
+
+template <typename Value, typename Key, typename Hash>
+const std::size_t hash_node_traits_base<Value, Key, Hash>::bucket_size;
+
+} // namespace detail
+
+template <typename T, typename Allocator>
+struct node_traits<std::list<T, Allocator> > :
+    public detail::node_traits_base<std::_List_node<T> >
+{
+};
+
+template <typename T, typename Allocator>
+struct node_traits<std::forward_list<T, Allocator> > :
+    public detail::node_traits_base<std::_Fwd_list_node<T> >
+{
+};
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+struct node_traits<std::map<Key, T, Compare, Allocator> > :
+    public detail::node_traits_base<std::_Rb_tree_node<std::pair<const Key, T> > >
+{
+};
+
+template <typename Key, typename T, typename Compare, typename Allocator>
+struct node_traits<std::multimap<Key, T, Compare, Allocator> > :
+    public detail::node_traits_base<std::_Rb_tree_node<std::pair<const Key, T> > >
+{
+};
+
+template <typename Key, typename Compare, typename Allocator>
+struct node_traits<std::set<Key, Compare, Allocator> > :
+    public detail::node_traits_base<std::_Rb_tree_node<Key> >
+{
+};
+
+template <typename Key, typename Compare, typename Allocator>
+struct node_traits<std::multiset<Key, Compare, Allocator> > :
+    public detail::node_traits_base<std::_Rb_tree_node<Key> >
+{
+};
+
+template <typename Key, typename T, typename Hash, typename Pred, typename Allocator>
+struct node_traits<std::unordered_map<Key, T, Hash, Pred, Allocator> > :
+    public detail::hash_node_traits_base<std::pair<const Key, T>, Key, Hash>
+{
+};
+
+template <typename Key, typename T, typename Hash, typename Pred, typename Allocator>
+struct node_traits<std::unordered_multimap<Key, T, Hash, Pred, Allocator> > :
+    public detail::hash_node_traits_base<std::pair<const Key, T>, Key, Hash>
+{
+};
+
+template <typename Key, typename Hash, typename Pred, typename Allocator>
+struct node_traits<std::unordered_set<Key, Hash, Pred, Allocator> > :
+    public detail::hash_node_traits_base<Key, Key, Hash>
+{
+};
+
+template <typename Key, typename Hash, typename Pred, typename Allocator>
+struct node_traits<std::unordered_multiset<Key, Hash, Pred, Allocator> > :
+    public detail::hash_node_traits_base<Key, Key, Hash>
+{
+};
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_NODE_TRAITS_H__
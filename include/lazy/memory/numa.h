@@ -0,0 +1,123 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_NUMA_H__
+#define __LAZY_NUMA_H__
+
+#include <cstddef>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// talks to the kernel directly rather than through libnuma, so nothing has to be linked
+// in.  everything degrades to the kernel's default first-touch placement on machines
+// with a single node, or where the kernel doesn't do NUMA.
+namespace lazy {
+namespace memory {
+namespace detail {
+
+// \brief the most NUMA nodes a node mask can name
+const std::size_t max_numa_nodes = 64;
+
+// \brief the bits in an unsigned long, which is what the kernel's node masks are made of
+const std::size_t numa_mask_bits = 8 * sizeof(unsigned long);
+
+// \brief the nodes this process may allocate from, bit i for node i.  just node 0 if the
+// kernel can't tell.
+inline unsigned long long numa_nodes()
+{
+#if defined(SYS_get_mempolicy)
+    unsigned long mask[max_numa_nodes / numa_mask_bits] = {};
+    int mode = 0;
+    if (syscall(SYS_get_mempolicy, &mode, mask, max_numa_nodes + 1, 0,
+            MPOL_F_MEMS_ALLOWED) == 0) {
+        unsigned long long nodes = 0;
+        for (std::size_t i = 0; i < max_numa_nodes; ++i) {
+            if ((mask[i / numa_mask_bits] >> (i % numa_mask_bits)) & 1) {
+                nodes |= 1ull << i;
+            }
+        }
+        if (nodes) {
+            return nodes;
+        }
+    }
+#endif
+    return 1;
+}
+
+// \brief the number of nodes up to and including the highest one this process may
+// allocate from
+inline std::size_t numa_node_count()
+{
+    return 8 * sizeof(unsigned long long) - __builtin_clzll(numa_nodes());
+}
+
+// \brief the node the calling thread is running on, 0 if the kernel can't tell.  this is
+// on the allocation path, so it goes through glibc's getcpu where there is one, which the
+// vDSO answers without entering the kernel.
+inline std::size_t current_numa_node()
+{
+    unsigned cpu = 0;
+    unsigned node = 0;
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 29)
+    if (getcpu(&cpu, &node) == 0) {
+        return node;
+    }
+#elif defined(SYS_getcpu)
+    if (syscall(SYS_getcpu, &cpu, &node, 0) == 0) {
+        return node;
+    }
+#endif
+    return 0;
+}
+
+// \brief sets the NUMA policy of a page-aligned range of address space, which decides
+// where the pages that are touched from then on come from
+// \param[in] p  the start of the range
+// \param[in] n  the size of the range
+// \param[in] mode  MPOL_BIND, MPOL_INTERLEAVE or MPOL_PREFERRED
+// \param[in] nodes  the nodes, bit i for node i
+// \return false if the kernel won't
+inline bool bind_memory(void* p, std::size_t n, int mode, unsigned long long nodes)
+{
+#if defined(SYS_mbind)
+    unsigned long mask[max_numa_nodes / numa_mask_bits] = {};
+    for (std::size_t i = 0; i < max_numa_nodes; ++i) {
+        if ((nodes >> i) & 1) {
+            mask[i / numa_mask_bits] |= 1ul << (i % numa_mask_bits);
+        }
+    }
+    return syscall(SYS_mbind, p, n, mode, mask, max_numa_nodes + 1, 0) == 0;
+#else
+    static_cast<void>(p);
+    static_cast<void>(n);
+    static_cast<void>(mode);
+    static_cast<void>(nodes);
+    return false;
+#endif
+}
+
+} // namespace detail
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_NUMA_H__
@@ -0,0 +1,133 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_NUMA_ARENAS_H__
+#define __LAZY_NUMA_ARENAS_H__
+
+#include <cstddef>
+#include <lazy/memory/concurrent_buffer_manager.h>
+#include <lazy/memory/numa.h>
+
+namespace lazy {
+namespace memory {
+
+// \brief an arena per NUMA node, each cut up by its own Manager, so workers on every
+// socket allocate from memory that is local to them instead of all paying remote-memory
+// latency on a buffer that sits on one node.  the arenas are reserved with mmap() and
+// bound to their nodes before anything touches them.  only nodes the process may
+// allocate from get an arena, see has_arena().  on a machine with one node, or where the
+// kernel won't bind, the arenas are placed by first touch, see bound().
+//
+// a worker picks its arena with local() when it creates its containers, e.g.
+//
+//     lazy::memory::numa_arenas<> arenas(1024 * 1024 * 1024);
+//     ...
+//     std::vector<int, buffer_allocator<int, concurrent_buffer_manager> > vec(
+//         (buffer_allocator<int, concurrent_buffer_manager>(arenas.local())));
+//
+// the allocator keeps the arena it was given, so a container stays with its node even
+// if the thread is moved to another one later, which also means it is deallocated to
+// the right arena.  pin workers to their sockets for local() to keep meaning the same
+// node.  workers on the same node share an arena, which is why Manager is a
+// concurrent_buffer_manager unless you ask for something else.
+template <typename Manager = concurrent_buffer_manager>
+class numa_arenas
+{
+public:
+    typedef std::size_t size_type;
+
+    // \brief ctor, reserves an arena on every node this process may allocate from
+    // \param[in] arena_size  the size of each arena, rounded up to whole pages
+    // \param[in] args  passed to the ctor of Manager after the arena and its size
+    template <typename... Args>
+    explicit numa_arenas(size_type arena_size, const Args&... args);
+
+    // \brief dtor, destroys the arenas and unmaps their memory
+    ~numa_arenas();
+
+    // \brief the number of nodes up to and including the highest one with an arena
+    size_type node_count() const;
+
+    // \brief whether a node has an arena, which is whether this process may allocate
+    // from it
+    // \param[in] node  the node, less than node_count()
+    bool has_arena(size_type node) const;
+
+    // \brief the size of each arena
+    size_type arena_size() const;
+
+    // \brief whether every arena is bound to its node, which it isn't on a machine with
+    // one node or where the kernel doesn't do NUMA
+    bool bound() const;
+
+    // \brief whether the arena of a node is bound to it
+    // \param[in] node  a node with an arena
+    bool bound(size_type node) const;
+
+    // \brief the arena of a node
+    // \param[in] node  a node with an arena
+    Manager& arena(size_type node);
+
+    // \brief the arena of the node the calling thread is running on.  looking up the node
+    // is cheap, but keep the arena anyway, so a container stays with one node.
+    Manager& local();
+
+    // \brief the node the calling thread is running on, or the lowest node with an arena
+    // if the thread runs on a node this process may not allocate from
+    size_type local_node() const;
+
+protected:
+    // \brief the index of a node's arena in m_arenas
+    size_type arena_index(size_type node) const;
+
+    // \brief the memory of every arena, one after the other
+    char* m_memory;
+
+    // \brief the nodes with an arena, bit i for node i
+    const unsigned long long m_nodes;
+
+    // \brief the number of nodes up to and including the highest one with an arena
+    const size_type m_node_count;
+
+    // \brief the number of arenas
+    const size_type m_arena_count;
+
+    // \brief the size of each arena
+    size_type m_arena_size;
+
+    // \brief the nodes whose arena is bound to them, bit i for node i
+    unsigned long long m_bound;
+
+    // \brief the arenas in node order, constructed in place since Manager can't be
+    // default constructed
+    Manager* m_arenas;
+
+private:
+    numa_arenas(const numa_arenas&);
+    numa_arenas& operator=(const numa_arenas&);
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "numa_arenas.tcc"
+
+#endif // __LAZY_NUMA_ARENAS_H__
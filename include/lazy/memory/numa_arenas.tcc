@@ -0,0 +1,156 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_NUMA_ARENAS_TCC__
+#define __LAZY_NUMA_ARENAS_TCC__
+
+#include <cassert>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <bits/functexcept.h>
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// numa_arenas
+////////////////////////////////////////////////////////////////////////////////
+template <typename Manager>
+template <typename... Args>
+inline numa_arenas<Manager>::numa_arenas(typename numa_arenas<Manager>::size_type arena_size,
+        const Args&... args) :
+    m_memory(0),
+    m_nodes(detail::numa_nodes()),
+    m_node_count(detail::numa_node_count()),
+    m_arena_count(__builtin_popcountll(m_nodes)),
+    m_arena_size(0),
+    m_bound(0),
+    m_arenas(0)
+{
+    const size_type page = static_cast<size_type>(sysconf(_SC_PAGESIZE));
+    m_arena_size = (arena_size + page - 1) / page * page;
+    void* p = mmap(0, m_arena_size * m_arena_count, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        std::__throw_bad_alloc();
+    }
+    m_memory = static_cast<char*>(p);
+
+    // nothing has touched the memory yet, so every page will come from the arena's node
+    if (m_arena_count > 1) {
+        for (size_type node = 0; node < m_node_count; ++node) {
+            if (has_arena(node) && detail::bind_memory(m_memory + arena_index(node)
+                    * m_arena_size, m_arena_size, MPOL_BIND, 1ull << node)) {
+                m_bound |= 1ull << node;
+            }
+        }
+    }
+
+    m_arenas = static_cast<Manager*>(::operator new(sizeof(Manager) * m_arena_count));
+    size_type index = 0;
+    try {
+        for (; index < m_arena_count; ++index) {
+            new (&m_arenas[index]) Manager(m_memory + index * m_arena_size, m_arena_size,
+                args...);
+        }
+    } catch (...) {
+        while (index > 0) {
+            m_arenas[--index].~Manager();
+        }
+        ::operator delete(m_arenas);
+        munmap(m_memory, m_arena_size * m_arena_count);
+        throw;
+    }
+}
+
+template <typename Manager>
+inline numa_arenas<Manager>::~numa_arenas()
+{
+    for (size_type index = 0; index < m_arena_count; ++index) {
+        m_arenas[index].~Manager();
+    }
+    ::operator delete(m_arenas);
+    munmap(m_memory, m_arena_size * m_arena_count);
+}
+
+template <typename Manager>
+inline typename numa_arenas<Manager>::size_type numa_arenas<Manager>::node_count() const
+{
+    return m_node_count;
+}
+
+template <typename Manager>
+inline bool numa_arenas<Manager>::has_arena(typename numa_arenas<Manager>::size_type node) const
+{
+    return node < m_node_count && ((m_nodes >> node) & 1);
+}
+
+template <typename Manager>
+inline typename numa_arenas<Manager>::size_type numa_arenas<Manager>::arena_size() const
+{
+    return m_arena_size;
+}
+
+template <typename Manager>
+inline bool numa_arenas<Manager>::bound() const
+{
+    return m_bound != 0 && m_bound == m_nodes;
+}
+
+template <typename Manager>
+inline bool numa_arenas<Manager>::bound(typename numa_arenas<Manager>::size_type node) const
+{
+    assert(has_arena(node));
+    return (m_bound >> node) & 1;
+}
+
+template <typename Manager>
+inline Manager& numa_arenas<Manager>::arena(typename numa_arenas<Manager>::size_type node)
+{
+    assert(has_arena(node));
+    return m_arenas[arena_index(node)];
+}
+
+template <typename Manager>
+inline Manager& numa_arenas<Manager>::local()
+{
+    return m_arenas[arena_index(local_node())];
+}
+
+template <typename Manager>
+inline typename numa_arenas<Manager>::size_type numa_arenas<Manager>::local_node() const
+{
+    const size_type node = detail::current_numa_node();
+    return has_arena(node) ? node : __builtin_ctzll(m_nodes);
+}
+
+template <typename Manager>
+inline typename numa_arenas<Manager>::size_type numa_arenas<Manager>::arena_index(
+    typename numa_arenas<Manager>::size_type node) const
+{
+    // the arenas of the nodes below this one come first
+    return __builtin_popcountll(m_nodes & ((1ull << node) - 1));
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_NUMA_ARENAS_TCC__
@@ -0,0 +1,92 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_OFFSET_ALLOCATOR_H__
+#define __LAZY_OFFSET_ALLOCATOR_H__
+
+#include <lazy/memory/buffer_allocator.h>
+#include <lazy/memory/offset_ptr.h>
+
+namespace lazy {
+namespace memory {
+
+// A buffer_allocator whose pointers are offset_ptr, so a container built in a buffer can
+// be written out with the buffer and mapped back at another address with nothing to
+// deserialize, as long as the container object itself is in the buffer too, e.g.
+//
+//     typedef offset_allocator<int> allocator_type;
+//     typedef std::vector<int, allocator_type> vector_type;
+//     vector_type* v = new (manager.allocate(sizeof(vector_type), alignof(vector_type)))
+//         vector_type(allocator_type(manager));
+//
+// libstdc++ only supports fancy pointers in std::vector; the node-based containers still
+// store raw pointers internally.  a sorted vector of pairs searched with std::lower_bound
+// makes a fine lookup table instead of a std::map.
+//
+// a container mapped back in is read-only: its allocator refers to a manager that isn't
+// there any more, so it must not grow, shrink or be destroyed.  just unmap the buffer.
+template <typename T, typename Manager = buffer_manager>
+class offset_allocator : public buffer_allocator<T, Manager>
+{
+public:
+    typedef buffer_allocator<T, Manager> base_type;
+    typedef typename base_type::size_type size_type;
+    typedef offset_ptr<T> pointer;
+    typedef offset_ptr<const T> const_pointer;
+
+    // \brief rebinds to an offset_allocator, so rebound copies keep offset_ptr pointers
+    template <typename U>
+    struct rebind
+    {
+        typedef offset_allocator<U, Manager> other;
+    };
+
+    // \brief default ctor that doesn't do anything meaningful.  Don't use it.
+    offset_allocator() noexcept;
+
+    // \brief ctor for allocating from a manager that is shared with other allocators
+    // \param[in] manager  the manager, which has to outlive this object and its copies
+    explicit offset_allocator(Manager& manager) noexcept;
+
+    // \brief copy ctor
+    offset_allocator(const offset_allocator&) noexcept;
+
+    // \brief rebind ctor
+    template <typename U>
+    offset_allocator(const offset_allocator<U, Manager>& alloc) noexcept;
+
+    // \brief Allocates the memory for 'n' objects aligned for T
+    // \param[in] n  the number of objects to allocate
+    pointer allocate(size_type n);
+
+    // \brief Releases the previously allocated resource, see buffer_allocator
+    void deallocate(pointer p, size_type n);
+
+    // \brief Tries to grow or shrink the most recent allocation in place
+    bool try_expand(pointer p, size_type n, size_type new_n);
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "offset_allocator.tcc"
+
+#endif // __LAZY_OFFSET_ALLOCATOR_H__
@@ -0,0 +1,83 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_OFFSET_ALLOCATOR_TCC__
+#define __LAZY_OFFSET_ALLOCATOR_TCC__
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// offset_allocator
+////////////////////////////////////////////////////////////////////////////////
+template <typename T, typename Manager>
+inline offset_allocator<T, Manager>::offset_allocator() noexcept :
+    base_type()
+{
+    // NOP
+}
+
+template <typename T, typename Manager>
+inline offset_allocator<T, Manager>::offset_allocator(Manager& manager) noexcept :
+    base_type(manager)
+{
+    // NOP
+}
+
+template <typename T, typename Manager>
+inline offset_allocator<T, Manager>::offset_allocator(const offset_allocator<T, Manager>& alloc) noexcept :
+    base_type(alloc)
+{
+    // NOP
+}
+
+template <typename T, typename Manager>
+template <typename U>
+inline offset_allocator<T, Manager>::offset_allocator(const offset_allocator<U, Manager>& alloc) noexcept :
+    base_type(alloc)
+{
+    // NOP
+}
+
+template <typename T, typename Manager>
+inline typename offset_allocator<T, Manager>::pointer offset_allocator<T, Manager>::allocate(
+    typename offset_allocator<T, Manager>::size_type n)
+{
+    return pointer(base_type::allocate(n));
+}
+
+template <typename T, typename Manager>
+inline void offset_allocator<T, Manager>::deallocate(typename offset_allocator<T, Manager>::pointer p,
+    typename offset_allocator<T, Manager>::size_type n)
+{
+    base_type::deallocate(p.get(), n);
+}
+
+template <typename T, typename Manager>
+inline bool offset_allocator<T, Manager>::try_expand(typename offset_allocator<T, Manager>::pointer p,
+    typename offset_allocator<T, Manager>::size_type n, typename offset_allocator<T, Manager>::size_type new_n)
+{
+    return base_type::try_expand(p.get(), n, new_n);
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_OFFSET_ALLOCATOR_TCC__
@@ -0,0 +1,142 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_OFFSET_PTR_H__
+#define __LAZY_OFFSET_PTR_H__
+
+#include <cstddef>
+#include <iterator>
+
+namespace lazy {
+namespace memory {
+
+// \brief a pointer that stores where it points relative to its own address rather than
+// the address itself, so a data structure made of them still works after it has been
+// copied or mapped somewhere else in one piece, like a buffer written to a file and
+// mapped back in.  pointing outside of the piece that moves breaks that, of course.
+//
+// this is a fancy pointer as far as allocators go, see offset_allocator.  null is stored
+// as an offset of 1, which can't point anywhere useful since it is inside the pointer.
+template <typename T>
+class offset_ptr
+{
+public:
+    typedef T element_type;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef offset_ptr pointer;
+    typedef T& reference;
+    typedef std::random_access_iterator_tag iterator_category;
+
+    // \brief null
+    offset_ptr() throw();
+
+    // \brief null
+    offset_ptr(std::nullptr_t) throw();
+
+    // \brief points at p
+    offset_ptr(T* p) throw();
+
+    // \brief points where the other one does
+    offset_ptr(const offset_ptr& p) throw();
+
+    // \brief points where the other one does, if a U* converts to a T*
+    template <typename U>
+    offset_ptr(const offset_ptr<U>& p) throw();
+
+    // \brief points where the other one does
+    offset_ptr& operator=(const offset_ptr& p) throw();
+
+    // \brief points at p
+    offset_ptr& operator=(T* p) throw();
+
+    // \brief the address pointed to
+    T* get() const throw();
+
+    T& operator*() const;
+    T* operator->() const;
+    T& operator[](difference_type n) const;
+
+    offset_ptr& operator++();
+    offset_ptr operator++(int);
+    offset_ptr& operator--();
+    offset_ptr operator--(int);
+    offset_ptr& operator+=(difference_type n);
+    offset_ptr& operator-=(difference_type n);
+    offset_ptr operator+(difference_type n) const;
+    offset_ptr operator-(difference_type n) const;
+
+    // \brief whether this isn't null
+    explicit operator bool() const throw();
+
+    // \brief what std::pointer_traits uses to make one out of a reference
+    static offset_ptr pointer_to(T& r) throw();
+
+private:
+    // \brief the offset stored for null
+    static const difference_type null_offset = 1;
+
+    // \brief the address pointed to, relative to this
+    difference_type m_offset;
+};
+
+template <typename T, typename U>
+std::ptrdiff_t operator-(const offset_ptr<T>& a, const offset_ptr<U>& b);
+
+template <typename T, typename U>
+bool operator==(const offset_ptr<T>& a, const offset_ptr<U>& b);
+
+template <typename T, typename U>
+bool operator!=(const offset_ptr<T>& a, const offset_ptr<U>& b);
+
+template <typename T, typename U>
+bool operator<(const offset_ptr<T>& a, const offset_ptr<U>& b);
+
+template <typename T, typename U>
+bool operator<=(const offset_ptr<T>& a, const offset_ptr<U>& b);
+
+template <typename T, typename U>
+bool operator>(const offset_ptr<T>& a, const offset_ptr<U>& b);
+
+template <typename T, typename U>
+bool operator>=(const offset_ptr<T>& a, const offset_ptr<U>& b);
+
+template <typename T>
+bool operator==(const offset_ptr<T>& p, std::nullptr_t);
+
+template <typename T>
+bool operator==(std::nullptr_t, const offset_ptr<T>& p);
+
+template <typename T>
+bool operator!=(const offset_ptr<T>& p, std::nullptr_t);
+
+template <typename T>
+bool operator!=(std::nullptr_t, const offset_ptr<T>& p);
+
+template <typename T>
+offset_ptr<T> operator+(std::ptrdiff_t n, const offset_ptr<T>& p);
+
+} // namespace memory
+} // namespace lazy
+
+#include "offset_ptr.tcc"
+
+#endif // __LAZY_OFFSET_PTR_H__
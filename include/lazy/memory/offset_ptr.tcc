@@ -0,0 +1,252 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_OFFSET_PTR_TCC__
+#define __LAZY_OFFSET_PTR_TCC__
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// offset_ptr
+////////////////////////////////////////////////////////////////////////////////
+template <typename T>
+inline offset_ptr<T>::offset_ptr() throw() :
+    m_offset(null_offset)
+{
+    // NOP
+}
+
+template <typename T>
+inline offset_ptr<T>::offset_ptr(std::nullptr_t) throw() :
+    m_offset(null_offset)
+{
+    // NOP
+}
+
+template <typename T>
+inline offset_ptr<T>::offset_ptr(T* p) throw()
+{
+    *this = p;
+}
+
+template <typename T>
+inline offset_ptr<T>::offset_ptr(const offset_ptr<T>& p) throw()
+{
+    *this = p.get();
+}
+
+template <typename T>
+template <typename U>
+inline offset_ptr<T>::offset_ptr(const offset_ptr<U>& p) throw()
+{
+    *this = static_cast<T*>(p.get());
+}
+
+template <typename T>
+inline offset_ptr<T>& offset_ptr<T>::operator=(const offset_ptr<T>& p) throw()
+{
+    // the offset is relative to where the pointer lives, so it can't just be copied
+    return *this = p.get();
+}
+
+template <typename T>
+inline offset_ptr<T>& offset_ptr<T>::operator=(T* p) throw()
+{
+    m_offset = p ? reinterpret_cast<const char*>(p) - reinterpret_cast<const char*>(this) :
+        null_offset;
+    return *this;
+}
+
+template <typename T>
+inline T* offset_ptr<T>::get() const throw()
+{
+    if (m_offset == null_offset) {
+        return 0;
+    }
+    return reinterpret_cast<T*>(
+        const_cast<char*>(reinterpret_cast<const char*>(this)) + m_offset);
+}
+
+template <typename T>
+inline T& offset_ptr<T>::operator*() const
+{
+    return *get();
+}
+
+template <typename T>
+inline T* offset_ptr<T>::operator->() const
+{
+    return get();
+}
+
+template <typename T>
+inline T& offset_ptr<T>::operator[](typename offset_ptr<T>::difference_type n) const
+{
+    return get()[n];
+}
+
+template <typename T>
+inline offset_ptr<T>& offset_ptr<T>::operator++()
+{
+    m_offset += sizeof(T);
+    return *this;
+}
+
+template <typename T>
+inline offset_ptr<T> offset_ptr<T>::operator++(int)
+{
+    offset_ptr<T> p(*this);
+    ++*this;
+    return p;
+}
+
+template <typename T>
+inline offset_ptr<T>& offset_ptr<T>::operator--()
+{
+    m_offset -= sizeof(T);
+    return *this;
+}
+
+template <typename T>
+inline offset_ptr<T> offset_ptr<T>::operator--(int)
+{
+    offset_ptr<T> p(*this);
+    --*this;
+    return p;
+}
+
+template <typename T>
+inline offset_ptr<T>& offset_ptr<T>::operator+=(typename offset_ptr<T>::difference_type n)
+{
+    m_offset += n * static_cast<difference_type>(sizeof(T));
+    return *this;
+}
+
+template <typename T>
+inline offset_ptr<T>& offset_ptr<T>::operator-=(typename offset_ptr<T>::difference_type n)
+{
+    m_offset -= n * static_cast<difference_type>(sizeof(T));
+    return *this;
+}
+
+template <typename T>
+inline offset_ptr<T> offset_ptr<T>::operator+(typename offset_ptr<T>::difference_type n) const
+{
+    return offset_ptr<T>(get() + n);
+}
+
+template <typename T>
+inline offset_ptr<T> offset_ptr<T>::operator-(typename offset_ptr<T>::difference_type n) const
+{
+    return offset_ptr<T>(get() - n);
+}
+
+template <typename T>
+inline offset_ptr<T>::operator bool() const throw()
+{
+    return m_offset != null_offset;
+}
+
+template <typename T>
+inline offset_ptr<T> offset_ptr<T>::pointer_to(T& r) throw()
+{
+    return offset_ptr<T>(&r);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// operators
+////////////////////////////////////////////////////////////////////////////////
+template <typename T, typename U>
+inline std::ptrdiff_t operator-(const offset_ptr<T>& a, const offset_ptr<U>& b)
+{
+    return a.get() - b.get();
+}
+
+template <typename T, typename U>
+inline bool operator==(const offset_ptr<T>& a, const offset_ptr<U>& b)
+{
+    return a.get() == b.get();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const offset_ptr<T>& a, const offset_ptr<U>& b)
+{
+    return a.get() != b.get();
+}
+
+template <typename T, typename U>
+inline bool operator<(const offset_ptr<T>& a, const offset_ptr<U>& b)
+{
+    return a.get() < b.get();
+}
+
+template <typename T, typename U>
+inline bool operator<=(const offset_ptr<T>& a, const offset_ptr<U>& b)
+{
+    return a.get() <= b.get();
+}
+
+template <typename T, typename U>
+inline bool operator>(const offset_ptr<T>& a, const offset_ptr<U>& b)
+{
+    return a.get() > b.get();
+}
+
+template <typename T, typename U>
+inline bool operator>=(const offset_ptr<T>& a, const offset_ptr<U>& b)
+{
+    return a.get() >= b.get();
+}
+
+template <typename T>
+inline bool operator==(const offset_ptr<T>& p, std::nullptr_t)
+{
+    return !p;
+}
+
+template <typename T>
+inline bool operator==(std::nullptr_t, const offset_ptr<T>& p)
+{
+    return !p;
+}
+
+template <typename T>
+inline bool operator!=(const offset_ptr<T>& p, std::nullptr_t)
+{
+    return static_cast<bool>(p);
+}
+
+template <typename T>
+inline bool operator!=(std::nullptr_t, const offset_ptr<T>& p)
+{
+    return static_cast<bool>(p);
+}
+
+template <typename T>
+inline offset_ptr<T> operator+(std::ptrdiff_t n, const offset_ptr<T>& p)
+{
+    return p + n;
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_OFFSET_PTR_TCC__
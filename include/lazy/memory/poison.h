@@ -0,0 +1,97 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_POISON_H__
+#define __LAZY_POISON_H__
+
+#include <cstddef>
+
+// AddressSanitizer is picked up from the compiler flags.  valgrind only knows about the
+// buffer if the annotations are compiled in with -DLAZY_MEMORY_VALGRIND, which is what
+// ./configure --enable-valgrind-annotations does.
+#if defined(__SANITIZE_ADDRESS__)
+#define LAZY_MEMORY_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define LAZY_MEMORY_ASAN 1
+#endif
+#endif
+
+#if defined(LAZY_MEMORY_ASAN)
+#include <sanitizer/asan_interface.h>
+#endif
+
+#if defined(LAZY_MEMORY_VALGRIND)
+#include <valgrind/memcheck.h>
+#endif
+
+// the number of poisoned bytes buffer_manager leaves in front of every chunk, so running
+// off the end of one chunk into the next is caught.  0 unless you ask for it with
+// -DLAZY_MEMORY_RED_ZONE=n or ./configure --with-red-zone=n, since it changes the layout
+// of the buffer and how much fits in it.
+#ifndef LAZY_MEMORY_RED_ZONE
+#define LAZY_MEMORY_RED_ZONE 0
+#endif
+
+namespace lazy {
+namespace memory {
+namespace detail {
+
+// \brief the number of bytes left poisoned in front of every chunk
+const std::size_t red_zone = LAZY_MEMORY_RED_ZONE;
+
+// \brief tells AddressSanitizer and valgrind that the memory must not be touched until
+// it is unpoisoned.  does nothing unless either is in use.
+// \param[in] p  the start of the memory
+// \param[in] n  the number of bytes
+inline void poison(const void* p, std::size_t n)
+{
+#if defined(LAZY_MEMORY_ASAN)
+    ASAN_POISON_MEMORY_REGION(p, n);
+#endif
+#if defined(LAZY_MEMORY_VALGRIND)
+    VALGRIND_MAKE_MEM_NOACCESS(p, n);
+#endif
+    static_cast<void>(p);
+    static_cast<void>(n);
+}
+
+// \brief tells AddressSanitizer and valgrind that the memory has been handed out, and
+// that its contents are garbage until written to
+// \param[in] p  the start of the memory
+// \param[in] n  the number of bytes
+inline void unpoison(const void* p, std::size_t n)
+{
+#if defined(LAZY_MEMORY_ASAN)
+    ASAN_UNPOISON_MEMORY_REGION(p, n);
+#endif
+#if defined(LAZY_MEMORY_VALGRIND)
+    VALGRIND_MAKE_MEM_UNDEFINED(p, n);
+#endif
+    static_cast<void>(p);
+    static_cast<void>(n);
+}
+
+} // namespace detail
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_POISON_H__
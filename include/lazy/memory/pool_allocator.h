@@ -0,0 +1,40 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_POOL_ALLOCATOR_H__
+#define __LAZY_POOL_ALLOCATOR_H__
+
+#include <lazy/memory/buffer_allocator.h>
+#include <lazy/memory/pool_manager.h>
+
+namespace lazy {
+namespace memory {
+
+// A buffer_allocator whose nodes are recycled through the free lists of a pool_manager,
+// which is what you want for std::list, std::map, std::unordered_map and friends when
+// elements come and go for the lifetime of the container.
+template <typename T>
+using pool_allocator = buffer_allocator<T, pool_manager>;
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_POOL_ALLOCATOR_H__
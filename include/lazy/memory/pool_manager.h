@@ -0,0 +1,173 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_POOL_MANAGER_H__
+#define __LAZY_POOL_MANAGER_H__
+
+#include <cstdlib>
+#include <lazy/memory/buffer_manager.h>
+
+namespace lazy {
+namespace memory {
+
+// \brief a buffer_manager that recycles small chunks, which is what node-based containers
+// like std::list, std::map and std::unordered_map ask for one element at a time.
+// chunks of up to max_slot_size bytes are rounded up to a multiple of slot_granularity
+// and carved out of the buffer as slots of that size class.  freed slots are kept on an
+// intrusive free list per size class and handed out again in O(1), so containers with
+// churn run in a fixed footprint.  bigger chunks come straight from the buffer like they
+// do with buffer_manager.
+//
+// slots are carved out with the alignment they are asked for, so a slot only costs the
+// padding its own type needs.  a free slot is handed out again only to a request it is
+// aligned enough for; when none of the first few on the list is, the request gets a fresh
+// slot from the buffer.
+//
+// rewinding or resetting the underlying buffer_manager drops every free slot, including
+// the ones below the marker, which are not reused until the next reset.
+//
+// free slots stay poisoned like the rest of the buffer, see buffer_manager.
+class pool_manager : public buffer_manager
+{
+public:
+    // \brief ctor
+    // \param[in] buffer  pointer to the buffer to use for allocation
+    // \param[in] buffer_size  size of the buffer.  make sure they match.
+    // \param[in] alignment  the minimum alignment of every chunk handed out
+    pool_manager(void* buffer, size_type buffer_size, size_type alignment = 1);
+
+    // \brief ctor for a buffer that grows from upstream when it runs out
+    // \param[in] buffer  pointer to the buffer to use for allocation first
+    // \param[in] buffer_size  size of the buffer.  make sure they match.
+    // \param[in] growth  where the blocks come from once the buffer is exhausted
+    // \param[in] alignment  the minimum alignment of every chunk handed out
+    pool_manager(void* buffer, size_type buffer_size, const growth_policy& growth,
+        size_type alignment = 1);
+
+    // \brief allocates a chunk of memory of requested size, aligned to the minimum alignment
+    // \param[in] n   size of chunk in bytes
+    void* allocate(size_type n);
+
+    // \brief allocates a chunk of memory, reusing a free slot if there is one
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* allocate(size_type n, size_type alignment);
+
+    // \brief allocates a chunk like allocate() does, but returns 0 instead of throwing
+    // \param[in] n   size of chunk in bytes
+    void* try_allocate(size_type n);
+
+    // \brief allocates a chunk like allocate() does, but returns 0 instead of throwing
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* try_allocate(size_type n, size_type alignment);
+
+    // \brief allocates 'count' chunks of n bytes in one go.  small chunks are taken from
+    // the free list first and the rest are carved out of the buffer as one run of slots.
+    // \param[out] chunks  receives the chunks, must hold count pointers
+    // \param[in] count  the number of chunks
+    // \param[in] n   size of each chunk in bytes
+    // \param[in] alignment  power of 2 every chunk must be aligned to
+    void allocate_batch(void** chunks, size_type count, size_type n, size_type alignment);
+
+    // \brief makes sure there are at least 'count' free slots for chunks of n bytes by
+    // carving the missing ones out of the buffer in one run, so a container that is about
+    // to be bulk-loaded gets its nodes without going back to the buffer for each one.
+    // use node_traits to find out how big the nodes of a container are, e.g.
+    //
+    //     manager.reserve(node_traits<map_type>::node_size, expected_elements);
+    //
+    // \param[in] n   size of the chunks in bytes, must not be bigger than max_slot_size
+    // \param[in] count  the number of free slots wanted
+    void reserve(size_type n, size_type count);
+
+    // \brief puts a small chunk back on the free list of its size class, or returns a big
+    // one to the buffer like buffer_manager does
+    // \param[in] p  the chunk
+    // \param[in] n  size of the chunk in bytes
+    void deallocate(void* p, size_type n);
+
+    // \brief resizes a chunk in place.  small chunks can only be resized within their
+    // size class.
+    // \param[in] p  the chunk
+    // \param[in] n  current size of the chunk in bytes
+    // \param[in] new_n  the size the chunk needs to be
+    // \return true if the chunk now holds new_n bytes
+    bool try_expand(void* p, size_type n, size_type new_n);
+
+    // \brief the number of free slots waiting to be reused for chunks of n bytes.  this
+    // walks the free list, so keep it out of hot paths.
+    // \param[in] n  size of chunk in bytes
+    size_type free_slots(size_type n) const;
+
+    // \brief slots are multiples of this size
+    static const size_type slot_granularity = sizeof(void*);
+
+    // \brief chunks bigger than this are not pooled
+    static const size_type max_slot_size = 256;
+
+protected:
+    // \brief what a free slot holds
+    struct free_slot
+    {
+        // \brief the next free slot of the same size class, or 0
+        free_slot* next;
+    };
+
+    // \brief the number of size classes
+    static const size_type class_count = max_slot_size / slot_granularity;
+
+    // \brief how far down a free list pop_free() looks for a slot that is aligned enough
+    static const size_type free_search_depth = 8;
+
+    // \brief the size class of a small chunk of n bytes
+    static size_type size_class(size_type n);
+
+    // \brief the size of the slots in a size class
+    static size_type slot_size(size_type size_class);
+
+    // \brief the alignment reserve() carves the slots of a size class out with, which is
+    // enough for any type of that size that isn't over-aligned
+    size_type slot_alignment(size_type size_class) const;
+
+    // \brief takes the first of the first free_search_depth free slots of a size class
+    // that is aligned to 'alignment' off its list, or returns 0 if there is none
+    free_slot* pop_free(size_type size_class, size_type alignment);
+
+    // \brief the slot after this one on its free list
+    static free_slot* next_free(free_slot* slot);
+
+    // \brief forgets every free slot if the buffer was rewound since we last looked
+    void drop_rewound_slots();
+
+    // \brief the free lists, one per size class
+    free_slot* m_free[class_count];
+
+    // \brief m_rewinds as of the last time we looked
+    size_type m_pool_rewinds;
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "pool_manager.tcc"
+
+#endif // __LAZY_POOL_MANAGER_H__
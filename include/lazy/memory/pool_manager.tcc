@@ -0,0 +1,258 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_POOL_MANAGER_TCC__
+#define __LAZY_POOL_MANAGER_TCC__
+
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// pool_manager
+////////////////////////////////////////////////////////////////////////////////
+inline pool_manager::pool_manager(void* buffer, pool_manager::size_type buffer_size,
+        pool_manager::size_type alignment) :
+    buffer_manager(buffer, buffer_size, alignment),
+    m_pool_rewinds(m_rewinds)
+{
+    for (size_type i = 0; i < class_count; ++i) {
+        m_free[i] = 0;
+    }
+}
+
+inline pool_manager::pool_manager(void* buffer, pool_manager::size_type buffer_size,
+        const growth_policy& growth, pool_manager::size_type alignment) :
+    buffer_manager(buffer, buffer_size, growth, alignment),
+    m_pool_rewinds(m_rewinds)
+{
+    for (size_type i = 0; i < class_count; ++i) {
+        m_free[i] = 0;
+    }
+}
+
+inline void* pool_manager::allocate(pool_manager::size_type n)
+{
+    return allocate(n, m_alignment);
+}
+
+inline void* pool_manager::allocate(pool_manager::size_type n,
+    pool_manager::size_type alignment)
+{
+    if (n > max_slot_size) {
+        return buffer_manager::allocate(n, alignment);
+    }
+    drop_rewound_slots();
+    const size_type index = size_class(n);
+    free_slot* const slot = pop_free(index, alignment);
+    if (slot) {
+        detail::unpoison(slot, n);
+        return slot;
+    }
+    return buffer_manager::allocate(slot_size(index), alignment);
+}
+
+inline void* pool_manager::try_allocate(pool_manager::size_type n)
+{
+    return try_allocate(n, m_alignment);
+}
+
+inline void* pool_manager::try_allocate(pool_manager::size_type n,
+    pool_manager::size_type alignment)
+{
+    if (n > max_slot_size) {
+        return buffer_manager::try_allocate(n, alignment);
+    }
+    drop_rewound_slots();
+    const size_type index = size_class(n);
+    free_slot* const slot = pop_free(index, alignment);
+    if (slot) {
+        detail::unpoison(slot, n);
+        return slot;
+    }
+    return buffer_manager::try_allocate(slot_size(index), alignment);
+}
+
+inline void pool_manager::allocate_batch(void** chunks, pool_manager::size_type count,
+    pool_manager::size_type n, pool_manager::size_type alignment)
+{
+    if (n > max_slot_size) {
+        buffer_manager::allocate_batch(chunks, count, n, alignment);
+        return;
+    }
+    drop_rewound_slots();
+    const size_type index = size_class(n);
+    size_type i = 0;
+    for (; i < count; ++i) {
+        free_slot* const slot = pop_free(index, alignment);
+        if (!slot) {
+            break;
+        }
+        chunks[i] = slot;
+        detail::unpoison(slot, n);
+    }
+    if (i < count) {
+        buffer_manager::allocate_batch(chunks + i, count - i, slot_size(index), alignment);
+    }
+}
+
+inline void pool_manager::reserve(pool_manager::size_type n, pool_manager::size_type count)
+{
+    assert(n <= max_slot_size);
+    const size_type have = free_slots(n);
+    if (have >= count) {
+        return;
+    }
+    drop_rewound_slots();
+    const size_type index = size_class(n);
+    const size_type size = slot_size(index);
+    const size_type slot_align = slot_alignment(index);
+    const size_type missing = count - have;
+    char* const run = static_cast<char*>(buffer_manager::allocate_run(missing, size, slot_align));
+    // pushed back to front so they are handed out in address order
+    const size_type step = stride(size, slot_align);
+    for (size_type i = missing; i > 0; --i) {
+        free_slot* const slot = reinterpret_cast<free_slot*>(run + (i - 1) * step);
+        slot->next = m_free[index];
+        m_free[index] = slot;
+        detail::poison(slot, size);
+    }
+}
+
+inline void pool_manager::deallocate(void* p, pool_manager::size_type n)
+{
+    if (n > max_slot_size) {
+        buffer_manager::deallocate(p, n);
+        return;
+    }
+    drop_rewound_slots();
+    const size_type index = size_class(n);
+    free_slot* const slot = static_cast<free_slot*>(p);
+    detail::unpoison(slot, sizeof(free_slot));
+    slot->next = m_free[index];
+    m_free[index] = slot;
+    detail::poison(slot, slot_size(index));
+}
+
+inline bool pool_manager::try_expand(void* p, pool_manager::size_type n,
+    pool_manager::size_type new_n)
+{
+    if (n > max_slot_size && new_n > max_slot_size) {
+        return buffer_manager::try_expand(p, n, new_n);
+    }
+    if (n > max_slot_size || new_n > max_slot_size || size_class(n) != size_class(new_n)) {
+        return false;
+    }
+    // the slot has room either way, but only the bytes asked for are accessible
+    if (new_n > n) {
+        detail::unpoison(static_cast<char*>(p) + n, new_n - n);
+    } else {
+        detail::poison(static_cast<char*>(p) + new_n, n - new_n);
+    }
+    return true;
+}
+
+inline pool_manager::size_type pool_manager::free_slots(pool_manager::size_type n) const
+{
+    if (n > max_slot_size || m_pool_rewinds != m_rewinds) {
+        return 0;
+    }
+    size_type count = 0;
+    for (free_slot* slot = m_free[size_class(n)]; slot; slot = next_free(slot)) {
+        ++count;
+    }
+    return count;
+}
+
+inline pool_manager::size_type pool_manager::size_class(pool_manager::size_type n)
+{
+    // zero-sized chunks still need a distinct address
+    return n == 0 ? 0 : (n - 1) / slot_granularity;
+}
+
+inline pool_manager::size_type pool_manager::slot_size(pool_manager::size_type size_class)
+{
+    return (size_class + 1) * slot_granularity;
+}
+
+inline pool_manager::size_type pool_manager::slot_alignment(
+    pool_manager::size_type size_class) const
+{
+    // the largest power of 2 that divides the slot size is the most a type of that size
+    // can need, unless it is over-aligned
+    const size_type size = slot_size(size_class);
+    size_type alignment = size & (~size + 1);
+    if (alignment > alignof(std::max_align_t)) {
+        alignment = alignof(std::max_align_t);
+    }
+    return alignment > m_alignment ? alignment : m_alignment;
+}
+
+inline pool_manager::free_slot* pool_manager::pop_free(pool_manager::size_type size_class,
+    pool_manager::size_type alignment)
+{
+    // slots are only as aligned as whoever carved them out asked for, so look a few slots
+    // down the list for one that is aligned enough
+    free_slot* previous = 0;
+    free_slot* slot = m_free[size_class];
+    for (size_type i = 0; slot && i < free_search_depth; ++i) {
+        free_slot* const next = next_free(slot);
+        if ((reinterpret_cast<uintptr_t>(slot) & (alignment - 1)) == 0) {
+            if (previous) {
+                detail::unpoison(previous, sizeof(free_slot));
+                previous->next = next;
+                detail::poison(previous, sizeof(free_slot));
+            } else {
+                m_free[size_class] = next;
+            }
+            return slot;
+        }
+        previous = slot;
+        slot = next;
+    }
+    return 0;
+}
+
+inline pool_manager::free_slot* pool_manager::next_free(pool_manager::free_slot* slot)
+{
+    detail::unpoison(slot, sizeof(free_slot));
+    free_slot* const next = slot->next;
+    detail::poison(slot, sizeof(free_slot));
+    return next;
+}
+
+inline void pool_manager::drop_rewound_slots()
+{
+    if (m_pool_rewinds == m_rewinds) {
+        return;
+    }
+    for (size_type i = 0; i < class_count; ++i) {
+        m_free[i] = 0;
+    }
+    m_pool_rewinds = m_rewinds;
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_POOL_MANAGER_TCC__
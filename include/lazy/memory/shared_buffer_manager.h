@@ -0,0 +1,215 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_SHARED_BUFFER_MANAGER_H__
+#define __LAZY_SHARED_BUFFER_MANAGER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <stdint.h>
+#include <lazy/memory/concurrent_buffer_manager.h>
+
+namespace lazy {
+namespace memory {
+
+namespace detail {
+
+// \brief the start of a segment managed by shared_buffer_manager, which holds all of its
+// state so every process attached to the segment sees the same cursor.  offsets are
+// from the start of the segment since every process maps it at a different address.
+struct shared_segment_header
+{
+    // \brief 0 in a fresh segment, then initializing_magic, then ready_magic
+    std::atomic<uint64_t> magic;
+
+    // \brief usable size of the segment, header included
+    uint64_t size;
+
+    // \brief the minimum alignment of every chunk handed out
+    uint64_t alignment;
+
+    // \brief the offset of the first free byte, which only overshoots size for as long as
+    // racing requests take to give back what didn't fit
+    std::atomic<std::size_t> cursor;
+
+    // \brief the offset of the root object, or 0
+    std::atomic<std::size_t> root;
+};
+
+} // namespace detail
+
+// \brief a lock-free buffer manager whose state lives at the start of the buffer, so a
+// segment of shared memory can be allocated from by every process that maps it.  it
+// allocates like concurrent_buffer_manager, with a fetch-add on an atomic cursor, only
+// the cursor is in the segment rather than in this object.
+//
+// the first manager constructed on a fresh, zeroed segment formats it, and the ones
+// after it attach to what is there.  one process usually builds the containers and
+// publishes them with set_root(), and the others find them with root().  processes map
+// the segment at different addresses, so the containers have to be built with
+// offset_allocator<T, shared_buffer_manager> to be usable from all of them, e.g.
+//
+//     lazy::memory::shared_segment segment("/tables", 1 << 30);
+//     lazy::memory::shared_buffer_manager manager(segment.address(), segment.size());
+//
+// like every buffer manager, memory is only reclaimed by rolling back the last chunk.
+class shared_buffer_manager
+{
+public:
+    typedef std::size_t size_type;
+
+    // \brief the default minimum alignment
+    static const size_type default_alignment = concurrent_buffer_manager::default_alignment;
+
+    // \brief ctor, formats the segment if nobody has yet and attaches to it
+    // \param[in] segment  the start of the segment, aligned to alignment.  a segment of
+    //                     shared memory is zeroed when it is created, which is what marks
+    //                     it as fresh.
+    // \param[in] segment_size  size of the segment, which must be the same in every process
+    // \param[in] alignment  the minimum alignment of every chunk handed out.  ignored when
+    //                       attaching, since the segment has its own.
+    shared_buffer_manager(void* segment, size_type segment_size,
+        size_type alignment = default_alignment);
+
+    // \brief the size of the segment, header included
+    size_type buffer_size() const;
+
+    // \brief the amount of space remaining in the segment
+    size_type available() const;
+
+    // \brief the number of bytes taken from the segment, header included
+    size_type used() const;
+
+    // \brief the largest number of bytes that could ever be handed out
+    size_type max_size() const;
+
+    // \brief the minimum alignment of the chunks handed out
+    size_type alignment() const;
+
+    // \brief allocates a chunk of memory, aligned to the minimum alignment
+    // \param[in] n   size of chunk in bytes
+    void* allocate(size_type n);
+
+    // \brief allocates a chunk of memory of requested size and alignment
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* allocate(size_type n, size_type alignment);
+
+    // \brief returns a chunk to the segment, only if it was the last chunk handed out
+    // \param[in] p  the chunk
+    // \param[in] n  size of the chunk in bytes
+    void deallocate(void* p, size_type n);
+
+    // \brief tries to resize the most recent chunk in place
+    // \param[in] p  the chunk
+    // \param[in] n  current size of the chunk in bytes
+    // \param[in] new_n  the size the chunk needs to be
+    bool try_expand(void* p, size_type n, size_type new_n);
+
+    // \brief publishes an object in the segment for other processes to find
+    // \param[in] p  the object, which has to be in the segment, or 0 to unpublish
+    void set_root(void* p);
+
+    // \brief the object published with set_root(), or 0
+    void* root() const;
+
+protected:
+    // \brief the chunk size rounded up to the minimum alignment
+    size_type round_up(size_type n) const;
+
+    // \brief the header of the segment, or m_empty_header if there is no segment
+    detail::shared_segment_header* const m_header;
+
+    // \brief start of the segment
+    char* const m_segment;
+
+    // \brief size of the segment
+    const size_type m_segment_size;
+
+    // \brief minimum alignment of the chunks handed out
+    const size_type m_alignment;
+
+    // \brief the header used without a segment, so a manager constructed on nothing
+    // throws on allocation like any other that has run out
+    detail::shared_segment_header m_empty_header;
+
+private:
+    shared_buffer_manager(const shared_buffer_manager&);
+    shared_buffer_manager& operator=(const shared_buffer_manager&);
+};
+
+// \brief a named segment of shared memory, or a file, mapped for a shared_buffer_manager.
+// it is created at the given size unless it exists already, in which case it is mapped
+// at the size it has.  creating zero-fills it.
+class shared_segment
+{
+public:
+    typedef std::size_t size_type;
+
+    // \brief where the segment lives
+    enum backing_type
+    {
+        // \brief POSIX shared memory from shm_open(), named like "/name"
+        posix_shm,
+
+        // \brief a file, which survives reboots too
+        file
+    };
+
+    // \brief ctor, opens or creates the segment and maps it.  throws std::system_error if
+    // it can't.
+    // \param[in] name  the name of the shared memory object, or the path of the file
+    // \param[in] size  the size to create the segment with
+    // \param[in] backing  where the segment lives
+    shared_segment(const char* name, size_type size, backing_type backing = posix_shm);
+
+    // \brief dtor, unmaps the segment but leaves it for the other processes
+    ~shared_segment();
+
+    // \brief the start of the mapped segment
+    void* address() const;
+
+    // \brief the size of the mapped segment
+    size_type size() const;
+
+    // \brief removes the segment once no process needs to attach to it any more
+    // \param[in] name  the name of the shared memory object, or the path of the file
+    // \param[in] backing  where the segment lives
+    static void remove(const char* name, backing_type backing = posix_shm);
+
+private:
+    shared_segment(const shared_segment&);
+    shared_segment& operator=(const shared_segment&);
+
+    // \brief the mapped segment
+    void* m_address;
+
+    // \brief the size of the mapped segment
+    size_type m_size;
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "shared_buffer_manager.tcc"
+
+#endif // __LAZY_SHARED_BUFFER_MANAGER_H__
@@ -0,0 +1,259 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_SHARED_BUFFER_MANAGER_TCC__
+#define __LAZY_SHARED_BUFFER_MANAGER_TCC__
+
+#include <cassert>
+#include <cerrno>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <bits/functexcept.h>
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// detail
+////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+
+// \brief "LAZYSHMI" while a segment is being formatted
+const uint64_t shared_segment_initializing = 0x4c415a5953484d49ull;
+
+// \brief "LAZYSHM1" once a segment has been formatted
+const uint64_t shared_segment_ready = 0x4c415a5953484d31ull;
+
+// \brief formats the segment unless another process has, and waits until it is ready
+inline shared_segment_header* attach_segment(void* segment, std::size_t segment_size,
+    std::size_t alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    assert(reinterpret_cast<uintptr_t>(segment) % alignment == 0);
+    shared_segment_header* const header = static_cast<shared_segment_header*>(segment);
+    if (segment_size < sizeof(shared_segment_header)) {
+        std::__throw_invalid_argument("segment too small for shared_buffer_manager");
+    }
+
+    uint64_t magic = 0;
+    if (header->magic.compare_exchange_strong(magic, shared_segment_initializing,
+            std::memory_order_acquire)) {
+        header->size = segment_size;
+        header->alignment = alignment;
+        header->cursor.store((sizeof(shared_segment_header) + alignment - 1) & ~(alignment - 1),
+            std::memory_order_relaxed);
+        header->root.store(0, std::memory_order_relaxed);
+        header->magic.store(shared_segment_ready, std::memory_order_release);
+        return header;
+    }
+    while (magic == shared_segment_initializing) {
+        sched_yield();
+        magic = header->magic.load(std::memory_order_acquire);
+    }
+    if (magic != shared_segment_ready || header->size > segment_size) {
+        std::__throw_invalid_argument("not a shared_buffer_manager segment");
+    }
+    return header;
+}
+
+} // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////
+// shared_buffer_manager
+////////////////////////////////////////////////////////////////////////////////
+inline shared_buffer_manager::shared_buffer_manager(void* segment,
+        shared_buffer_manager::size_type segment_size,
+        shared_buffer_manager::size_type alignment) :
+    m_header(segment ? detail::attach_segment(segment, segment_size, alignment) : &m_empty_header),
+    m_segment(static_cast<char*>(segment)),
+    m_segment_size(segment ? m_header->size : 0),
+    m_alignment(segment ? m_header->alignment : alignment)
+{
+    m_empty_header.magic.store(0, std::memory_order_relaxed);
+    m_empty_header.size = 0;
+    m_empty_header.alignment = alignment;
+    m_empty_header.cursor.store(0, std::memory_order_relaxed);
+    m_empty_header.root.store(0, std::memory_order_relaxed);
+}
+
+inline shared_buffer_manager::size_type shared_buffer_manager::buffer_size() const
+{
+    return m_segment_size;
+}
+
+inline shared_buffer_manager::size_type shared_buffer_manager::available() const
+{
+    const size_type cursor = m_header->cursor.load(std::memory_order_relaxed);
+    return cursor < m_segment_size ? m_segment_size - cursor : 0;
+}
+
+inline shared_buffer_manager::size_type shared_buffer_manager::used() const
+{
+    return m_segment_size - available();
+}
+
+inline shared_buffer_manager::size_type shared_buffer_manager::max_size() const
+{
+    return m_segment_size;
+}
+
+inline shared_buffer_manager::size_type shared_buffer_manager::alignment() const
+{
+    return m_alignment;
+}
+
+inline void* shared_buffer_manager::allocate(shared_buffer_manager::size_type n)
+{
+    return allocate(n, m_alignment);
+}
+
+inline void* shared_buffer_manager::allocate(shared_buffer_manager::size_type n,
+    shared_buffer_manager::size_type alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    const size_type bytes = round_up(n);
+    // a request that can never fit must not move the cursor, or it could wrap around
+    if (bytes < n || bytes > m_segment_size) {
+        std::__throw_bad_alloc();
+    }
+    // the cursor is always on the minimum alignment, so no padding is needed.  a request that
+    // doesn't fit takes the slow path, which fails without moving the cursor past the end
+    const size_type allocated = m_header->cursor.load(std::memory_order_relaxed);
+    if (alignment <= m_alignment && allocated <= m_segment_size
+        && m_segment_size - allocated >= bytes) {
+        const size_type offset = m_header->cursor.fetch_add(bytes, std::memory_order_relaxed);
+        if (offset <= m_segment_size && m_segment_size - offset >= bytes) {
+            return m_segment + offset;
+        }
+        // another process got there first; give the bytes back unless someone bumped past us
+        size_type expected = offset + bytes;
+        m_header->cursor.compare_exchange_strong(expected, offset, std::memory_order_relaxed);
+        std::__throw_bad_alloc();
+    }
+    // the segment is aligned in every process, so the padding is the same in all of them
+    void* const cursor = detail::atomic_bump(m_header->cursor, m_segment, m_segment_size,
+        bytes, alignment);
+    if (!cursor) {
+        std::__throw_bad_alloc();
+    }
+    return cursor;
+}
+
+inline void shared_buffer_manager::deallocate(void* p, shared_buffer_manager::size_type n)
+{
+    const size_type offset = static_cast<char*>(p) - m_segment;
+    size_type expected = offset + round_up(n);
+    m_header->cursor.compare_exchange_strong(expected, offset, std::memory_order_relaxed);
+}
+
+inline bool shared_buffer_manager::try_expand(void* p, shared_buffer_manager::size_type n,
+    shared_buffer_manager::size_type new_n)
+{
+    const size_type offset = static_cast<char*>(p) - m_segment;
+    const size_type bytes = round_up(new_n);
+    if (bytes < new_n || bytes > m_segment_size - offset) {
+        return false;
+    }
+    size_type expected = offset + round_up(n);
+    return m_header->cursor.compare_exchange_strong(expected, offset + bytes,
+        std::memory_order_relaxed);
+}
+
+inline void shared_buffer_manager::set_root(void* p)
+{
+    assert(!p || (static_cast<char*>(p) > m_segment &&
+        static_cast<char*>(p) < m_segment + m_segment_size));
+    // release, so whoever finds the root also sees what was built before it
+    m_header->root.store(p ? static_cast<char*>(p) - m_segment : 0, std::memory_order_release);
+}
+
+inline void* shared_buffer_manager::root() const
+{
+    const size_type offset = m_header->root.load(std::memory_order_acquire);
+    return offset ? m_segment + offset : 0;
+}
+
+inline shared_buffer_manager::size_type shared_buffer_manager::round_up(
+    shared_buffer_manager::size_type n) const
+{
+    return (n + m_alignment - 1) & ~(m_alignment - 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// shared_segment
+////////////////////////////////////////////////////////////////////////////////
+inline shared_segment::shared_segment(const char* name, shared_segment::size_type size,
+        shared_segment::backing_type backing) :
+    m_address(0),
+    m_size(0)
+{
+    const int fd = backing == posix_shm ? shm_open(name, O_RDWR | O_CREAT, 0600) :
+        open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        std::__throw_system_error(errno);
+    }
+    struct stat st;
+    // whoever gets here first sizes it, which zero-fills it
+    if (fstat(fd, &st) != 0 || (st.st_size == 0 && ftruncate(fd, size) != 0)) {
+        const int error = errno;
+        close(fd);
+        std::__throw_system_error(error);
+    }
+    m_size = st.st_size ? static_cast<size_type>(st.st_size) : size;
+    void* const address = mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int error = errno;
+    close(fd);
+    if (address == MAP_FAILED) {
+        std::__throw_system_error(error);
+    }
+    m_address = address;
+}
+
+inline shared_segment::~shared_segment()
+{
+    munmap(m_address, m_size);
+}
+
+inline void* shared_segment::address() const
+{
+    return m_address;
+}
+
+inline shared_segment::size_type shared_segment::size() const
+{
+    return m_size;
+}
+
+inline void shared_segment::remove(const char* name, shared_segment::backing_type backing)
+{
+    if (backing == posix_shm) {
+        shm_unlink(name);
+    } else {
+        unlink(name);
+    }
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_SHARED_BUFFER_MANAGER_TCC__
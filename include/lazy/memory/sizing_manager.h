@@ -0,0 +1,179 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_SIZING_MANAGER_H__
+#define __LAZY_SIZING_MANAGER_H__
+
+#include <cstdlib>
+#include <stdint.h>
+#include <unordered_map>
+#include <lazy/memory/poison.h>
+
+namespace lazy {
+namespace memory {
+
+// \brief a dry run of buffer_manager that works out how big a buffer a workload needs.
+// every chunk is handed out from the heap, while the cursor of a buffer_manager is moved
+// alongside as if the chunk had come from a buffer, padding, rolling back the last chunk
+// and all.  run the workload once with
+//
+//     lazy::memory::sizing_manager sizer(0, 0);
+//     run(allocator_type(sizer));    // with buffer_allocator<T, sizing_manager>
+//
+// and required_size() is the smallest buffer it fits in, give or take the alignment of
+// the buffer.  the padding is worked out for the address of the buffer passed to the ctor,
+// or for a buffer aligned to required_alignment() if that is 0, so declare your buffer
+// with alignas(required_alignment()) or measure with the real buffer, which is never
+// touched.
+//
+// nothing runs out, so the workload has to be the same one that will later run on the
+// real buffer.  chunks can only be resized in place within what the heap gave them.
+class sizing_manager
+{
+public:
+    typedef std::size_t size_type;
+
+    // \brief ctor
+    // \param[in] buffer  the buffer the real run will use, only to work out the padding
+    //                    on its address, or 0
+    // \param[in] buffer_size  the size of the real buffer, see available()
+    // \param[in] alignment  the minimum alignment of every chunk, like buffer_manager
+    sizing_manager(void* buffer, size_type buffer_size, size_type alignment = 1);
+
+    // \brief dtor, frees whatever chunks the workload did not
+    ~sizing_manager();
+
+    // \brief the buffer size passed to the ctor
+    size_type buffer_size() const;
+
+    // \brief how much of the buffer passed to the ctor would be left, 0 once the workload
+    // has outgrown it
+    size_type available() const;
+
+    // \brief the number of bytes a buffer_manager would have taken from its buffer by now
+    size_type used() const;
+
+    // \brief nothing runs out
+    size_type max_size() const;
+
+    // \brief the minimum alignment of the chunks handed out
+    size_type alignment() const;
+
+    // \brief the smallest buffer the workload so far would have fit in, i.e. the highest
+    // used() has ever been
+    size_type required_size() const;
+
+    // \brief the largest alignment any chunk was asked for
+    size_type required_alignment() const;
+
+    // \brief the bytes that would have been spent on aligning chunks so far
+    size_type padding_bytes() const;
+
+    // \brief the number of chunks handed out so far
+    size_type allocations() const;
+
+    // \brief allocates a chunk from the heap and moves the cursor like buffer_manager would
+    // \param[in] n   size of chunk in bytes
+    void* allocate(size_type n);
+
+    // \brief allocates a chunk from the heap and moves the cursor like buffer_manager would
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* allocate(size_type n, size_type alignment);
+
+    // \brief frees the chunk, rolling the cursor back over it and its padding if it was the
+    // last one handed out
+    // \param[in] p  the chunk
+    // \param[in] n  size of the chunk in bytes
+    void deallocate(void* p, size_type n);
+
+    // \brief resizes the most recent chunk in place like buffer_manager would, as long as
+    // it still fits in the memory the heap gave it
+    // \param[in] p  the chunk
+    // \param[in] n  current size of the chunk in bytes
+    // \param[in] new_n  the size the chunk needs to be
+    bool try_expand(void* p, size_type n, size_type new_n);
+
+    // \brief starts measuring from scratch.  the chunks still out stay valid but can't be
+    // rolled back any more.
+    void reset();
+
+protected:
+    // \brief where a chunk would have been in the buffer
+    struct chunk
+    {
+        // \brief offset of the chunk from the start of the buffer
+        size_type offset;
+
+        // \brief bytes the heap gave the chunk
+        size_type capacity;
+    };
+
+    typedef std::unordered_map<void*, chunk> chunk_map;
+
+    // \brief whether the chunk at offset is the last one handed out
+    bool is_last(size_type offset, size_type n) const;
+
+    // \brief the address of the buffer the padding is worked out on
+    const uintptr_t m_buffer;
+
+    // \brief the size of the real buffer
+    const size_type m_buffer_size;
+
+    // \brief minimum alignment of the chunks handed out
+    const size_type m_alignment;
+
+    // \brief the cursor of the buffer_manager being simulated
+    size_type m_bytes_allocated;
+
+    // \brief the last chunk handed out, or 0 once it has been rolled back or reset
+    void* m_last_chunk;
+
+    // \brief m_bytes_allocated from before m_last_chunk and its padding were taken
+    size_type m_last_offset;
+
+    // \brief the highest m_bytes_allocated has been
+    size_type m_peak;
+
+    // \brief the largest alignment asked for
+    size_type m_max_alignment;
+
+    // \brief the bytes spent on padding
+    size_type m_padding;
+
+    // \brief the number of chunks handed out
+    size_type m_allocations;
+
+    // \brief the chunks that are still out
+    chunk_map m_chunks;
+
+private:
+    // \brief not copyable since we own the chunks
+    sizing_manager(const sizing_manager&);
+    sizing_manager& operator=(const sizing_manager&);
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "sizing_manager.tcc"
+
+#endif // __LAZY_SIZING_MANAGER_H__
@@ -0,0 +1,198 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_SIZING_MANAGER_TCC__
+#define __LAZY_SIZING_MANAGER_TCC__
+
+#include <cassert>
+#include <malloc.h>
+#include <bits/functexcept.h>
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// sizing_manager
+////////////////////////////////////////////////////////////////////////////////
+inline sizing_manager::sizing_manager(void* buffer, sizing_manager::size_type buffer_size,
+        sizing_manager::size_type alignment) :
+    m_buffer(reinterpret_cast<uintptr_t>(buffer)),
+    m_buffer_size(buffer_size),
+    m_alignment(alignment),
+    m_bytes_allocated(0),
+    m_last_chunk(0),
+    m_last_offset(0),
+    m_peak(0),
+    m_max_alignment(alignment),
+    m_padding(0),
+    m_allocations(0)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+}
+
+inline sizing_manager::~sizing_manager()
+{
+    for (chunk_map::iterator it = m_chunks.begin(); it != m_chunks.end(); ++it) {
+        std::free(it->first);
+    }
+}
+
+inline sizing_manager::size_type sizing_manager::buffer_size() const
+{
+    return m_buffer_size;
+}
+
+inline sizing_manager::size_type sizing_manager::available() const
+{
+    return m_bytes_allocated < m_buffer_size ? m_buffer_size - m_bytes_allocated : 0;
+}
+
+inline sizing_manager::size_type sizing_manager::used() const
+{
+    return m_bytes_allocated;
+}
+
+inline sizing_manager::size_type sizing_manager::max_size() const
+{
+    return static_cast<size_type>(-1);
+}
+
+inline sizing_manager::size_type sizing_manager::alignment() const
+{
+    return m_alignment;
+}
+
+inline sizing_manager::size_type sizing_manager::required_size() const
+{
+    return m_peak;
+}
+
+inline sizing_manager::size_type sizing_manager::required_alignment() const
+{
+    return m_max_alignment;
+}
+
+inline sizing_manager::size_type sizing_manager::padding_bytes() const
+{
+    return m_padding;
+}
+
+inline sizing_manager::size_type sizing_manager::allocations() const
+{
+    return m_allocations;
+}
+
+inline void* sizing_manager::allocate(sizing_manager::size_type n)
+{
+    return allocate(n, m_alignment);
+}
+
+inline void* sizing_manager::allocate(sizing_manager::size_type n,
+    sizing_manager::size_type alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if (alignment < m_alignment) {
+        alignment = m_alignment;
+    }
+
+    // posix_memalign wants at least the alignment of a pointer, and something to hand out
+    void* p = 0;
+    const size_type heap_alignment = alignment < sizeof(void*) ? sizeof(void*) : alignment;
+    if (posix_memalign(&p, heap_alignment, n ? n : 1) != 0) {
+        std::__throw_bad_alloc();
+    }
+
+    // the red zone buffer_manager leaves in front of the chunk counts as padding
+    const uintptr_t cursor = m_buffer + m_bytes_allocated + detail::red_zone;
+    const size_type pad = detail::red_zone + static_cast<size_type>(-cursor & (alignment - 1));
+    chunk c;
+    c.offset = m_bytes_allocated + pad;
+    c.capacity = malloc_usable_size(p);
+    m_chunks[p] = c;
+
+    m_last_chunk = p;
+    m_last_offset = m_bytes_allocated;
+    m_bytes_allocated += pad + n;
+    if (m_bytes_allocated > m_peak) {
+        m_peak = m_bytes_allocated;
+    }
+    if (alignment > m_max_alignment) {
+        m_max_alignment = alignment;
+    }
+    m_padding += pad;
+    ++m_allocations;
+    return p;
+}
+
+inline void sizing_manager::deallocate(void* p, sizing_manager::size_type n)
+{
+    chunk_map::iterator it = m_chunks.find(p);
+    assert(it != m_chunks.end());
+    if (p == m_last_chunk && is_last(it->second.offset, n)) {
+        // buffer_manager hands the padding back along with the chunk
+        m_padding -= it->second.offset - m_last_offset;
+        m_bytes_allocated = m_last_offset;
+        m_last_chunk = 0;
+    } else if (is_last(it->second.offset, n)) {
+        m_bytes_allocated -= n;
+    }
+    m_chunks.erase(it);
+    std::free(p);
+}
+
+inline bool sizing_manager::try_expand(void* p, sizing_manager::size_type n,
+    sizing_manager::size_type new_n)
+{
+    chunk_map::iterator it = m_chunks.find(p);
+    assert(it != m_chunks.end());
+    if (!is_last(it->second.offset, n) || new_n > it->second.capacity) {
+        return false;
+    }
+    m_bytes_allocated = it->second.offset + new_n;
+    if (m_bytes_allocated > m_peak) {
+        m_peak = m_bytes_allocated;
+    }
+    return true;
+}
+
+inline void sizing_manager::reset()
+{
+    // the offsets of the chunks still out are meaningless from here on
+    for (chunk_map::iterator it = m_chunks.begin(); it != m_chunks.end(); ++it) {
+        it->second.offset = static_cast<size_type>(-1);
+    }
+    m_bytes_allocated = 0;
+    m_last_chunk = 0;
+    m_peak = 0;
+    m_max_alignment = m_alignment;
+    m_padding = 0;
+    m_allocations = 0;
+}
+
+inline bool sizing_manager::is_last(sizing_manager::size_type offset,
+    sizing_manager::size_type n) const
+{
+    return offset != static_cast<size_type>(-1) && offset + n == m_bytes_allocated;
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_SIZING_MANAGER_TCC__
@@ -0,0 +1,95 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_STATIC_BUFFER_H__
+#define __LAZY_STATIC_BUFFER_H__
+
+#include <cstddef>
+#include <lazy/memory/buffer_manager.h>
+
+namespace lazy {
+namespace memory {
+namespace detail {
+
+// \brief the storage of a static_buffer, which is a base class of it so the array is
+// there before the manager is constructed on top of it
+template <std::size_t N, std::size_t Align>
+struct static_storage
+{
+    // \brief the array memory is allocated from
+    alignas(Align) char m_storage[N];
+};
+
+} // namespace detail
+
+// \brief a Manager that owns its buffer, N bytes aligned to Align, instead of being
+// handed one.  the size can't disagree with the array, and since it is known at compile
+// time it can be checked with static_assert and asked for with capacity.  the storage
+// lives wherever the static_buffer does, so on the stack or inside another object, e.g.
+//
+//     lazy::memory::static_buffer<4096> arena;
+//     std::vector<int, buffer_allocator<int> > vec((buffer_allocator<int>(arena)));
+//
+// Manager is what cuts the storage up, buffer_manager unless you want e.g. a
+// pool_manager.  containers keep pointers into the storage, so a static_buffer can
+// neither be copied nor moved.
+template <std::size_t N, std::size_t Align = alignof(std::max_align_t),
+    typename Manager = buffer_manager>
+class static_buffer : private detail::static_storage<N, Align>, public Manager
+{
+public:
+    typedef typename Manager::size_type size_type;
+
+    // \brief the number of bytes in the storage
+    static constexpr size_type capacity = N;
+
+    // \brief the alignment of the storage
+    static constexpr size_type storage_alignment = Align;
+
+    // \brief ctor
+    // \param[in] alignment  the minimum alignment of every chunk handed out, see Manager
+    explicit static_buffer(size_type alignment = 1);
+
+    // \brief ctor for a buffer that grows from upstream once the storage is exhausted
+    // \param[in] growth  where the blocks come from once the storage is exhausted
+    // \param[in] alignment  the minimum alignment of every chunk handed out, see Manager
+    explicit static_buffer(const growth_policy& growth, size_type alignment = 1);
+
+    // \brief the storage, which is where the first chunks are handed out from
+    void* data();
+
+    // \brief the storage, which is where the first chunks are handed out from
+    const void* data() const;
+
+private:
+    static_buffer(const static_buffer&);
+    static_buffer& operator=(const static_buffer&);
+
+    static_assert(N > 0, "a static_buffer needs some storage");
+    static_assert(Align != 0 && (Align & (Align - 1)) == 0, "Align must be a power of 2");
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "static_buffer.tcc"
+
+#endif // __LAZY_STATIC_BUFFER_H__
@@ -0,0 +1,61 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_STATIC_BUFFER_TCC__
+#define __LAZY_STATIC_BUFFER_TCC__
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// static_buffer
+////////////////////////////////////////////////////////////////////////////////
+template <std::size_t N, std::size_t Align, typename Manager>
+inline static_buffer<N, Align, Manager>::static_buffer(
+        typename static_buffer<N, Align, Manager>::size_type alignment) :
+    Manager(detail::static_storage<N, Align>::m_storage, N, alignment)
+{
+    // NOP
+}
+
+template <std::size_t N, std::size_t Align, typename Manager>
+inline static_buffer<N, Align, Manager>::static_buffer(const growth_policy& growth,
+        typename static_buffer<N, Align, Manager>::size_type alignment) :
+    Manager(detail::static_storage<N, Align>::m_storage, N, growth, alignment)
+{
+    // NOP
+}
+
+template <std::size_t N, std::size_t Align, typename Manager>
+inline void* static_buffer<N, Align, Manager>::data()
+{
+    return detail::static_storage<N, Align>::m_storage;
+}
+
+template <std::size_t N, std::size_t Align, typename Manager>
+inline const void* static_buffer<N, Align, Manager>::data() const
+{
+    return detail::static_storage<N, Align>::m_storage;
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_STATIC_BUFFER_TCC__
@@ -0,0 +1,166 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_THREAD_CACHE_MANAGER_H__
+#define __LAZY_THREAD_CACHE_MANAGER_H__
+
+#include <cstdlib>
+#include <unordered_map>
+#include <lazy/memory/concurrent_buffer_manager.h>
+
+namespace lazy {
+namespace memory {
+
+// \brief manages the allocation of memory from a buffer shared by many threads, where
+// every thread bumps a cursor through a chunk of its own.  the buffer is cut into chunks
+// by a concurrent_buffer_manager, and a thread only touches it (and its atomic cursor)
+// when its chunk runs out, so allocations are plain thread-local pointer bumps that
+// don't bounce cache lines between cores.  chunks are cache-line aligned and the
+// per-thread cursors live in cache-line padded thread-local storage.
+//
+// chunks bigger than a quarter of the chunk size come straight from the shared buffer.
+// whatever is left at the end of a chunk when a thread moves on to the next one is not
+// reused, and neither is the rest of its chunk when a thread exits.
+//
+// a thread keeps a region for every manager it allocates from, so it can switch between
+// any number of them without giving up the chunks it has taken.  regions of managers
+// that have been destroyed are dropped the next time the thread's table fills up.
+class thread_cache_manager
+{
+public:
+    typedef std::size_t size_type;
+
+    // \brief the default size of the chunk each thread takes from the buffer
+    static const size_type default_chunk_size = 64 * 1024;
+
+    // \brief ctor
+    // \param[in] buffer  pointer to the buffer to use for allocation
+    // \param[in] buffer_size  size of the buffer.  make sure they match.
+    // \param[in] alignment  the minimum alignment of every chunk handed out.  must be a
+    //                        power of 2.
+    // \param[in] chunk_size  how much each thread takes from the buffer at a time
+    thread_cache_manager(void* buffer, size_type buffer_size, size_type alignment = 1,
+        size_type chunk_size = default_chunk_size);
+
+    // \brief dtor
+    ~thread_cache_manager();
+
+    // \brief the buffer size in this class
+    size_type buffer_size() const;
+
+    // \brief the amount of space remaining in the buffer, not counting what is left in
+    // the chunks threads have already taken
+    size_type available() const;
+
+    // \brief the number of bytes taken from the buffer, counting the chunks threads have
+    // taken as a whole
+    size_type used() const;
+
+    // \brief the largest number of bytes that could ever be handed out
+    size_type max_size() const;
+
+    // \brief the minimum alignment of the chunks handed out
+    size_type alignment() const;
+
+    // \brief how much each thread takes from the buffer at a time
+    size_type chunk_size() const;
+
+    // \brief allocates a chunk of memory of requested size, aligned to the minimum alignment
+    // \param[in] n   size of chunk in bytes
+    void* allocate(size_type n);
+
+    // \brief allocates a chunk of memory of requested size and alignment
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* allocate(size_type n, size_type alignment);
+
+    // \brief returns a chunk, which is only reclaimed if it was the last one the calling
+    // thread allocated
+    // \param[in] p  the chunk
+    // \param[in] n  size of the chunk in bytes
+    void deallocate(void* p, size_type n);
+
+    // \brief tries to resize the last chunk the calling thread allocated in place
+    // \param[in] p  the chunk
+    // \param[in] n  current size of the chunk in bytes
+    // \param[in] new_n  the size the chunk needs to be
+    // \return true if the chunk now holds new_n bytes
+    bool try_expand(void* p, size_type n, size_type new_n);
+
+protected:
+    // \brief the size of a cache line, which is what per-thread state is padded to
+    static const size_type cache_line_size = 64;
+
+    // \brief the part of the buffer a thread is allocating from
+    struct alignas(cache_line_size) local_region
+    {
+        // \brief the manager the region belongs to, see m_id
+        unsigned long long id;
+
+        // \brief start of the chunk
+        char* begin;
+
+        // \brief first free byte
+        char* cursor;
+
+        // \brief end of the chunk
+        char* end;
+    };
+
+    // \brief a thread's regions, by the id of the manager they belong to
+    typedef std::unordered_map<unsigned long long, local_region> region_map;
+
+    // \brief the calling thread's region for this manager
+    local_region& local() const;
+
+    // \brief forgets the regions of managers that have been destroyed
+    static void drop_dead_regions(region_map& regions);
+
+    // \brief takes a new chunk from the buffer and allocates from it
+    void* refill(local_region& region, size_type n, size_type alignment);
+
+    // \brief whether a chunk is too big to come out of a thread's region
+    bool is_large(size_type n) const;
+
+    // \brief cuts the buffer into chunks
+    concurrent_buffer_manager m_central;
+
+    // \brief how much each thread takes from the buffer at a time
+    const size_type m_chunk_size;
+
+    // \brief minimum alignment of the chunks handed out
+    const size_type m_alignment;
+
+    // \brief identifies this manager in thread-local storage.  ids are never reused, so a
+    // manager created where an old one used to be doesn't pick up its stale regions.
+    const unsigned long long m_id;
+
+private:
+    thread_cache_manager(const thread_cache_manager&);
+    thread_cache_manager& operator=(const thread_cache_manager&);
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "thread_cache_manager.tcc"
+
+#endif // __LAZY_THREAD_CACHE_MANAGER_H__
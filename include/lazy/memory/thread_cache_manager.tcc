@@ -0,0 +1,235 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_THREAD_CACHE_MANAGER_TCC__
+#define __LAZY_THREAD_CACHE_MANAGER_TCC__
+
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <unordered_set>
+#include <utility>
+#include <stdint.h>
+#include <bits/functexcept.h>
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// detail
+////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+
+inline unsigned long long next_thread_cache_id()
+{
+    static std::atomic<unsigned long long> id(0);
+    return ++id;
+}
+
+// \brief the ids of the thread_cache_managers that haven't been destroyed yet, so threads
+// can tell which of their regions are stale
+struct thread_cache_registry
+{
+    std::mutex mutex;
+    std::unordered_set<unsigned long long> live;
+};
+
+inline thread_cache_registry& thread_cache_managers()
+{
+    static thread_cache_registry registry;
+    return registry;
+}
+
+} // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////
+// thread_cache_manager
+////////////////////////////////////////////////////////////////////////////////
+inline thread_cache_manager::thread_cache_manager(void* buffer,
+        thread_cache_manager::size_type buffer_size, thread_cache_manager::size_type alignment,
+        thread_cache_manager::size_type chunk_size) :
+    m_central(buffer, buffer_size, cache_line_size),
+    m_chunk_size(chunk_size),
+    m_alignment(alignment),
+    m_id(detail::next_thread_cache_id())
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    detail::thread_cache_registry& registry = detail::thread_cache_managers();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.live.insert(m_id);
+}
+
+inline thread_cache_manager::~thread_cache_manager()
+{
+    detail::thread_cache_registry& registry = detail::thread_cache_managers();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.live.erase(m_id);
+}
+
+inline thread_cache_manager::size_type thread_cache_manager::buffer_size() const
+{
+    return m_central.buffer_size();
+}
+
+inline thread_cache_manager::size_type thread_cache_manager::available() const
+{
+    return m_central.available();
+}
+
+inline thread_cache_manager::size_type thread_cache_manager::used() const
+{
+    return m_central.used();
+}
+
+inline thread_cache_manager::size_type thread_cache_manager::max_size() const
+{
+    return m_central.max_size();
+}
+
+inline thread_cache_manager::size_type thread_cache_manager::alignment() const
+{
+    return m_alignment;
+}
+
+inline thread_cache_manager::size_type thread_cache_manager::chunk_size() const
+{
+    return m_chunk_size;
+}
+
+inline void* thread_cache_manager::allocate(thread_cache_manager::size_type n)
+{
+    return allocate(n, m_alignment);
+}
+
+inline void* thread_cache_manager::allocate(thread_cache_manager::size_type n,
+    thread_cache_manager::size_type alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if (alignment < m_alignment) {
+        alignment = m_alignment;
+    }
+    if (is_large(n)) {
+        return m_central.allocate(n, alignment);
+    }
+    local_region& region = local();
+    const uintptr_t address = reinterpret_cast<uintptr_t>(region.cursor);
+    const size_type padding = static_cast<size_type>(-address & (alignment - 1));
+    const size_type remains = region.end - region.cursor;
+    if (remains < padding || remains - padding < n) {
+        return refill(region, n, alignment);
+    }
+    void* cursor = region.cursor + padding;
+    region.cursor += padding + n;
+    return cursor;
+}
+
+inline void thread_cache_manager::deallocate(void* p, thread_cache_manager::size_type n)
+{
+    if (is_large(n)) {
+        m_central.deallocate(p, n);
+        return;
+    }
+    local_region& region = local();
+    char* const chunk = static_cast<char*>(p);
+    if (chunk >= region.begin && chunk + n == region.cursor) {
+        region.cursor = chunk;
+    }
+}
+
+inline bool thread_cache_manager::try_expand(void* p, thread_cache_manager::size_type n,
+    thread_cache_manager::size_type new_n)
+{
+    if (is_large(n) && is_large(new_n)) {
+        return m_central.try_expand(p, n, new_n);
+    }
+    if (is_large(n) || is_large(new_n)) {
+        return false;
+    }
+    local_region& region = local();
+    char* const chunk = static_cast<char*>(p);
+    if (chunk < region.begin || chunk + n != region.cursor ||
+            new_n > static_cast<size_type>(region.end - chunk)) {
+        return false;
+    }
+    region.cursor = chunk + new_n;
+    return true;
+}
+
+inline thread_cache_manager::local_region& thread_cache_manager::local() const
+{
+    static thread_local region_map regions;
+    // threads mostly stick to one manager, so the last region found skips the lookup
+    static thread_local local_region* last = 0;
+    static thread_local size_type prune_at = 16;
+
+    if (last && last->id == m_id) {
+        return *last;
+    }
+    region_map::iterator it = regions.find(m_id);
+    if (it == regions.end()) {
+        if (regions.size() >= prune_at) {
+            last = 0;
+            drop_dead_regions(regions);
+            prune_at = 2 * regions.size() + 16;
+        }
+        local_region region;
+        region.id = m_id;
+        region.begin = 0;
+        region.cursor = 0;
+        region.end = 0;
+        it = regions.insert(std::make_pair(m_id, region)).first;
+    }
+    last = &it->second;
+    return *last;
+}
+
+inline void thread_cache_manager::drop_dead_regions(thread_cache_manager::region_map& regions)
+{
+    detail::thread_cache_registry& registry = detail::thread_cache_managers();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (region_map::iterator it = regions.begin(); it != regions.end(); ) {
+        if (registry.live.count(it->first)) {
+            ++it;
+        } else {
+            it = regions.erase(it);
+        }
+    }
+}
+
+inline void* thread_cache_manager::refill(thread_cache_manager::local_region& region,
+    thread_cache_manager::size_type n, thread_cache_manager::size_type alignment)
+{
+    const size_type chunk_alignment = alignment > cache_line_size ? alignment : cache_line_size;
+    char* const chunk = static_cast<char*>(m_central.allocate(m_chunk_size, chunk_alignment));
+    region.begin = chunk;
+    region.cursor = chunk + n;
+    region.end = chunk + m_chunk_size;
+    return chunk;
+}
+
+inline bool thread_cache_manager::is_large(thread_cache_manager::size_type n) const
+{
+    return n > m_chunk_size / 4;
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_THREAD_CACHE_MANAGER_TCC__
@@ -0,0 +1,269 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_TLSF_MANAGER_H__
+#define __LAZY_TLSF_MANAGER_H__
+
+#include <cstdlib>
+#include <lazy/memory/poison.h>
+
+namespace lazy {
+namespace memory {
+
+// \brief manages a buffer like a general-purpose allocator would, so chunks of any size
+// can be deallocated in any order and their memory is reused.  this is what vectors that
+// keep resizing and strings of varying length need to live in a fixed footprint for the
+// lifetime of a long-running program, which buffer_manager's high-water mark can't do.
+//
+// the buffer is cut up into blocks, each with a two-word header.  free blocks are kept
+// on a two-level segregated fit (TLSF) index: the first level is the power of 2 below
+// the block size, the second splits that range into 16 lists, and a bitmap per level
+// says which lists are non-empty.  allocate() rounds the request up to the next list,
+// so any block found there fits, finds the first non-empty list at or above it with two
+// bit scans and splits the block.  deallocate() merges the block with its neighbours if
+// they are free.  both take constant time no matter how the buffer is fragmented, and
+// rounding wastes at most 1/16th of a chunk.
+//
+// the list heads take up the front of the buffer, a few hundred bytes for small buffers
+// and about 7 KiB for the largest, which counts against used().  the buffer never grows.
+//
+// under AddressSanitizer, free blocks and the part of every chunk past what was asked
+// for are poisoned.  block headers, and the free list links at the start of free blocks,
+// are not.
+class tlsf_manager
+{
+protected:
+    struct block_header;
+
+public:
+    typedef std::size_t size_type;
+
+    // \brief ctor
+    // \param[in] buffer  pointer to the buffer to use for allocation
+    // \param[in] buffer_size  size of the buffer.  make sure they match.
+    // \param[in] alignment  the minimum alignment of every chunk handed out.  must be a
+    //                        power of 2.  chunks are always aligned to granularity.
+    tlsf_manager(void* buffer, size_type buffer_size, size_type alignment = 1);
+
+    // \brief dtor
+    ~tlsf_manager();
+
+    // \brief the buffer size in this class
+    size_type buffer_size() const;
+
+    // \brief the number of bytes in free blocks.  that much can't necessarily be handed
+    // out as one chunk since the free blocks may not be next to each other.
+    size_type available() const;
+
+    // \brief the number of bytes not in free blocks, including the list heads, block
+    // headers and rounding
+    size_type used() const;
+
+    // \brief the largest number of bytes that could ever be handed out, which is what the
+    // empty buffer holds as one block
+    size_type max_size() const;
+
+    // \brief the minimum alignment of the chunks handed out
+    size_type alignment() const;
+
+    // \brief allocates a chunk of memory of requested size, aligned to the minimum alignment
+    // \param[in] n   size of chunk in bytes
+    void* allocate(size_type n);
+
+    // \brief allocates a chunk of memory of requested size and alignment.  a block is
+    // looked for that fits the chunk after moving it up to the boundary, and whatever is
+    // left in front of it goes back to the free lists.
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* allocate(size_type n, size_type alignment);
+
+    // \brief allocates a chunk like allocate() does, but returns 0 instead of throwing
+    // std::bad_alloc when no free block is big enough
+    // \param[in] n   size of chunk in bytes
+    void* try_allocate(size_type n);
+
+    // \brief allocates a chunk like allocate() does, but returns 0 instead of throwing
+    // \param[in] n   size of chunk in bytes
+    // \param[in] alignment  power of 2 the chunk must be aligned to
+    void* try_allocate(size_type n, size_type alignment);
+
+    // \brief returns a chunk to the free lists, merged with the blocks on either side of
+    // it if they are free
+    // \param[in] p  the chunk
+    // \param[in] n  size of the chunk in bytes
+    void deallocate(void* p, size_type n);
+
+    // \brief resizes a chunk in place.  it can grow into the block after it if that one
+    // is free, and gives back what it no longer needs when it shrinks.
+    // \param[in] p  the chunk
+    // \param[in] n  current size of the chunk in bytes
+    // \param[in] new_n  the size the chunk needs to be
+    // \return true if the chunk now holds new_n bytes, false if it was left alone
+    bool try_expand(void* p, size_type n, size_type new_n);
+
+    // \brief releases everything, which leaves the buffer as one free block
+    void reset();
+
+    // \brief the number of free blocks, which is how fragmented the buffer is.  this
+    // walks every block, so keep it out of hot paths.
+    size_type free_blocks() const;
+
+    // \brief chunks are multiples of this size, and aligned to it
+    static const size_type granularity = 2 * sizeof(void*);
+
+protected:
+    // \brief at the start of every block, right in front of the chunk
+    struct block_header
+    {
+        // \brief the block right before this one in the buffer, or 0 for the first
+        block_header* previous;
+
+        // \brief the number of bytes after the header, with the lowest bit set if the
+        // block is free
+        size_type size;
+    };
+
+    // \brief at the start of a free block's chunk
+    struct free_links
+    {
+        // \brief the next free block on the same list, or 0
+        block_header* next;
+
+        // \brief the previous free block on the same list, or 0
+        block_header* previous;
+    };
+
+    // \brief log2 of the number of second-level lists per first-level range
+    static const size_type second_level_log2 = 4;
+
+    // \brief the number of second-level lists per first-level range
+    static const size_type second_level_count = 1 << second_level_log2;
+
+    // \brief log2 of granularity
+    static const size_type granularity_log2 = sizeof(void*) == 8 ? 4 : 3;
+
+    // \brief blocks smaller than this all go in the first first-level range, whose
+    // second-level lists are granularity apart
+    static const size_type small_block_size = second_level_count << granularity_log2;
+
+    // \brief the largest number of first-level ranges, enough for any size_type
+    static const size_type first_level_limit =
+        sizeof(size_type) * 8 - second_level_log2 - granularity_log2 + 1;
+
+    // \brief the smallest block, which has to hold the free_links
+    static const size_type min_block_size = sizeof(free_links);
+
+    // \brief the lowest bit of block_header::size
+    static const size_type free_bit = 1;
+
+    // \brief the first- and second-level list a block of this size goes on
+    static void mapping(size_type size, size_type& first, size_type& second);
+
+    // \brief rounds a chunk size up to a block size, 0 if it can't be done
+    static size_type round_size(size_type n);
+
+    // \brief the chunk of a block
+    static char* chunk(block_header* block);
+
+    // \brief the block of a chunk
+    static block_header* header(void* chunk);
+
+    // \brief the number of bytes after the header of a block
+    static size_type size_of(const block_header* block);
+
+    // \brief whether a block is on the free lists
+    static bool is_free(const block_header* block);
+
+    // \brief the free_links of a free block
+    static free_links* links(block_header* block);
+
+    // \brief the block right after this one in the buffer
+    static block_header* next(block_header* block);
+
+    // \brief lays out the list heads and one free block spanning the rest of the buffer
+    void initialize();
+
+    // \brief a free block of at least size bytes, or 0
+    block_header* find_free(size_type size) const;
+
+    // \brief puts a block on the free list for its size
+    void insert(block_header* block);
+
+    // \brief takes a block off its free list
+    void remove(block_header* block);
+
+    // \brief turns what is in front of the aligned chunk into a free block of its own,
+    // returns the block the chunk is in
+    block_header* align(block_header* block, size_type alignment);
+
+    // \brief turns what is past the first size bytes of a block into a free block of its
+    // own, merged with the block after it if that one is free.  a tail too small to hold
+    // a block stays where it is.
+    void split(block_header* block, size_type size);
+
+    // \brief poisons a free block, except for its free_links
+    static void poison_free(block_header* block);
+
+    // \brief the buffer
+    void* const m_buffer;
+
+    // \brief buffer size
+    const size_type m_buffer_size;
+
+    // \brief minimum alignment of the chunks handed out, at least granularity
+    const size_type m_alignment;
+
+    // \brief the list heads at the front of the buffer, second_level_count per
+    // first-level range
+    block_header** m_heads;
+
+    // \brief the number of first-level ranges the buffer needs
+    size_type m_first_level_count;
+
+    // \brief the first block, right after the list heads, or 0 if the buffer can't even
+    // hold one block
+    block_header* m_first;
+
+    // \brief the size of the first block when every block is free
+    size_type m_max_size;
+
+    // \brief the number of bytes in free blocks
+    size_type m_free_bytes;
+
+    // \brief bit i is set if any of the lists of first-level range i are non-empty
+    size_type m_first_level_bitmap;
+
+    // \brief bit j of entry i is set if list j of first-level range i is non-empty
+    unsigned m_second_level_bitmap[first_level_limit];
+
+private:
+    // \brief not copyable, since two managers cutting up the same buffer would hand out
+    // the same memory twice.
+    tlsf_manager(const tlsf_manager&);
+    tlsf_manager& operator=(const tlsf_manager&);
+};
+
+} // namespace memory
+} // namespace lazy
+
+#include "tlsf_manager.tcc"
+
+#endif // __LAZY_TLSF_MANAGER_H__
@@ -0,0 +1,451 @@
+// The MIT License (MIT)
+// 
+// Copyright (c) 2013 Vince Tse
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+#ifndef __LAZY_TLSF_MANAGER_TCC__
+#define __LAZY_TLSF_MANAGER_TCC__
+
+#include <cassert>
+#include <stdint.h>
+#include <bits/functexcept.h>
+
+namespace lazy {
+namespace memory {
+////////////////////////////////////////////////////////////////////////////////
+// detail
+////////////////////////////////////////////////////////////////////////////////
+namespace detail {
+
+// the index of the highest bit set, x must not be 0
+inline std::size_t highest_bit(std::size_t x)
+{
+    return sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(x);
+}
+
+// the index of the lowest bit set, x must not be 0
+inline std::size_t lowest_bit(std::size_t x)
+{
+    return __builtin_ctzll(x);
+}
+
+} // namespace detail
+
+////////////////////////////////////////////////////////////////////////////////
+// tlsf_manager
+////////////////////////////////////////////////////////////////////////////////
+inline tlsf_manager::tlsf_manager(void* buffer, tlsf_manager::size_type buffer_size,
+        tlsf_manager::size_type alignment) :
+    m_buffer(buffer),
+    m_buffer_size(buffer_size),
+    m_alignment(alignment > granularity ? alignment : granularity),
+    m_heads(0),
+    m_first_level_count(0),
+    m_first(0),
+    m_max_size(0),
+    m_free_bytes(0),
+    m_first_level_bitmap(0)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    initialize();
+}
+
+inline tlsf_manager::~tlsf_manager()
+{
+    detail::unpoison(m_buffer, m_buffer_size);
+}
+
+inline tlsf_manager::size_type tlsf_manager::buffer_size() const
+{
+    return m_buffer_size;
+}
+
+inline tlsf_manager::size_type tlsf_manager::available() const
+{
+    return m_free_bytes;
+}
+
+inline tlsf_manager::size_type tlsf_manager::used() const
+{
+    return m_buffer_size - m_free_bytes;
+}
+
+inline tlsf_manager::size_type tlsf_manager::max_size() const
+{
+    return m_max_size;
+}
+
+inline tlsf_manager::size_type tlsf_manager::alignment() const
+{
+    return m_alignment;
+}
+
+inline void* tlsf_manager::allocate(tlsf_manager::size_type n)
+{
+    return allocate(n, m_alignment);
+}
+
+inline void* tlsf_manager::allocate(tlsf_manager::size_type n,
+    tlsf_manager::size_type alignment)
+{
+    void* const p = try_allocate(n, alignment);
+    if (!p) {
+        std::__throw_bad_alloc();
+    }
+    return p;
+}
+
+inline void* tlsf_manager::try_allocate(tlsf_manager::size_type n)
+{
+    return try_allocate(n, m_alignment);
+}
+
+inline void* tlsf_manager::try_allocate(tlsf_manager::size_type n,
+    tlsf_manager::size_type alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+    if (alignment < m_alignment) {
+        alignment = m_alignment;
+    }
+    const size_type size = round_size(n);
+    if (size == 0) {
+        return 0;
+    }
+    // blocks are only aligned to granularity, so look for one that still fits once the
+    // chunk is moved up to the boundary far enough to leave a free block in front of it
+    size_type wanted = size;
+    if (alignment > granularity) {
+        const size_type slack = alignment + sizeof(block_header) + min_block_size;
+        if (size > static_cast<size_type>(-1) - slack) {
+            return 0;
+        }
+        wanted += slack;
+    }
+    block_header* block = find_free(wanted);
+    if (!block) {
+        return 0;
+    }
+    remove(block);
+    detail::unpoison(chunk(block), size_of(block));
+    if (alignment > granularity) {
+        block = align(block, alignment);
+    }
+    split(block, size);
+    char* const p = chunk(block);
+    detail::poison(p + n, size_of(block) - n);
+    return p;
+}
+
+inline void tlsf_manager::deallocate(void* p, tlsf_manager::size_type n)
+{
+    block_header* block = header(p);
+    assert(!is_free(block) && size_of(block) >= n);
+    static_cast<void>(n);
+    block_header* const after = next(block);
+    if (is_free(after)) {
+        remove(after);
+        block->size += sizeof(block_header) + size_of(after);
+    }
+    block_header* const before = block->previous;
+    if (before && is_free(before)) {
+        remove(before);
+        before->size += sizeof(block_header) + size_of(block);
+        block = before;
+    }
+    next(block)->previous = block;
+    insert(block);
+    poison_free(block);
+}
+
+inline bool tlsf_manager::try_expand(void* p, tlsf_manager::size_type n,
+    tlsf_manager::size_type new_n)
+{
+    block_header* const block = header(p);
+    assert(!is_free(block) && size_of(block) >= n);
+    static_cast<void>(n);
+    const size_type size = round_size(new_n);
+    if (size == 0) {
+        return false;
+    }
+    if (size > size_of(block)) {
+        block_header* const after = next(block);
+        if (!is_free(after) || size_of(block) + sizeof(block_header) + size_of(after) < size) {
+            return false;
+        }
+        remove(after);
+        detail::unpoison(after, sizeof(block_header) + size_of(after));
+        block->size += sizeof(block_header) + size_of(after);
+        next(block)->previous = block;
+    }
+    split(block, size);
+    detail::unpoison(p, new_n);
+    detail::poison(static_cast<char*>(p) + new_n, size_of(block) - new_n);
+    return true;
+}
+
+inline void tlsf_manager::reset()
+{
+    initialize();
+}
+
+inline tlsf_manager::size_type tlsf_manager::free_blocks() const
+{
+    if (!m_first) {
+        return 0;
+    }
+    size_type count = 0;
+    for (block_header* block = m_first; size_of(block) != 0; block = next(block)) {
+        if (is_free(block)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+inline void tlsf_manager::mapping(tlsf_manager::size_type size,
+    tlsf_manager::size_type& first, tlsf_manager::size_type& second)
+{
+    if (size < small_block_size) {
+        first = 0;
+        second = size >> granularity_log2;
+    } else {
+        const size_type bit = detail::highest_bit(size);
+        second = (size >> (bit - second_level_log2)) ^ second_level_count;
+        first = bit - second_level_log2 - granularity_log2 + 1;
+    }
+}
+
+inline tlsf_manager::size_type tlsf_manager::round_size(tlsf_manager::size_type n)
+{
+    if (n > static_cast<size_type>(-1) - (granularity - 1)) {
+        return 0;
+    }
+    const size_type size = (n + granularity - 1) & ~(granularity - 1);
+    return size < min_block_size ? min_block_size : size;
+}
+
+inline char* tlsf_manager::chunk(tlsf_manager::block_header* block)
+{
+    return reinterpret_cast<char*>(block) + sizeof(block_header);
+}
+
+inline tlsf_manager::block_header* tlsf_manager::header(void* chunk)
+{
+    return reinterpret_cast<block_header*>(static_cast<char*>(chunk) - sizeof(block_header));
+}
+
+inline tlsf_manager::size_type tlsf_manager::size_of(const tlsf_manager::block_header* block)
+{
+    return block->size & ~free_bit;
+}
+
+inline bool tlsf_manager::is_free(const tlsf_manager::block_header* block)
+{
+    return (block->size & free_bit) != 0;
+}
+
+inline tlsf_manager::free_links* tlsf_manager::links(tlsf_manager::block_header* block)
+{
+    return reinterpret_cast<free_links*>(chunk(block));
+}
+
+inline tlsf_manager::block_header* tlsf_manager::next(tlsf_manager::block_header* block)
+{
+    return reinterpret_cast<block_header*>(chunk(block) + size_of(block));
+}
+
+inline void tlsf_manager::initialize()
+{
+    m_heads = 0;
+    m_first_level_count = 0;
+    m_first = 0;
+    m_max_size = 0;
+    m_free_bytes = 0;
+    m_first_level_bitmap = 0;
+    for (size_type i = 0; i < first_level_limit; ++i) {
+        m_second_level_bitmap[i] = 0;
+    }
+    const uintptr_t address = reinterpret_cast<uintptr_t>(m_buffer);
+    const size_type padding = static_cast<size_type>(-address & (granularity - 1));
+    if (m_buffer_size < padding) {
+        return;
+    }
+    // enough list heads for a block spanning the whole buffer, followed by that block
+    // and a zero-sized block marking the end, which is never free so nothing merges
+    // past it
+    const size_type usable = (m_buffer_size - padding) & ~(granularity - 1);
+    size_type first;
+    size_type second;
+    mapping(usable, first, second);
+    const size_type heads = (first + 1) * second_level_count * sizeof(block_header*);
+    if (usable < heads + 2 * sizeof(block_header) + min_block_size) {
+        return;
+    }
+    m_heads = reinterpret_cast<block_header**>(static_cast<char*>(m_buffer) + padding);
+    m_first_level_count = first + 1;
+    for (size_type i = 0; i < m_first_level_count * second_level_count; ++i) {
+        m_heads[i] = 0;
+    }
+    m_first = reinterpret_cast<block_header*>(reinterpret_cast<char*>(m_heads) + heads);
+    m_first->previous = 0;
+    m_first->size = usable - heads - 2 * sizeof(block_header);
+    m_max_size = m_first->size;
+    block_header* const end = next(m_first);
+    end->previous = m_first;
+    end->size = 0;
+    insert(m_first);
+    poison_free(m_first);
+}
+
+inline tlsf_manager::block_header* tlsf_manager::find_free(tlsf_manager::size_type size) const
+{
+    // rounded up to the next list, every block on the lists searched fits
+    size_type first = m_first_level_count;
+    size_type second = 0;
+    if (size < small_block_size) {
+        mapping(size, first, second);
+    } else {
+        const size_type round =
+            (size_type(1) << (detail::highest_bit(size) - second_level_log2)) - 1;
+        if (size <= static_cast<size_type>(-1) - round) {
+            mapping(size + round, first, second);
+        }
+    }
+    if (first < m_first_level_count) {
+        unsigned second_map = m_second_level_bitmap[first] & (~0u << second);
+        if (!second_map) {
+            const size_type first_map = m_first_level_bitmap & (~size_type(0) << (first + 1));
+            if (first_map) {
+                first = detail::lowest_bit(first_map);
+                second_map = m_second_level_bitmap[first];
+            }
+        }
+        if (second_map) {
+            return m_heads[first * second_level_count + detail::lowest_bit(second_map)];
+        }
+    }
+    // the list the size itself goes on may still have a block that fits at its head,
+    // which is the only way to get the biggest blocks out
+    mapping(size, first, second);
+    if (first < m_first_level_count) {
+        block_header* const block = m_heads[first * second_level_count + second];
+        if (block && size_of(block) >= size) {
+            return block;
+        }
+    }
+    return 0;
+}
+
+inline void tlsf_manager::insert(tlsf_manager::block_header* block)
+{
+    size_type first;
+    size_type second;
+    mapping(size_of(block), first, second);
+    block_header*& head = m_heads[first * second_level_count + second];
+    detail::unpoison(links(block), sizeof(free_links));
+    links(block)->next = head;
+    links(block)->previous = 0;
+    if (head) {
+        links(head)->previous = block;
+    }
+    head = block;
+    block->size |= free_bit;
+    m_first_level_bitmap |= size_type(1) << first;
+    m_second_level_bitmap[first] |= 1u << second;
+    m_free_bytes += size_of(block);
+}
+
+inline void tlsf_manager::remove(tlsf_manager::block_header* block)
+{
+    size_type first;
+    size_type second;
+    mapping(size_of(block), first, second);
+    free_links* const free = links(block);
+    if (free->next) {
+        links(free->next)->previous = free->previous;
+    }
+    if (free->previous) {
+        links(free->previous)->next = free->next;
+    } else {
+        block_header*& head = m_heads[first * second_level_count + second];
+        head = free->next;
+        if (!head) {
+            m_second_level_bitmap[first] &= ~(1u << second);
+            if (!m_second_level_bitmap[first]) {
+                m_first_level_bitmap &= ~(size_type(1) << first);
+            }
+        }
+    }
+    block->size &= ~free_bit;
+    m_free_bytes -= size_of(block);
+}
+
+inline tlsf_manager::block_header* tlsf_manager::align(tlsf_manager::block_header* block,
+    tlsf_manager::size_type alignment)
+{
+    char* const p = chunk(block);
+    size_type gap = static_cast<size_type>(-reinterpret_cast<uintptr_t>(p) & (alignment - 1));
+    if (gap == 0) {
+        return block;
+    }
+    // the gap becomes a free block, so it has to be big enough to be one
+    if (gap < sizeof(block_header) + min_block_size) {
+        gap += alignment;
+    }
+    block_header* const aligned = reinterpret_cast<block_header*>(p + gap - sizeof(block_header));
+    aligned->previous = block;
+    aligned->size = size_of(block) - gap;
+    block->size = gap - sizeof(block_header);
+    next(aligned)->previous = aligned;
+    // the block before it is in use, otherwise the two would have been merged
+    insert(block);
+    poison_free(block);
+    return aligned;
+}
+
+inline void tlsf_manager::split(tlsf_manager::block_header* block, tlsf_manager::size_type size)
+{
+    const size_type total = size_of(block);
+    if (total - size < sizeof(block_header) + min_block_size) {
+        return;
+    }
+    block_header* const tail = reinterpret_cast<block_header*>(chunk(block) + size);
+    detail::unpoison(tail, sizeof(block_header));
+    tail->previous = block;
+    tail->size = total - size - sizeof(block_header);
+    block->size = size;
+    block_header* const after = next(tail);
+    if (is_free(after)) {
+        remove(after);
+        tail->size += sizeof(block_header) + size_of(after);
+    }
+    next(tail)->previous = tail;
+    insert(tail);
+    poison_free(tail);
+}
+
+inline void tlsf_manager::poison_free(tlsf_manager::block_header* block)
+{
+    detail::poison(chunk(block) + sizeof(free_links), size_of(block) - sizeof(free_links));
+}
+
+} // namespace memory
+} // namespace lazy
+
+#endif // __LAZY_TLSF_MANAGER_TCC__
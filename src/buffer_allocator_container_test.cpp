@@ -16,15 +16,37 @@
 #include <utility>
 #include <functional>
 #include <algorithm>
+#include <stdint.h>
 
-BOOST_AUTO_TEST_CASE( stl_vector_push_back )
+namespace {
+
+bool is_aligned(const void* p, size_t alignment)
+{
+    return (reinterpret_cast<uintptr_t>(p) % alignment) == 0;
+}
+
+// stands in for an AVX vector
+struct alignas(32) vec4
+{
+    double v[4];
+};
+
+// the tests that fill a buffer sized for exactly so many elements need chunks to be packed
+// without a red zone between them
+const bool exact_layout = lazy::memory::detail::red_zone == 0;
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( stl_vector_push_back,
+    *boost::unit_test::enable_if<exact_layout>() )
 {
     typedef int data_type;
     typedef lazy::memory::buffer_allocator<data_type> allocator_type;
 
     const size_t num_objects = 3;
     data_type buffer[num_objects];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     BOOST_REQUIRE_EQUAL(allocator.max_size(), num_objects);
 
     std::vector<data_type, allocator_type> vec(allocator);
@@ -39,14 +61,16 @@ BOOST_AUTO_TEST_CASE( stl_vector_push_back )
     BOOST_REQUIRE_EQUAL(vec.size(), 2);
 }
 
-BOOST_AUTO_TEST_CASE( stl_vector_resize )
+BOOST_AUTO_TEST_CASE( stl_vector_resize,
+    *boost::unit_test::enable_if<exact_layout>() )
 {
     typedef int data_type;
     typedef lazy::memory::buffer_allocator<data_type> allocator_type;
 
     const size_t num_objects = 2;
     data_type buffer[num_objects];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     BOOST_REQUIRE_EQUAL(allocator.max_size(), num_objects);
 
     std::vector<data_type, allocator_type> vec(allocator);
@@ -57,16 +81,39 @@ BOOST_AUTO_TEST_CASE( stl_vector_resize )
     BOOST_REQUIRE_EQUAL(vec.size(), num_objects);
 }
 
-BOOST_AUTO_TEST_CASE( stl_vector_copy )
+BOOST_AUTO_TEST_CASE( stl_vector_grows_to_heap )
+{
+    typedef int data_type;
+    typedef lazy::memory::buffer_allocator<data_type> allocator_type;
+
+    const size_t num_objects = 4;
+    data_type buffer[num_objects];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer), lazy::memory::growth_policy::heap());
+    allocator_type allocator(manager);
+
+    std::vector<data_type, allocator_type> vec(allocator);
+    for (int i = 0; i < 10000; ++i) {
+        BOOST_REQUIRE_NO_THROW(vec.push_back(i));
+    }
+    BOOST_REQUIRE_EQUAL(vec.size(), 10000);
+    for (int i = 0; i < 10000; ++i) {
+        BOOST_REQUIRE_EQUAL(vec[i], i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( stl_vector_copy,
+    *boost::unit_test::enable_if<exact_layout>() )
 {
     typedef int data_type;
     typedef lazy::memory::buffer_allocator<data_type> allocator_type;
 
     const size_t num_objects = 2;
     data_type buffer1[num_objects];
-    allocator_type allocator1(buffer1, sizeof(buffer1));
+    lazy::memory::buffer_manager manager1(buffer1, sizeof(buffer1));
+    allocator_type allocator1(manager1);
     data_type buffer2[num_objects];
-    allocator_type allocator2(buffer2, sizeof(buffer2));
+    lazy::memory::buffer_manager manager2(buffer2, sizeof(buffer2));
+    allocator_type allocator2(manager2);
 
     std::vector<data_type, allocator_type> vec1(allocator1);
     std::vector<data_type, allocator_type> vec2(allocator2);
@@ -80,12 +127,70 @@ BOOST_AUTO_TEST_CASE( stl_vector_copy )
     BOOST_REQUIRE_EQUAL(vec2[0], 1);
     BOOST_REQUIRE_EQUAL(vec2[1], 2);
     vec1.clear();
+    lazy::memory::detail::unpoison(buffer1, sizeof(buffer1));
     memset(buffer1, 0, sizeof(buffer1));
     BOOST_REQUIRE_EQUAL(vec1.size(), 0);
     BOOST_REQUIRE_EQUAL(vec2[0], 1);
     BOOST_REQUIRE_EQUAL(vec2[1], 2);
 }
 
+BOOST_AUTO_TEST_CASE( stl_vector_move_assign_steals_storage,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef int data_type;
+    typedef lazy::memory::buffer_allocator<data_type> allocator_type;
+
+    const size_t num_objects = 4;
+    data_type buffer1[num_objects];
+    lazy::memory::buffer_manager manager1(buffer1, sizeof(buffer1));
+    data_type buffer2[num_objects];
+    lazy::memory::buffer_manager manager2(buffer2, sizeof(buffer2));
+
+    std::vector<data_type, allocator_type> vec1((allocator_type(manager1)));
+    std::vector<data_type, allocator_type> vec2((allocator_type(manager2)));
+    vec1.reserve(num_objects);
+    vec1.push_back(1);
+    vec1.push_back(2);
+    const data_type* storage = vec1.data();
+
+    // the allocator propagates on move, so the elements stay where they are
+    // and the second manager is never touched.
+    vec2 = std::move(vec1);
+    BOOST_REQUIRE_EQUAL(vec2.data(), storage);
+    BOOST_REQUIRE(vec2.get_allocator() == allocator_type(manager1));
+    BOOST_REQUIRE_EQUAL(manager2.used(), static_cast<size_t>(0));
+    BOOST_REQUIRE_EQUAL(vec2[0], 1);
+    BOOST_REQUIRE_EQUAL(vec2[1], 2);
+}
+
+BOOST_AUTO_TEST_CASE( stl_vector_swap_exchanges_allocators,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef int data_type;
+    typedef lazy::memory::buffer_allocator<data_type> allocator_type;
+
+    const size_t num_objects = 4;
+    data_type buffer1[num_objects];
+    lazy::memory::buffer_manager manager1(buffer1, sizeof(buffer1));
+    data_type buffer2[num_objects];
+    lazy::memory::buffer_manager manager2(buffer2, sizeof(buffer2));
+
+    std::vector<data_type, allocator_type> vec1((allocator_type(manager1)));
+    std::vector<data_type, allocator_type> vec2((allocator_type(manager2)));
+    vec1.push_back(1);
+    vec2.push_back(2);
+    const data_type* storage1 = vec1.data();
+    const data_type* storage2 = vec2.data();
+
+    vec1.swap(vec2);
+    BOOST_REQUIRE_EQUAL(vec1.data(), storage2);
+    BOOST_REQUIRE_EQUAL(vec2.data(), storage1);
+    BOOST_REQUIRE(vec1.get_allocator() == allocator_type(manager2));
+    BOOST_REQUIRE(vec2.get_allocator() == allocator_type(manager1));
+    BOOST_REQUIRE_EQUAL(vec1[0], 2);
+    BOOST_REQUIRE_EQUAL(vec2[0], 1);
+}
+
 BOOST_AUTO_TEST_CASE( stl_string )
 {
     typedef char data_type;
@@ -98,7 +203,8 @@ BOOST_AUTO_TEST_CASE( stl_string )
     // a significantly smaller amount and hope that it is enough.
     const size_t buffer_size = 32 * 1024;
     data_type buffer[buffer_size];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     string_type str(allocator);
     BOOST_REQUIRE_EQUAL(str.length(), 0);
     BOOST_REQUIRE_NO_THROW(str.reserve(512));
@@ -107,6 +213,26 @@ BOOST_AUTO_TEST_CASE( stl_string )
     BOOST_REQUIRE_EQUAL(str, "hello, world!");
 }
 
+BOOST_AUTO_TEST_CASE( stl_string_scratch_is_reclaimed )
+{
+    typedef char data_type;
+    typedef lazy::memory::buffer_allocator<data_type> allocator_type;
+    typedef std::basic_string<data_type, std::char_traits<data_type>, allocator_type> string_type;
+
+    // every temporary string gives its memory back when it dies, so a buffer with room
+    // for one of them is enough for any number of them.
+    const size_t buffer_size = 1024;
+    data_type buffer[buffer_size];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    for (int i = 0; i < 1000; ++i) {
+        string_type str(allocator);
+        BOOST_REQUIRE_NO_THROW(str.assign(400, 'x'));
+        BOOST_REQUIRE_EQUAL(str.length(), 400);
+    }
+    BOOST_REQUIRE_EQUAL(allocator.get_buffer_manager().available(), buffer_size);
+}
+
 BOOST_AUTO_TEST_CASE( stl_string_copy )
 {
     typedef char data_type;
@@ -116,8 +242,10 @@ BOOST_AUTO_TEST_CASE( stl_string_copy )
     const size_t buffer_size = 32 * 1024;
     data_type buffer1[buffer_size];
     data_type buffer2[buffer_size];
-    allocator_type allocator1(buffer1, sizeof(buffer1));
-    allocator_type allocator2(buffer2, sizeof(buffer2));
+    lazy::memory::buffer_manager manager1(buffer1, sizeof(buffer1));
+    allocator_type allocator1(manager1);
+    lazy::memory::buffer_manager manager2(buffer2, sizeof(buffer2));
+    allocator_type allocator2(manager2);
     string_type str1(allocator1);
     string_type str2(allocator2);
 
@@ -131,6 +259,7 @@ BOOST_AUTO_TEST_CASE( stl_string_copy )
     // basic_string used to be reference-counted and copies on
     // write, but it seem like the behavior changed.
     str1.clear();
+    lazy::memory::detail::unpoison(buffer1, sizeof(buffer1));
     memset(buffer1, 0, sizeof(buffer1));
     BOOST_REQUIRE(str1.empty());
     BOOST_REQUIRE_EQUAL(str1.length(), 0);
@@ -149,6 +278,7 @@ BOOST_AUTO_TEST_CASE( stl_string_copy )
     BOOST_REQUIRE_EQUAL(str1, "The quick brown fox jumps over the lazy dog");
     BOOST_REQUIRE_EQUAL(str2, "The quick brown fox jumps over the lazy dog!!!");
     str1.clear();
+    lazy::memory::detail::unpoison(buffer1, sizeof(buffer1));
     memset(buffer1, 0, sizeof(buffer1));
     BOOST_REQUIRE(str1.empty());
     BOOST_REQUIRE_EQUAL(str2, "The quick brown fox jumps over the lazy dog!!!");
@@ -162,7 +292,8 @@ BOOST_AUTO_TEST_CASE( stl_list )
 
     const size_t buffer_size = 32 * 1024;
     data_type buffer[buffer_size];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     list_type l(allocator);
     BOOST_REQUIRE_NO_THROW(l.push_back(1));
     BOOST_REQUIRE_NO_THROW(l.push_front(2));
@@ -171,6 +302,22 @@ BOOST_AUTO_TEST_CASE( stl_list )
     BOOST_REQUIRE_THROW(l.resize(buffer_size, 0), std::bad_alloc);
 }
 
+BOOST_AUTO_TEST_CASE( stl_list_grows_to_heap )
+{
+    typedef int data_type;
+    typedef lazy::memory::buffer_allocator<data_type> allocator_type;
+    typedef std::list<data_type, allocator_type> list_type;
+
+    const size_t buffer_size = 16;
+    data_type buffer[buffer_size];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer), lazy::memory::growth_policy::heap());
+    allocator_type allocator(manager);
+    list_type l(allocator);
+    BOOST_REQUIRE_NO_THROW(l.resize(buffer_size * 100, 7));
+    BOOST_REQUIRE_EQUAL(l.size(), buffer_size * 100);
+    BOOST_REQUIRE_EQUAL(l.back(), 7);
+}
+
 BOOST_AUTO_TEST_CASE( stl_slist )
 {
     typedef int data_type;
@@ -179,7 +326,8 @@ BOOST_AUTO_TEST_CASE( stl_slist )
 
     const size_t buffer_size = 32 * 1024;
     data_type buffer[buffer_size];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     list_type l(allocator);
     BOOST_REQUIRE_NO_THROW(l.push_front(1));
     BOOST_REQUIRE_NO_THROW(l.push_front(2));
@@ -195,7 +343,8 @@ BOOST_AUTO_TEST_CASE( stl_deque )
 
     const size_t buffer_size = 32 * 1024;
     data_type buffer[buffer_size];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     deque_type d(allocator);
     BOOST_REQUIRE_NO_THROW(d.push_front(0));
     BOOST_REQUIRE_NO_THROW(d.push_back(1));
@@ -213,7 +362,8 @@ BOOST_AUTO_TEST_CASE( stl_queue )
 
     const size_t buffer_size = 32 * 1024;
     data_type buffer[buffer_size];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     deque_type d(allocator);
     queue_type q(d);
     BOOST_REQUIRE_NO_THROW(q.push(1));
@@ -238,13 +388,51 @@ BOOST_AUTO_TEST_CASE( stl_map )
     // of std::map yet.
     const size_t buffer_size = 128 * 1024;
     char buffer[buffer_size];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     std::less<key_type> cmp;
     map_type m(cmp, allocator);
     map_type::value_type value(1, 1);
     BOOST_REQUIRE_NO_THROW(m.insert(value));
 }
 
+BOOST_AUTO_TEST_CASE( stl_map_scratch_phases )
+{
+    typedef int key_type;
+    typedef int data_type;
+    typedef std::pair<const key_type, data_type> value_type;
+    typedef lazy::memory::buffer_allocator<value_type> allocator_type;
+    typedef std::map<key_type, data_type, std::less<key_type>, allocator_type> map_type;
+    typedef lazy::memory::buffer_allocator<data_type> list_allocator_type;
+    typedef std::list<data_type, list_allocator_type> list_type;
+
+    const size_t buffer_size = 16 * 1024;
+    char buffer[buffer_size];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    std::less<key_type> cmp;
+    // handling each request fills most of the buffer, so it only works if every request
+    // releases its scratch space.
+    for (int request = 0; request < 100; ++request) {
+        lazy::memory::scoped_rewind request_scope(manager);
+        map_type m(cmp, allocator);
+        for (int i = 0; i < 100; ++i) {
+            BOOST_REQUIRE_NO_THROW(m.insert(value_type(i, request)));
+        }
+        {
+            lazy::memory::scoped_rewind phase_scope(manager);
+            list_allocator_type list_allocator(allocator);
+            list_type l(list_allocator);
+            for (map_type::const_iterator it = m.begin(); it != m.end(); ++it) {
+                BOOST_REQUIRE_NO_THROW(l.push_back(it->second));
+            }
+            BOOST_REQUIRE_EQUAL(l.size(), m.size());
+        }
+        BOOST_REQUIRE_EQUAL(m[99], request);
+    }
+    BOOST_REQUIRE_EQUAL(manager.available(), buffer_size);
+}
+
 BOOST_AUTO_TEST_CASE( tr1_unordered_map )
 {
     typedef int key_type;
@@ -257,7 +445,8 @@ BOOST_AUTO_TEST_CASE( tr1_unordered_map )
     // You know it.
     const size_t buffer_size = 128 * 1024;
     char buffer[buffer_size];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     std::hash<key_type> hasher;
     std::equal_to<key_type> cmp;
     map_type m(10, hasher, cmp, allocator);
@@ -277,7 +466,8 @@ BOOST_AUTO_TEST_CASE( stl_unordered_multimap )
     // You know it.
     const size_t buffer_size = 128 * 1024;
     char buffer[buffer_size];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     std::hash<key_type> hasher;
     std::equal_to<key_type> cmp;
     map_type m(10, hasher, cmp, allocator);
@@ -296,7 +486,8 @@ BOOST_AUTO_TEST_CASE( tr1_unordered_set )
     // You know it.
     const size_t buffer_size = 128 * 1024;
     char buffer[buffer_size];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     std::hash<key_type> hasher;
     std::equal_to<key_type> cmp;
     set_type m(10, hasher, cmp, allocator);
@@ -314,7 +505,8 @@ BOOST_AUTO_TEST_CASE( stl_unordered_multiset )
     // You know it.
     const size_t buffer_size = 128 * 1024;
     char buffer[buffer_size];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     std::hash<key_type> hasher;
     std::equal_to<key_type> cmp;
     set_type m(10, hasher, cmp, allocator);
@@ -323,4 +515,86 @@ BOOST_AUTO_TEST_CASE( stl_unordered_multiset )
     BOOST_REQUIRE_NO_THROW(m.insert(key));
 }
 
+BOOST_AUTO_TEST_CASE( stl_list_rebind_aligned )
+{
+    typedef lazy::memory::buffer_allocator<char> char_allocator_type;
+    typedef lazy::memory::buffer_allocator<vec4> allocator_type;
+    typedef std::list<vec4, allocator_type> list_type;
+
+    const size_t buffer_size = 32 * 1024;
+    char buffer[buffer_size];
+    lazy::memory::buffer_manager char_manager(buffer, sizeof(buffer));
+    char_allocator_type char_allocator(char_manager);
+    // knock the cursor off any sensible boundary before the list gets its nodes
+    BOOST_REQUIRE_NO_THROW(char_allocator.allocate(1));
+
+    allocator_type allocator(char_allocator);
+    list_type l(allocator);
+    for (int i = 0; i < 16; ++i) {
+        vec4 v = { { double(i), 0, 0, 0 } };
+        BOOST_REQUIRE_NO_THROW(l.push_back(v));
+        BOOST_REQUIRE_NO_THROW(char_allocator.allocate(3));
+    }
+    int i = 0;
+    for (list_type::const_iterator it = l.begin(); it != l.end(); ++it, ++i) {
+        BOOST_REQUIRE(is_aligned(&*it, alignof(vec4)));
+        BOOST_REQUIRE_EQUAL(it->v[0], double(i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( stl_map_rebind_mixed_types )
+{
+    typedef char key_type;
+    typedef double data_type;
+    typedef std::pair<const key_type, data_type> value_type;
+    typedef lazy::memory::buffer_allocator<value_type> allocator_type;
+    typedef std::map<key_type, data_type, std::less<key_type>, allocator_type> map_type;
+    typedef lazy::memory::buffer_allocator<char> char_allocator_type;
+    typedef std::basic_string<char, std::char_traits<char>, char_allocator_type> string_type;
+
+    const size_t buffer_size = 128 * 1024;
+    char buffer[buffer_size];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    std::less<key_type> cmp;
+    map_type m(cmp, allocator);
+    // strings and map nodes interleave in the same buffer
+    char_allocator_type char_allocator(allocator);
+    string_type str(char_allocator);
+    for (char c = 'a'; c <= 'z'; ++c) {
+        BOOST_REQUIRE_NO_THROW(m.insert(value_type(c, c)));
+        BOOST_REQUIRE_NO_THROW(str.push_back(c));
+    }
+    for (map_type::const_iterator it = m.begin(); it != m.end(); ++it) {
+        BOOST_REQUIRE(is_aligned(&*it, alignof(value_type)));
+        BOOST_REQUIRE(is_aligned(&it->second, alignof(data_type)));
+        BOOST_REQUIRE_EQUAL(it->second, double(it->first));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( stl_map_cache_line_aligned )
+{
+    typedef int key_type;
+    typedef int data_type;
+    typedef std::pair<const key_type, data_type> value_type;
+    typedef lazy::memory::buffer_allocator<value_type> allocator_type;
+    typedef std::map<key_type, data_type, std::less<key_type>, allocator_type> map_type;
+
+    const size_t buffer_size = 128 * 1024;
+    char buffer[buffer_size];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer), 64);
+    allocator_type allocator(manager);
+    std::less<key_type> cmp;
+    map_type m(cmp, allocator);
+    for (int i = 0; i < 64; ++i) {
+        BOOST_REQUIRE_NO_THROW(m.insert(value_type(i, i)));
+    }
+    for (map_type::const_iterator it = m.begin(); it != m.end(); ++it) {
+        // the value sits at a fixed offset into the node, so the nodes themselves
+        // being cache-line aligned means every value lands on the same offset.
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(&*it) % 64,
+            reinterpret_cast<uintptr_t>(&*m.begin()) % 64);
+    }
+}
+
 // EOF
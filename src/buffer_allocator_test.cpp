@@ -3,15 +3,51 @@
 #define BOOST_TEST_MAIN
 #define BOOST_TEST_MODULE BufferAllocatorTest
 #include <boost/test/unit_test.hpp>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
-BOOST_AUTO_TEST_CASE( max_size_test )
+namespace {
+
+// counts how an element got into its container
+struct counted
+{
+    static int copies;
+    static int moves;
+    static int destroyed;
+
+    counted(int a, int b) : value(a + b) {}
+    counted(const counted& other) : value(other.value) { ++copies; }
+    counted(counted&& other) : value(other.value) { ++moves; }
+    ~counted() { ++destroyed; }
+
+    static void reset() { copies = moves = destroyed = 0; }
+
+    int value;
+};
+
+int counted::copies = 0;
+int counted::moves = 0;
+int counted::destroyed = 0;
+
+// the tests that fill a buffer sized for exactly so many objects need chunks to be packed
+// without a red zone between them
+const bool exact_layout = lazy::memory::detail::red_zone == 0;
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( max_size_test,
+    *boost::unit_test::enable_if<exact_layout>() )
 {
     typedef int data_type;
     typedef lazy::memory::buffer_allocator<data_type> allocator_type;
 
     const size_t num_objects = 2;
     data_type buffer[num_objects];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
     BOOST_REQUIRE_EQUAL(allocator.max_size(), num_objects);
     data_type* a = 0;
     BOOST_REQUIRE_NO_THROW(a = allocator.allocate(1));
@@ -23,14 +59,16 @@ BOOST_AUTO_TEST_CASE( max_size_test )
     BOOST_REQUIRE_THROW(allocator.allocate(1), std::bad_alloc);
 }
 
-BOOST_AUTO_TEST_CASE( address )
+BOOST_AUTO_TEST_CASE( address,
+    *boost::unit_test::enable_if<exact_layout>() )
 {
     typedef int data_type;
     typedef lazy::memory::buffer_allocator<data_type> allocator_type;
 
     const size_t num_objects = 2;
     data_type buffer[num_objects];
-    allocator_type allocator(buffer, sizeof(buffer));
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
 
     BOOST_REQUIRE_EQUAL(allocator.max_size(), num_objects);
     data_type* a = 0;
@@ -52,9 +90,187 @@ BOOST_AUTO_TEST_CASE( buffer_size_is_honored )
     const size_t buffer_size = 0;
     const size_t num_objects = 2;
     data_type buffer[num_objects];
-    allocator_type allocator(buffer, buffer_size);
+    lazy::memory::buffer_manager manager(buffer, buffer_size);
+    allocator_type allocator(manager);
     BOOST_REQUIRE_EQUAL(allocator.max_size(), static_cast<size_t>(0));
     BOOST_REQUIRE_THROW(allocator.allocate(1), std::bad_alloc);
 }
 
+BOOST_AUTO_TEST_CASE( allocate_checks_for_overflow )
+{
+    typedef int data_type;
+    typedef lazy::memory::buffer_allocator<data_type> allocator_type;
+
+    data_type buffer[4];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer),
+        lazy::memory::growth_policy::heap());
+    allocator_type allocator(manager);
+    // the size in bytes of this many ints wraps around to 0
+    const size_t n = static_cast<size_t>(-1) / sizeof(data_type) + 1;
+    BOOST_REQUIRE_EQUAL(n * sizeof(data_type), static_cast<size_t>(0));
+    BOOST_REQUIRE_THROW(allocator.allocate(n), std::bad_alloc);
+    BOOST_REQUIRE_EQUAL(manager.used(), static_cast<size_t>(0));
+}
+
+BOOST_AUTO_TEST_CASE( deallocate_last_allocation,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef int data_type;
+    typedef lazy::memory::buffer_allocator<data_type> allocator_type;
+
+    const size_t num_objects = 4;
+    data_type buffer[num_objects];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    for (int i = 0; i < 100; ++i) {
+        data_type* a = 0;
+        BOOST_REQUIRE_NO_THROW(a = allocator.allocate(num_objects));
+        allocator.deallocate(a, num_objects);
+    }
+    BOOST_REQUIRE_EQUAL(allocator.get_buffer_manager().available(), sizeof(buffer));
+}
+
+BOOST_AUTO_TEST_CASE( try_expand,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef int data_type;
+    typedef lazy::memory::buffer_allocator<data_type> allocator_type;
+
+    const size_t num_objects = 4;
+    data_type buffer[num_objects];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    data_type* a = allocator.allocate(1);
+    BOOST_REQUIRE(allocator.try_expand(a, 1, num_objects));
+    BOOST_REQUIRE(!allocator.try_expand(a, num_objects, num_objects + 1));
+    BOOST_REQUIRE_THROW(allocator.allocate(1), std::bad_alloc);
+}
+
+BOOST_AUTO_TEST_CASE( allocator_is_one_pointer )
+{
+    typedef lazy::memory::buffer_allocator<int> allocator_type;
+    BOOST_REQUIRE_EQUAL(sizeof(allocator_type), sizeof(void*));
+}
+
+BOOST_AUTO_TEST_CASE( equality_follows_manager )
+{
+    typedef lazy::memory::buffer_allocator<int> allocator_type;
+    typedef lazy::memory::buffer_allocator<double> other_allocator_type;
+
+    char a_buffer[64];
+    char b_buffer[64];
+    lazy::memory::buffer_manager a_manager(a_buffer, sizeof(a_buffer));
+    lazy::memory::buffer_manager b_manager(b_buffer, sizeof(b_buffer));
+
+    allocator_type a(a_manager);
+    allocator_type a_copy(a);
+    other_allocator_type a_rebound(a);
+    allocator_type b(b_manager);
+
+    BOOST_REQUIRE(a == a_copy);
+    BOOST_REQUIRE(a == a_rebound);
+    BOOST_REQUIRE(a != b);
+    BOOST_REQUIRE(!(a_rebound == b));
+    BOOST_REQUIRE_EQUAL(&a_rebound.get_buffer_manager(), &a_manager);
+}
+
+BOOST_AUTO_TEST_CASE( allocator_traits )
+{
+    typedef lazy::memory::buffer_allocator<int> allocator_type;
+    typedef std::allocator_traits<allocator_type> traits_type;
+
+    BOOST_REQUIRE(!traits_type::is_always_equal::value);
+    BOOST_REQUIRE((std::is_same<traits_type::size_type, allocator_type::size_type>::value));
+    BOOST_REQUIRE(std::is_nothrow_copy_constructible<allocator_type>::value);
+    BOOST_REQUIRE(std::is_nothrow_move_constructible<allocator_type>::value);
+    BOOST_REQUIRE(noexcept(std::declval<allocator_type&>().max_size()));
+    BOOST_REQUIRE(noexcept(std::declval<allocator_type&>().destroy(static_cast<int*>(0))));
+    BOOST_REQUIRE(noexcept(std::declval<allocator_type&>() == std::declval<allocator_type&>()));
+}
+
+BOOST_AUTO_TEST_CASE( emplace_back_does_not_copy )
+{
+    typedef lazy::memory::buffer_allocator<counted> allocator_type;
+
+    char buffer[1024];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    {
+        std::vector<counted, allocator_type> vec(allocator);
+        vec.reserve(4);
+        counted::reset();
+        vec.emplace_back(1, 2);
+        vec.push_back(counted(3, 4));
+        BOOST_REQUIRE_EQUAL(counted::copies, 0);
+        BOOST_REQUIRE_EQUAL(counted::moves, 1);
+        BOOST_REQUIRE_EQUAL(vec[0].value, 3);
+        BOOST_REQUIRE_EQUAL(vec[1].value, 7);
+        counted::reset();
+    }
+    BOOST_REQUIRE_EQUAL(counted::destroyed, 2);
+}
+
+BOOST_AUTO_TEST_CASE( map_emplace_forwards_through_rebind )
+{
+    typedef std::pair<const int, std::string> value_type;
+    typedef lazy::memory::buffer_allocator<value_type> allocator_type;
+    typedef std::map<int, std::string, std::less<int>, allocator_type> map_type;
+
+    char buffer[4096];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    map_type m((std::less<int>()), allocator);
+    const std::string long_string(64, 'x');
+    std::string moved = long_string;
+    const char* data = moved.data();
+    m.emplace(1, std::move(moved));
+    m.emplace(std::piecewise_construct, std::forward_as_tuple(2), std::forward_as_tuple(3, 'y'));
+    BOOST_REQUIRE_EQUAL(m[1], long_string);
+    BOOST_REQUIRE_EQUAL(m[1].data(), data);
+    BOOST_REQUIRE_EQUAL(m[2], "yyy");
+}
+
+BOOST_AUTO_TEST_CASE( destroy_runs_dtors_unless_trivial )
+{
+    typedef lazy::memory::buffer_allocator<counted> allocator_type;
+
+    char buffer[1024];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    counted* p = allocator.allocate(3);
+    for (int i = 0; i < 3; ++i) {
+        allocator.construct(p + i, i, i);
+    }
+    counted::reset();
+    allocator.destroy(p, 3);
+    BOOST_REQUIRE_EQUAL(counted::destroyed, 3);
+    allocator.deallocate(p, 3);
+
+    lazy::memory::buffer_allocator<int> int_allocator(allocator);
+    int* q = int_allocator.allocate(3);
+    int_allocator.construct(q, 42);
+    BOOST_REQUIRE_EQUAL(*q, 42);
+    int_allocator.destroy(q, 3);
+    int_allocator.deallocate(q, 3);
+    BOOST_REQUIRE_EQUAL(manager.used(), static_cast<size_t>(0));
+}
+
+BOOST_AUTO_TEST_CASE( try_allocate_returns_null,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef int data_type;
+    typedef lazy::memory::buffer_allocator<data_type> allocator_type;
+
+    const size_t num_objects = 4;
+    data_type buffer[num_objects];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    data_type* a = allocator.try_allocate(num_objects);
+    BOOST_REQUIRE_EQUAL(a, buffer);
+    BOOST_REQUIRE(!allocator.try_allocate(1));
+    BOOST_REQUIRE(!allocator.try_allocate(static_cast<size_t>(-1) / 2));
+    allocator.deallocate(a, num_objects);
+    BOOST_REQUIRE_EQUAL(manager.used(), static_cast<size_t>(0));
+}
+
 // EOF
@@ -0,0 +1,595 @@
+#include "lazy/memory/buffer_manager.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE BufferManagerTest
+#include <boost/test/unit_test.hpp>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <stdint.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// the red zone buffer_manager leaves in front of every chunk
+const size_t red_zone = lazy::memory::detail::red_zone;
+
+// the tests that check exactly where padding puts chunks only hold without a red zone
+const bool exact_layout = red_zone == 0;
+
+bool is_aligned(const void* p, size_t alignment)
+{
+    return (reinterpret_cast<uintptr_t>(p) % alignment) == 0;
+}
+
+// upstream that remembers what it handed out
+struct counting_upstream
+{
+    counting_upstream() : blocks(0), last_size(0) {}
+
+    static void* allocate(size_t n, void* context)
+    {
+        counting_upstream* self = static_cast<counting_upstream*>(context);
+        ++self->blocks;
+        self->last_size = n;
+        return std::malloc(n);
+    }
+
+    static void deallocate(void* p, size_t, void* context)
+    {
+        counting_upstream* self = static_cast<counting_upstream*>(context);
+        --self->blocks;
+        std::free(p);
+    }
+
+    lazy::memory::growth_policy policy(size_t initial_block_size)
+    {
+        lazy::memory::growth_policy growth;
+        growth.allocate = &counting_upstream::allocate;
+        growth.deallocate = &counting_upstream::deallocate;
+        growth.context = this;
+        growth.initial_block_size = initial_block_size;
+        return growth;
+    }
+
+    int blocks;
+    size_t last_size;
+};
+
+// overflow handler that remembers what it handed out
+struct counting_overflow
+{
+    counting_overflow() : blocks(0), last_request(0) {}
+
+    static void* allocate(size_t n, size_t request, const lazy::memory::buffer_manager&,
+        void* context)
+    {
+        counting_overflow* self = static_cast<counting_overflow*>(context);
+        ++self->blocks;
+        self->last_request = request;
+        return std::malloc(n);
+    }
+
+    static void deallocate(void* p, size_t, void* context)
+    {
+        counting_overflow* self = static_cast<counting_overflow*>(context);
+        --self->blocks;
+        std::free(p);
+    }
+
+    lazy::memory::overflow_handler handler()
+    {
+        lazy::memory::overflow_handler overflow;
+        overflow.allocate = &counting_overflow::allocate;
+        overflow.deallocate = &counting_overflow::deallocate;
+        overflow.context = this;
+        return overflow;
+    }
+
+    int blocks;
+    size_t last_request;
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( allocate_pads_to_alignment )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    const size_t buffer_size = 256;
+    char buffer[buffer_size];
+    manager_type manager(buffer, sizeof(buffer));
+    BOOST_REQUIRE_EQUAL(manager.alignment(), 1);
+
+    void* a = 0;
+    BOOST_REQUIRE_NO_THROW(a = manager.allocate(1, 1));
+    BOOST_REQUIRE(a);
+    void* b = 0;
+    BOOST_REQUIRE_NO_THROW(b = manager.allocate(sizeof(double), alignof(double)));
+    BOOST_REQUIRE(is_aligned(b, alignof(double)));
+    void* c = 0;
+    BOOST_REQUIRE_NO_THROW(c = manager.allocate(32, 32));
+    BOOST_REQUIRE(is_aligned(c, 32));
+    BOOST_REQUIRE(static_cast<char*>(b) > static_cast<char*>(a));
+    BOOST_REQUIRE(static_cast<char*>(c) >= static_cast<char*>(b) + sizeof(double));
+}
+
+BOOST_AUTO_TEST_CASE( minimum_alignment_is_honored )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    const size_t buffer_size = 1024;
+    char buffer[buffer_size];
+    manager_type manager(buffer, sizeof(buffer), 64);
+    BOOST_REQUIRE_EQUAL(manager.alignment(), 64);
+    for (int i = 0; i < 4; ++i) {
+        void* p = 0;
+        BOOST_REQUIRE_NO_THROW(p = manager.allocate(1));
+        BOOST_REQUIRE(is_aligned(p, 64));
+        BOOST_REQUIRE_NO_THROW(p = manager.allocate(3, 2));
+        BOOST_REQUIRE(is_aligned(p, 64));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( padding_counts_against_buffer,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    // an aligned buffer so we know exactly how much padding is needed
+    alignas(16) char buffer[16];
+    manager_type manager(buffer, sizeof(buffer));
+    BOOST_REQUIRE_NO_THROW(manager.allocate(1, 1));
+    BOOST_REQUIRE_EQUAL(manager.available(), 15);
+    // 7 bytes of padding and 8 bytes of payload fit exactly
+    BOOST_REQUIRE_NO_THROW(manager.allocate(8, 8));
+    BOOST_REQUIRE_EQUAL(manager.available(), 0);
+    BOOST_REQUIRE_THROW(manager.allocate(1, 1), std::bad_alloc);
+
+    manager_type tight(buffer, sizeof(buffer));
+    BOOST_REQUIRE_NO_THROW(tight.allocate(1, 1));
+    // only 15 bytes remain, which are not enough for the padding plus the payload
+    BOOST_REQUIRE_THROW(tight.allocate(9, 8), std::bad_alloc);
+    BOOST_REQUIRE_EQUAL(tight.available(), 15);
+}
+
+BOOST_AUTO_TEST_CASE( fixed_buffer_does_not_grow )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    char buffer[16 + red_zone];
+    manager_type manager(buffer, sizeof(buffer));
+    BOOST_REQUIRE(!manager.growable());
+    BOOST_REQUIRE_EQUAL(manager.max_size(), sizeof(buffer));
+    BOOST_REQUIRE_NO_THROW(manager.allocate(16));
+    BOOST_REQUIRE_THROW(manager.allocate(1), std::bad_alloc);
+}
+
+BOOST_AUTO_TEST_CASE( grows_from_heap )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    char buffer[64];
+    manager_type manager(buffer, sizeof(buffer), lazy::memory::growth_policy::heap(128));
+    BOOST_REQUIRE(manager.growable());
+    BOOST_REQUIRE_EQUAL(manager.buffer_size(), sizeof(buffer));
+    for (int i = 0; i < 1000; ++i) {
+        char* p = 0;
+        BOOST_REQUIRE_NO_THROW(p = static_cast<char*>(manager.allocate(16, 8)));
+        BOOST_REQUIRE(is_aligned(p, 8));
+        std::memset(p, i, 16);
+    }
+    BOOST_REQUIRE(manager.buffer_size() >= 1000 * 16);
+}
+
+BOOST_AUTO_TEST_CASE( grown_block_fits_padding_and_chunk )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    // the block has to be sized for the chunk, since the first one is too small
+    char buffer[64];
+    manager_type manager(buffer, sizeof(buffer), lazy::memory::growth_policy::heap(16));
+    char* p = static_cast<char*>(manager.allocate(1000, 8));
+    BOOST_REQUIRE(is_aligned(p, 8));
+    std::memset(p, 1, 1000);
+    BOOST_REQUIRE(manager.available() < manager.buffer_size());
+    p = static_cast<char*>(manager.allocate(4000, 8));
+    std::memset(p, 2, 4000);
+    BOOST_REQUIRE(manager.used() <= manager.buffer_size());
+}
+
+BOOST_AUTO_TEST_CASE( grows_geometrically_and_returns_blocks )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    counting_upstream upstream;
+    {
+        char buffer[64 + red_zone];
+        manager_type manager(buffer, sizeof(buffer), upstream.policy(256));
+        BOOST_REQUIRE_NO_THROW(manager.allocate(64));
+        BOOST_REQUIRE_EQUAL(upstream.blocks, 0);
+
+        BOOST_REQUIRE_NO_THROW(manager.allocate(1));
+        BOOST_REQUIRE_EQUAL(upstream.blocks, 1);
+        BOOST_REQUIRE_EQUAL(upstream.last_size, 256);
+
+        BOOST_REQUIRE_NO_THROW(manager.allocate(manager.available() + 1));
+        BOOST_REQUIRE_EQUAL(upstream.blocks, 2);
+        BOOST_REQUIRE_EQUAL(upstream.last_size, 512);
+
+        // an oversized chunk gets a block big enough for it
+        BOOST_REQUIRE_NO_THROW(manager.allocate(4096, 64));
+        BOOST_REQUIRE_EQUAL(upstream.blocks, 3);
+        BOOST_REQUIRE(upstream.last_size >= 4096 + 64);
+    }
+    BOOST_REQUIRE_EQUAL(upstream.blocks, 0);
+}
+
+BOOST_AUTO_TEST_CASE( failed_upstream_throws )
+{
+    struct failing
+    {
+        static void* allocate(size_t, void*) { return 0; }
+        static void deallocate(void*, size_t, void*) {}
+    };
+    typedef lazy::memory::buffer_manager manager_type;
+
+    lazy::memory::growth_policy growth;
+    growth.allocate = &failing::allocate;
+    growth.deallocate = &failing::deallocate;
+    growth.context = 0;
+    growth.initial_block_size = 64;
+
+    manager_type manager(0, 0, growth);
+    BOOST_REQUIRE_THROW(manager.allocate(1), std::bad_alloc);
+}
+
+BOOST_AUTO_TEST_CASE( deallocate_reclaims_last_chunk )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    char buffer[64 + 2 * red_zone];
+    manager_type manager(buffer, sizeof(buffer));
+    void* a = manager.allocate(8);
+    void* b = manager.allocate(8);
+    BOOST_REQUIRE_EQUAL(manager.available(), 48);
+
+    // not the last chunk, so it stays allocated
+    manager.deallocate(a, 8);
+    BOOST_REQUIRE_EQUAL(manager.available(), 48);
+
+    // the red zone in front of the chunk comes back with it
+    manager.deallocate(b, 8);
+    BOOST_REQUIRE_EQUAL(manager.available(), 56 + red_zone);
+    void* c = manager.allocate(8);
+    BOOST_REQUIRE_EQUAL(b, c);
+}
+
+BOOST_AUTO_TEST_CASE( deallocate_ignores_chunks_in_previous_blocks )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    char buffer[8];
+    manager_type manager(buffer, sizeof(buffer), lazy::memory::growth_policy::heap(64));
+    void* a = manager.allocate(8);
+    BOOST_REQUIRE_NO_THROW(manager.allocate(8));
+    const size_t available = manager.available();
+    manager.deallocate(a, 8);
+    BOOST_REQUIRE_EQUAL(manager.available(), available);
+}
+
+BOOST_AUTO_TEST_CASE( try_expand_in_place )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    char buffer[64 + 2 * red_zone];
+    manager_type manager(buffer, sizeof(buffer));
+    void* a = manager.allocate(8);
+    void* b = manager.allocate(8);
+
+    BOOST_REQUIRE(!manager.try_expand(a, 8, 16));
+    BOOST_REQUIRE(manager.try_expand(b, 8, 32));
+    BOOST_REQUIRE_EQUAL(manager.available(), 24);
+    BOOST_REQUIRE(!manager.try_expand(b, 32, 57));
+    BOOST_REQUIRE_EQUAL(manager.available(), 24);
+    BOOST_REQUIRE(manager.try_expand(b, 32, 56));
+    BOOST_REQUIRE_EQUAL(manager.available(), 0);
+
+    // shrinking works the same way
+    BOOST_REQUIRE(manager.try_expand(b, 56, 4));
+    BOOST_REQUIRE_EQUAL(manager.available(), 52);
+}
+
+BOOST_AUTO_TEST_CASE( try_allocate_returns_null,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    alignas(64) char buffer[64];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    BOOST_REQUIRE_EQUAL(manager.try_allocate(48), buffer);
+    BOOST_REQUIRE(!manager.try_allocate(32));
+    BOOST_REQUIRE(!manager.try_allocate(8, 32));
+    // a failure leaves the cursor alone
+    BOOST_REQUIRE_EQUAL(manager.try_allocate(16), buffer + 48);
+    BOOST_REQUIRE_EQUAL(manager.available(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( try_allocate_grows_before_failing )
+{
+    counting_upstream upstream;
+    char buffer[64];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer), upstream.policy(128));
+    BOOST_REQUIRE(manager.try_allocate(100));
+    BOOST_REQUIRE_EQUAL(upstream.blocks, 1);
+    BOOST_REQUIRE(!manager.try_allocate(static_cast<size_t>(-1) - 8));
+}
+
+BOOST_AUTO_TEST_CASE( overflow_handler_takes_over,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    counting_overflow overflow;
+    char buffer[64];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer), 16);
+    manager.set_overflow_handler(overflow.handler());
+    BOOST_REQUIRE_NO_THROW(manager.allocate(64));
+
+    void* p = 0;
+    BOOST_REQUIRE_NO_THROW(p = manager.allocate(100, 64));
+    BOOST_REQUIRE(is_aligned(p, 64));
+    std::memset(p, 1, 100);
+    BOOST_REQUIRE_EQUAL(overflow.blocks, 1);
+    BOOST_REQUIRE_EQUAL(overflow.last_request, 100);
+    // the buffer itself doesn't get any bigger
+    BOOST_REQUIRE_EQUAL(manager.buffer_size(), 64);
+    BOOST_REQUIRE_EQUAL(manager.used(), 64);
+
+    const lazy::memory::buffer_manager::marker m = manager.mark();
+    void* q = manager.try_allocate(8);
+    BOOST_REQUIRE(is_aligned(q, 16));
+    BOOST_REQUIRE_EQUAL(overflow.blocks, 2);
+    manager.rewind(m);
+    BOOST_REQUIRE_EQUAL(overflow.blocks, 1);
+    manager.reset();
+    BOOST_REQUIRE_EQUAL(overflow.blocks, 0);
+    BOOST_REQUIRE_EQUAL(manager.allocate(8), buffer);
+}
+
+BOOST_AUTO_TEST_CASE( overflow_handler_is_released_with_the_manager )
+{
+    counting_overflow overflow;
+    {
+        char buffer[16];
+        lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+        manager.set_overflow_handler(overflow.handler());
+        manager.allocate(32);
+        manager.allocate(32);
+        BOOST_REQUIRE_EQUAL(overflow.blocks, 2);
+    }
+    BOOST_REQUIRE_EQUAL(overflow.blocks, 0);
+}
+
+BOOST_AUTO_TEST_CASE( overflow_handler_comes_after_growth )
+{
+    counting_upstream upstream;
+    counting_overflow overflow;
+    char buffer[16];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer), upstream.policy(64));
+    manager.set_overflow_handler(overflow.handler());
+    manager.allocate(32);
+    BOOST_REQUIRE_EQUAL(upstream.blocks, 1);
+    BOOST_REQUIRE_EQUAL(overflow.blocks, 0);
+}
+
+BOOST_AUTO_TEST_CASE( overflow_to_heap_logs )
+{
+    std::FILE* log = std::tmpfile();
+    BOOST_REQUIRE(log);
+    {
+        char buffer[16];
+        lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+        manager.set_overflow_handler(lazy::memory::overflow_handler::heap(log));
+        void* p = manager.allocate(1000);
+        std::memset(p, 1, 1000);
+    }
+    std::rewind(log);
+    char line[256] = { 0 };
+    BOOST_REQUIRE(std::fgets(line, sizeof(line), log));
+    BOOST_REQUIRE(std::strstr(line, "1000 bytes"));
+    std::fclose(log);
+}
+
+BOOST_AUTO_TEST_CASE( overflow_fails_by_default )
+{
+    char buffer[16];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    manager.set_overflow_handler(lazy::memory::overflow_handler::fail());
+    BOOST_REQUIRE_THROW(manager.allocate(32), std::bad_alloc);
+    BOOST_REQUIRE(!manager.try_allocate(32));
+}
+
+BOOST_AUTO_TEST_CASE( overflow_aborts )
+{
+    const pid_t child = fork();
+    BOOST_REQUIRE(child >= 0);
+    if (child == 0) {
+        // keep the diagnostic out of the test output, and Boost.Test from catching
+        // the signal
+        std::freopen("/dev/null", "w", stderr);
+        std::signal(SIGABRT, SIG_DFL);
+        char buffer[16];
+        lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+        manager.set_overflow_handler(lazy::memory::overflow_handler::abort());
+        manager.try_allocate(32);
+        _exit(0);
+    }
+    int status = 0;
+    BOOST_REQUIRE_EQUAL(waitpid(child, &status, 0), child);
+    BOOST_REQUIRE(WIFSIGNALED(status));
+    BOOST_REQUIRE_EQUAL(WTERMSIG(status), SIGABRT);
+}
+
+#if defined(LAZY_MEMORY_ASAN)
+BOOST_AUTO_TEST_CASE( free_space_is_poisoned )
+{
+    alignas(64) char buffer[256];
+    {
+        lazy::memory::buffer_manager manager(buffer, sizeof(buffer), 8);
+        BOOST_REQUIRE(__asan_address_is_poisoned(buffer));
+        char* a = static_cast<char*>(manager.allocate(16));
+        char* b = static_cast<char*>(manager.allocate(16));
+        BOOST_REQUIRE(!__asan_region_is_poisoned(a, 16));
+        BOOST_REQUIRE(!__asan_region_is_poisoned(b, 16));
+        BOOST_REQUIRE(__asan_address_is_poisoned(b + 16 + lazy::memory::detail::red_zone));
+
+        // chunks that can't be reclaimed are poisoned all the same
+        manager.deallocate(a, 16);
+        BOOST_REQUIRE(__asan_address_is_poisoned(a));
+        BOOST_REQUIRE(manager.try_expand(b, 16, 32));
+        BOOST_REQUIRE(!__asan_region_is_poisoned(b, 32));
+        BOOST_REQUIRE(manager.try_expand(b, 32, 8));
+        BOOST_REQUIRE(__asan_address_is_poisoned(b + 8));
+
+        const lazy::memory::buffer_manager::marker m = manager.mark();
+        char* c = static_cast<char*>(manager.allocate(16));
+        manager.rewind(m);
+        BOOST_REQUIRE(__asan_address_is_poisoned(c));
+        manager.reset();
+        BOOST_REQUIRE(__asan_address_is_poisoned(b));
+    }
+    // the buffer is handed back clean
+    BOOST_REQUIRE(!__asan_region_is_poisoned(buffer, sizeof(buffer)));
+}
+
+BOOST_AUTO_TEST_CASE( overrun_is_caught )
+{
+    const pid_t child = fork();
+    BOOST_REQUIRE(child >= 0);
+    if (child == 0) {
+        std::freopen("/dev/null", "w", stderr);
+        alignas(64) char buffer[256];
+        lazy::memory::buffer_manager manager(buffer, sizeof(buffer), 8);
+        char* a = static_cast<char*>(manager.allocate(16));
+        std::memset(a, 0, 24);
+        _exit(0);
+    }
+    int status = 0;
+    BOOST_REQUIRE_EQUAL(waitpid(child, &status, 0), child);
+    BOOST_REQUIRE(!WIFEXITED(status) || WEXITSTATUS(status) != 0);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE( allocate_batch_is_one_aligned_run )
+{
+    char buffer[1024];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    BOOST_REQUIRE_NO_THROW(manager.allocate(1, 1));
+    void* chunks[8];
+    manager.allocate_batch(chunks, 8, 12, 8);
+    BOOST_REQUIRE_EQUAL(manager.stride(12, 8), 16);
+    for (int i = 0; i < 8; ++i) {
+        BOOST_REQUIRE(is_aligned(chunks[i], 8));
+        BOOST_REQUIRE_EQUAL(static_cast<char*>(chunks[i]) - static_cast<char*>(chunks[0]), i * 16);
+    }
+    BOOST_REQUIRE_EQUAL(static_cast<void*>(static_cast<char*>(chunks[7]) + 16),
+        static_cast<void*>(buffer + manager.used()));
+}
+
+BOOST_AUTO_TEST_CASE( allocate_batch_that_does_not_fit_allocates_nothing,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    char buffer[64];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer), 8);
+    void* chunks[5];
+    BOOST_REQUIRE_THROW(manager.allocate_batch(chunks, 5, 16, 8), std::bad_alloc);
+    BOOST_REQUIRE_EQUAL(manager.used(), 0);
+    BOOST_REQUIRE_THROW(manager.allocate_run(static_cast<size_t>(-1) / 8, 16, 8), std::bad_alloc);
+    BOOST_REQUIRE_NO_THROW(manager.allocate_batch(chunks, 4, 16, 8));
+    BOOST_REQUIRE_EQUAL(manager.available(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( allocate_run_grows_once )
+{
+    counting_upstream upstream;
+    char buffer[64];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer), upstream.policy(64));
+    void* run = manager.allocate_run(100, 24, 8);
+    BOOST_REQUIRE(is_aligned(run, 8));
+    BOOST_REQUIRE_EQUAL(upstream.blocks, 1);
+    BOOST_REQUIRE_GE(upstream.last_size, 100 * 24);
+}
+
+BOOST_AUTO_TEST_CASE( mark_and_rewind,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    char buffer[64];
+    manager_type manager(buffer, sizeof(buffer));
+    BOOST_REQUIRE_NO_THROW(manager.allocate(8));
+    const manager_type::marker outer = manager.mark();
+    void* a = manager.allocate(8);
+    const manager_type::marker inner = manager.mark();
+    BOOST_REQUIRE_NO_THROW(manager.allocate(16));
+    BOOST_REQUIRE_EQUAL(manager.available(), 32);
+
+    manager.rewind(inner);
+    BOOST_REQUIRE_EQUAL(manager.available(), 48);
+    manager.rewind(outer);
+    BOOST_REQUIRE_EQUAL(manager.available(), 56);
+    BOOST_REQUIRE_EQUAL(manager.allocate(8), a);
+
+    manager.reset();
+    BOOST_REQUIRE_EQUAL(manager.available(), 64);
+    BOOST_REQUIRE_EQUAL(manager.allocate(1), static_cast<void*>(buffer));
+}
+
+BOOST_AUTO_TEST_CASE( rewind_returns_chained_blocks,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    counting_upstream upstream;
+    char buffer[64];
+    manager_type manager(buffer, sizeof(buffer), upstream.policy(128));
+    BOOST_REQUIRE_NO_THROW(manager.allocate(32));
+    const manager_type::marker m = manager.mark();
+    for (int i = 0; i < 100; ++i) {
+        BOOST_REQUIRE_NO_THROW(manager.allocate(32));
+    }
+    BOOST_REQUIRE(upstream.blocks > 1);
+    manager.rewind(m);
+    BOOST_REQUIRE_EQUAL(upstream.blocks, 0);
+    BOOST_REQUIRE_EQUAL(manager.buffer_size(), sizeof(buffer));
+    BOOST_REQUIRE_EQUAL(manager.available(), 32);
+
+    // growing again starts from the first block size
+    BOOST_REQUIRE_NO_THROW(manager.allocate(64));
+    BOOST_REQUIRE_EQUAL(upstream.blocks, 1);
+    BOOST_REQUIRE_EQUAL(upstream.last_size, 128);
+    manager.reset();
+    BOOST_REQUIRE_EQUAL(upstream.blocks, 0);
+    BOOST_REQUIRE_EQUAL(manager.available(), 64);
+}
+
+BOOST_AUTO_TEST_CASE( scoped_rewind_nests,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::buffer_manager manager_type;
+
+    char buffer[64];
+    manager_type manager(buffer, sizeof(buffer));
+    {
+        lazy::memory::scoped_rewind phase1(manager);
+        BOOST_REQUIRE_NO_THROW(manager.allocate(16));
+        {
+            lazy::memory::scoped_rewind phase2(manager);
+            BOOST_REQUIRE_NO_THROW(manager.allocate(32));
+            BOOST_REQUIRE_EQUAL(manager.available(), 16);
+        }
+        BOOST_REQUIRE_EQUAL(manager.available(), 48);
+    }
+    BOOST_REQUIRE_EQUAL(manager.available(), 64);
+}
+
+// EOF
@@ -0,0 +1,193 @@
+#include "lazy/memory/buffer_resource.h"
+#include "lazy/memory/pool_manager.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE BufferResourceTest
+#include <boost/test/unit_test.hpp>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace {
+
+// counts the bytes handed out by new_delete_resource()
+class counting_resource : public std::pmr::memory_resource
+{
+public:
+    counting_resource() : outstanding(0), blocks(0) {}
+
+    std::size_t outstanding;
+    std::size_t blocks;
+
+protected:
+    virtual void* do_allocate(std::size_t bytes, std::size_t alignment)
+    {
+        outstanding += bytes;
+        ++blocks;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    virtual void do_deallocate(void* p, std::size_t bytes, std::size_t alignment)
+    {
+        outstanding -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept
+    {
+        return this == &other;
+    }
+};
+
+// a buffer_manager that knows how many of it there are
+struct counted_manager : lazy::memory::buffer_manager
+{
+    static int instances;
+
+    counted_manager(void* buffer, size_type buffer_size,
+            const lazy::memory::growth_policy& growth, size_type alignment) :
+        lazy::memory::buffer_manager(buffer, buffer_size, growth, alignment)
+    {
+        ++instances;
+    }
+
+    ~counted_manager() { --instances; }
+};
+
+int counted_manager::instances = 0;
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( pmr_containers )
+{
+    char buffer[64 * 1024];
+    lazy::memory::buffer_resource<> resource(buffer, sizeof(buffer));
+    std::pmr::vector<int> v(&resource);
+    std::pmr::map<int, std::pmr::string> m(&resource);
+    for (int i = 0; i < 100; ++i) {
+        v.push_back(i);
+        m[i] = std::pmr::string(40, 'x');
+    }
+    BOOST_REQUIRE_EQUAL(v[99], 99);
+    BOOST_REQUIRE_EQUAL(m[99].size(), 40);
+    // the strings are allocated from the buffer too
+    const char* s = m[50].data();
+    BOOST_REQUIRE(s >= buffer && s < buffer + sizeof(buffer));
+}
+
+BOOST_AUTO_TEST_CASE( allocates_from_an_existing_manager )
+{
+    char buffer[1024];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    lazy::memory::buffer_resource<> resource(manager);
+    void* p = resource.allocate(64, 32);
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % 32, 0);
+    BOOST_REQUIRE_EQUAL(&resource.get_buffer_manager(), &manager);
+
+    // the last chunk is rolled back, along with the padding in front of it
+    resource.deallocate(p, 64, 32);
+    BOOST_REQUIRE_EQUAL(manager.available(), sizeof(buffer));
+    BOOST_REQUIRE_THROW(static_cast<void>(resource.allocate(2048)), std::bad_alloc);
+}
+
+BOOST_AUTO_TEST_CASE( only_owns_a_manager_when_it_makes_one )
+{
+    typedef lazy::memory::buffer_resource<counted_manager> resource_type;
+
+    char buffer[1024];
+    {
+        resource_type owning(buffer, sizeof(buffer));
+        BOOST_REQUIRE_EQUAL(counted_manager::instances, 1);
+        resource_type shared(owning.get_buffer_manager());
+        BOOST_REQUIRE_EQUAL(counted_manager::instances, 1);
+        BOOST_REQUIRE(shared == owning);
+        const char* p = static_cast<char*>(shared.allocate(16));
+        BOOST_REQUIRE(p >= buffer && p < buffer + sizeof(buffer));
+    }
+    BOOST_REQUIRE_EQUAL(counted_manager::instances, 0);
+}
+
+BOOST_AUTO_TEST_CASE( grows_from_upstream )
+{
+    counting_resource upstream;
+    {
+        char buffer[256];
+        lazy::memory::buffer_resource<> resource(buffer, sizeof(buffer), &upstream);
+        std::pmr::vector<int> v(&resource);
+        for (int i = 0; i < 1000; ++i) {
+            v.push_back(i);
+        }
+        BOOST_REQUIRE_EQUAL(v[999], 999);
+        BOOST_REQUIRE_GT(upstream.blocks, 0);
+        BOOST_REQUIRE_GT(upstream.outstanding, 0);
+    }
+    // every block goes back with the resource
+    BOOST_REQUIRE_EQUAL(upstream.outstanding, 0);
+}
+
+BOOST_AUTO_TEST_CASE( pool_manager_recycles_nodes )
+{
+    typedef lazy::memory::buffer_resource<lazy::memory::pool_manager> resource_type;
+
+    char buffer[4096];
+    resource_type resource(buffer, sizeof(buffer));
+    std::pmr::list<int> l(&resource);
+    // far more nodes than fit in the buffer, but never more than 10 at once
+    for (int i = 0; i < 10000; ++i) {
+        l.push_back(i);
+        if (l.size() > 10) {
+            l.pop_front();
+        }
+    }
+    BOOST_REQUIRE_EQUAL(l.back(), 9999);
+}
+
+BOOST_AUTO_TEST_CASE( pool_manager_honours_alignment )
+{
+    typedef lazy::memory::buffer_resource<lazy::memory::pool_manager> resource_type;
+
+    char buffer[4096];
+    resource_type resource(buffer, sizeof(buffer));
+    for (int i = 0; i < 10; ++i) {
+        void* p = resource.allocate(8, 8);
+        void* q = resource.allocate(40, 16);
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(q) % 16, 0);
+        resource.deallocate(p, 8, 8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( layers_under_a_pool_resource )
+{
+    char buffer[64 * 1024];
+    lazy::memory::buffer_resource<> arena(buffer, sizeof(buffer));
+    std::pmr::unsynchronized_pool_resource pool(&arena);
+    std::pmr::map<int, int> m(&pool);
+    for (int i = 0; i < 100; ++i) {
+        m[i] = i;
+    }
+    for (int i = 0; i < 100; i += 2) {
+        m.erase(i);
+    }
+    BOOST_REQUIRE_EQUAL(m.size(), 50);
+    BOOST_REQUIRE_LT(arena.get_buffer_manager().available(), sizeof(buffer));
+}
+
+BOOST_AUTO_TEST_CASE( equal_if_the_manager_is_the_same )
+{
+    char buffer[1024];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    lazy::memory::buffer_resource<> a(manager);
+    lazy::memory::buffer_resource<> b(manager);
+    lazy::memory::buffer_resource<> c(buffer, sizeof(buffer));
+    BOOST_REQUIRE(a.is_equal(b));
+    BOOST_REQUIRE(a == b);
+    BOOST_REQUIRE(!a.is_equal(c));
+    BOOST_REQUIRE(!a.is_equal(*std::pmr::new_delete_resource()));
+}
+
+// EOF
@@ -0,0 +1,194 @@
+#include "lazy/memory/buffer_allocator.h"
+#include "lazy/memory/concurrent_buffer_manager.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE ConcurrentBufferManagerTest
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const int num_threads = 8;
+
+bool is_aligned(const void* p, size_t alignment)
+{
+    return (reinterpret_cast<uintptr_t>(p) % alignment) == 0;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( allocate_and_exhaust )
+{
+    typedef lazy::memory::concurrent_buffer_manager manager_type;
+
+    alignas(64) char buffer[64];
+    manager_type manager(buffer, sizeof(buffer), 16);
+    void* a = manager.allocate(1);
+    BOOST_REQUIRE_EQUAL(a, static_cast<void*>(buffer));
+    void* b = manager.allocate(16);
+    BOOST_REQUIRE_EQUAL(b, static_cast<void*>(buffer + 16));
+    void* c = manager.allocate(8, 32);
+    BOOST_REQUIRE_EQUAL(c, static_cast<void*>(buffer + 32));
+    BOOST_REQUIRE_EQUAL(manager.available(), 16);
+    BOOST_REQUIRE_THROW(manager.allocate(17), std::bad_alloc);
+    BOOST_REQUIRE_EQUAL(manager.available(), 16);
+    void* d = manager.allocate(16);
+    BOOST_REQUIRE_EQUAL(d, static_cast<void*>(buffer + 48));
+    BOOST_REQUIRE_EQUAL(manager.available(), 0);
+    manager.reset();
+    BOOST_REQUIRE_EQUAL(manager.available(), 64);
+}
+
+BOOST_AUTO_TEST_CASE( failed_request_keeps_the_tail )
+{
+    typedef lazy::memory::concurrent_buffer_manager manager_type;
+
+    alignas(64) char buffer[256];
+    manager_type manager(buffer, sizeof(buffer), 16);
+    void* a = manager.allocate(144);
+    BOOST_REQUIRE_EQUAL(manager.try_allocate(200), static_cast<void*>(0));
+    BOOST_REQUIRE_EQUAL(manager.available(), 256 - 144);
+    void* b = manager.allocate(48);
+    BOOST_REQUIRE_EQUAL(b, static_cast<void*>(buffer + 144));
+    // the last chunk can still be given back
+    manager.deallocate(b, 48);
+    BOOST_REQUIRE_EQUAL(manager.available(), 256 - 144);
+    manager.deallocate(a, 144);
+    BOOST_REQUIRE_EQUAL(manager.available(), 256);
+}
+
+BOOST_AUTO_TEST_CASE( try_allocate_returns_null )
+{
+    typedef lazy::memory::concurrent_buffer_manager manager_type;
+
+    alignas(64) char buffer[64];
+    manager_type manager(buffer, sizeof(buffer), 16);
+    BOOST_REQUIRE_EQUAL(manager.try_allocate(48), static_cast<void*>(buffer));
+    BOOST_REQUIRE(!manager.try_allocate(8, 64));
+    BOOST_REQUIRE(!manager.try_allocate(32));
+    BOOST_REQUIRE(!manager.try_allocate(static_cast<size_t>(-1)));
+}
+
+BOOST_AUTO_TEST_CASE( oversized_request_leaves_the_cursor_alone )
+{
+    typedef lazy::memory::concurrent_buffer_manager manager_type;
+
+    alignas(64) char buffer[128];
+    manager_type manager(buffer, sizeof(buffer), 16);
+    void* a = manager.allocate(64);
+    // adding this to the cursor would wrap it around to the start of the buffer
+    BOOST_REQUIRE(!manager.try_allocate(static_cast<size_t>(-1) - 31));
+    void* b = manager.allocate(16);
+    BOOST_REQUIRE_EQUAL(b, static_cast<void*>(static_cast<char*>(a) + 64));
+    BOOST_REQUIRE_EQUAL(manager.available(), 48);
+}
+
+BOOST_AUTO_TEST_CASE( misaligned_buffer_is_trimmed )
+{
+    typedef lazy::memory::concurrent_buffer_manager manager_type;
+
+    alignas(64) char buffer[64];
+    manager_type manager(buffer + 1, sizeof(buffer) - 1, 16);
+    BOOST_REQUIRE_EQUAL(manager.buffer_size(), 48);
+    BOOST_REQUIRE_EQUAL(manager.allocate(1), static_cast<void*>(buffer + 16));
+}
+
+BOOST_AUTO_TEST_CASE( deallocate_and_expand_last_chunk )
+{
+    typedef lazy::memory::concurrent_buffer_manager manager_type;
+
+    alignas(64) char buffer[64];
+    manager_type manager(buffer, sizeof(buffer), 16);
+    void* a = manager.allocate(16);
+    void* b = manager.allocate(16);
+    manager.deallocate(a, 16);
+    BOOST_REQUIRE_EQUAL(manager.available(), 32);
+    BOOST_REQUIRE(!manager.try_expand(a, 16, 32));
+    BOOST_REQUIRE(manager.try_expand(b, 16, 48));
+    BOOST_REQUIRE_EQUAL(manager.available(), 0);
+    manager.deallocate(b, 48);
+    BOOST_REQUIRE_EQUAL(manager.available(), 48);
+}
+
+BOOST_AUTO_TEST_CASE( threads_get_disjoint_chunks )
+{
+    typedef lazy::memory::concurrent_buffer_manager manager_type;
+
+    const size_t chunks_per_thread = 10000;
+    std::vector<char> buffer(num_threads * chunks_per_thread * 128);
+    manager_type manager(&buffer[0], buffer.size());
+    std::vector<std::vector<std::pair<char*, size_t> > > chunks(num_threads);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.push_back(std::thread([&manager, &chunks, t, chunks_per_thread]() {
+            for (size_t i = 0; i < chunks_per_thread; ++i) {
+                // a mix of sizes and alignments, half of them off the fetch-add path
+                const size_t n = 1 + (i * 7 + t) % 48;
+                const size_t alignment = (i % 2) ? 64 : 8;
+                char* p = static_cast<char*>(manager.allocate(n, alignment));
+                std::memset(p, t, n);
+                chunks[t].push_back(std::make_pair(p, n));
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    std::vector<std::pair<char*, size_t> > all;
+    for (int t = 0; t < num_threads; ++t) {
+        for (size_t i = 0; i < chunks[t].size(); ++i) {
+            const std::pair<char*, size_t>& chunk = chunks[t][i];
+            BOOST_REQUIRE(is_aligned(chunk.first, (i % 2) ? 64 : 8));
+            BOOST_REQUIRE(std::count(chunk.first, chunk.first + chunk.second, char(t)) ==
+                static_cast<std::ptrdiff_t>(chunk.second));
+            all.push_back(chunk);
+        }
+    }
+    std::sort(all.begin(), all.end());
+    for (size_t i = 1; i < all.size(); ++i) {
+        BOOST_REQUIRE(all[i - 1].first + all[i - 1].second <= all[i].first);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( threads_share_buffer_allocator )
+{
+    typedef int data_type;
+    typedef lazy::memory::concurrent_buffer_manager manager_type;
+    typedef lazy::memory::buffer_allocator<data_type, manager_type> allocator_type;
+    typedef std::vector<data_type, allocator_type> vector_type;
+
+    std::vector<char> buffer(num_threads * 1024 * 1024);
+    manager_type manager(&buffer[0], buffer.size());
+    allocator_type allocator(manager);
+    std::vector<int> sums(num_threads);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.push_back(std::thread([&allocator, &sums, t]() {
+            vector_type vec(allocator);
+            for (int i = 0; i < 10000; ++i) {
+                vec.push_back(t);
+            }
+            int sum = 0;
+            for (size_t i = 0; i < vec.size(); ++i) {
+                sum += vec[i];
+            }
+            sums[t] = sum;
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    for (int t = 0; t < num_threads; ++t) {
+        BOOST_REQUIRE_EQUAL(sums[t], t * 10000);
+    }
+}
+
+// EOF
@@ -0,0 +1,234 @@
+#include "lazy/memory/buffer_allocator.h"
+#include "lazy/memory/epoch_ring.h"
+#include "lazy/memory/tlsf_manager.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE EpochRingTest
+#include <boost/test/unit_test.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+typedef lazy::memory::epoch_ring<3> ring_type;
+typedef lazy::memory::buffer_allocator<int> allocator_type;
+typedef std::vector<int, allocator_type> vector_type;
+
+// the red zone buffer_manager leaves in front of every chunk
+const std::size_t red_zone = lazy::memory::detail::red_zone;
+
+// hands batches from one stage of a pipeline to the next
+class batch_queue
+{
+public:
+    typedef std::pair<ring_type::epoch_type, const vector_type*> batch;
+
+    void push(const batch& b)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_batches.push_back(b);
+        m_ready.notify_one();
+    }
+
+    batch pop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_ready.wait(lock, [this] { return !m_batches.empty(); });
+        const batch b = m_batches.front();
+        m_batches.pop_front();
+        return b;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_ready;
+    std::deque<batch> m_batches;
+};
+
+// a buffer_manager that runs out of something once two of it are alive
+struct third_arena_throws : lazy::memory::buffer_manager
+{
+    static int live;
+
+    third_arena_throws(void* buffer, size_type buffer_size, size_type alignment) :
+        buffer_manager(buffer, buffer_size, alignment)
+    {
+        if (live == 2) {
+            throw std::bad_alloc();
+        }
+        ++live;
+    }
+
+    ~third_arena_throws()
+    {
+        --live;
+    }
+};
+
+int third_arena_throws::live = 0;
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( arenas_split_the_buffer )
+{
+    static_assert(ring_type::arena_count == 3, "the number of arenas is a constant");
+
+    alignas(64) char buffer[3 * 1024 + 2];
+    ring_type ring(buffer, sizeof(buffer));
+    BOOST_REQUIRE_EQUAL(ring.arena_size(), 1024);
+    BOOST_REQUIRE_EQUAL(ring.current(), 0);
+    for (int i = 0; i < 3; ++i) {
+        const ring_type::epoch_type epoch = ring.begin();
+        BOOST_REQUIRE_EQUAL(epoch, static_cast<ring_type::epoch_type>(i + 1));
+        BOOST_REQUIRE_EQUAL(ring.current(), epoch);
+        BOOST_REQUIRE_EQUAL(ring.arena(epoch).allocate(1), static_cast<void*>(buffer + i * 1024 + red_zone));
+        BOOST_REQUIRE_EQUAL(ring.arena(epoch).buffer_size(), 1024);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( arena_is_recycled_once_retired )
+{
+    alignas(64) char buffer[3 * 1024];
+    ring_type ring(buffer, sizeof(buffer));
+    const ring_type::epoch_type first = ring.begin(2);
+    ring.arena(first).allocate(512);
+    ring.begin();
+    ring.begin();
+
+    // the first arena is still in use by both consumers
+    ring_type::epoch_type epoch = 0;
+    BOOST_REQUIRE(!ring.try_begin(epoch));
+    BOOST_REQUIRE_THROW(ring.begin(), std::bad_alloc);
+    BOOST_REQUIRE_EQUAL(ring.current(), 3);
+    ring.retire(first);
+    BOOST_REQUIRE(!ring.retired(first));
+    BOOST_REQUIRE(!ring.try_begin(epoch));
+    ring.retire(first);
+    BOOST_REQUIRE(ring.retired(first));
+
+    // and is reset when the ring comes back around
+    BOOST_REQUIRE(ring.try_begin(epoch));
+    BOOST_REQUIRE_EQUAL(epoch, 4);
+    BOOST_REQUIRE_EQUAL(ring.arena(epoch).available(), 1024);
+    BOOST_REQUIRE_EQUAL(ring.arena(epoch).allocate(1), static_cast<void*>(buffer + red_zone));
+
+    // the next one was never retired
+    BOOST_REQUIRE(!ring.try_begin(epoch));
+}
+
+BOOST_AUTO_TEST_CASE( retain_adds_consumers )
+{
+    alignas(64) char buffer[1024];
+    lazy::memory::epoch_ring<1> ring(buffer, sizeof(buffer));
+    const ring_type::epoch_type epoch = ring.begin();
+    ring.retain(epoch, 2);
+    ring.retire(epoch);
+    ring.retire(epoch);
+    BOOST_REQUIRE(!ring.retired(epoch));
+    BOOST_REQUIRE_THROW(ring.begin(), std::bad_alloc);
+    ring.retire(epoch);
+    BOOST_REQUIRE(ring.retired(epoch));
+    BOOST_REQUIRE_EQUAL(ring.begin(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( arenas_grow_and_shrink_back )
+{
+    alignas(64) char buffer[2 * 256];
+    lazy::memory::epoch_ring<2> ring(buffer, sizeof(buffer),
+        lazy::memory::growth_policy::heap(1024));
+    const ring_type::epoch_type epoch = ring.begin();
+    ring.arena(epoch).allocate(512);
+    BOOST_REQUIRE(ring.arena(epoch).buffer_size() > 256);
+    ring.retire(epoch);
+    ring.retire(ring.begin());
+    BOOST_REQUIRE_EQUAL(ring.arena(ring.begin()).buffer_size(), 256);
+}
+
+BOOST_AUTO_TEST_CASE( failed_arena_destroys_the_others )
+{
+    typedef lazy::memory::epoch_ring<3, third_arena_throws> throwing_ring;
+
+    alignas(64) char buffer[3 * 1024];
+    BOOST_REQUIRE_THROW(throwing_ring(buffer, sizeof(buffer)), std::bad_alloc);
+    BOOST_REQUIRE_EQUAL(third_arena_throws::live, 0);
+}
+
+BOOST_AUTO_TEST_CASE( ring_of_tlsf_arenas )
+{
+    typedef lazy::memory::epoch_ring<2, lazy::memory::tlsf_manager> tlsf_ring;
+    typedef lazy::memory::buffer_allocator<int, lazy::memory::tlsf_manager> tlsf_allocator;
+
+    alignas(64) char buffer[2 * 4096];
+    tlsf_ring ring(buffer, sizeof(buffer));
+    const tlsf_ring::epoch_type epoch = ring.begin();
+    {
+        std::vector<int, tlsf_allocator> vec((tlsf_allocator(ring.arena(epoch))));
+        vec.assign(100, 1);
+    }
+    BOOST_REQUIRE_EQUAL(ring.arena(epoch).free_blocks(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( batches_outlive_the_stage_that_built_them )
+{
+    const int batches = 200;
+    const int batch_size = 100;
+
+    alignas(64) char buffer[3 * 1024];
+    ring_type ring(buffer, sizeof(buffer));
+    batch_queue to_first;
+    batch_queue to_second;
+    int first_sum = 0;
+    int second_sum = 0;
+
+    // the first consumer passes every batch on before retiring it, so both stages
+    // read it while the producer is busy with the ones after it.  the last stage
+    // destroys it, which leaves its memory to be released with the arena.
+    std::thread first([&] {
+        for (int i = 0; i < batches; ++i) {
+            const batch_queue::batch b = to_first.pop();
+            for (size_t j = 0; j < b.second->size(); ++j) {
+                first_sum += (*b.second)[j];
+            }
+            to_second.push(b);
+            ring.retire(b.first);
+        }
+    });
+    std::thread second([&] {
+        for (int i = 0; i < batches; ++i) {
+            const batch_queue::batch b = to_second.pop();
+            for (size_t j = 0; j < b.second->size(); ++j) {
+                second_sum += (*b.second)[j];
+            }
+            b.second->~vector_type();
+            ring.retire(b.first);
+        }
+    });
+
+    int expected = 0;
+    for (int i = 0; i < batches; ++i) {
+        ring_type::epoch_type epoch;
+        while (!ring.try_begin(epoch, 2)) {
+            std::this_thread::yield();
+        }
+        // the vector itself lives in the arena too
+        lazy::memory::buffer_manager& arena = ring.arena(epoch);
+        vector_type* vec = new (arena.allocate(sizeof(vector_type), alignof(vector_type)))
+            vector_type((allocator_type(arena)));
+        vec->reserve(batch_size);
+        for (int j = 0; j < batch_size; ++j) {
+            vec->push_back(i + j);
+            expected += i + j;
+        }
+        to_first.push(batch_queue::batch(epoch, vec));
+    }
+    first.join();
+    second.join();
+    BOOST_REQUIRE_EQUAL(first_sum, expected);
+    BOOST_REQUIRE_EQUAL(second_sum, expected);
+}
+
+// EOF
@@ -0,0 +1,216 @@
+#include "lazy/memory/instrumented_manager.h"
+#include "lazy/memory/pool_manager.h"
+#include <lazy/memory/concurrent_buffer_manager.h>
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE InstrumentedManagerTest
+#include <boost/test/unit_test.hpp>
+#include <functional>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+// the red zone buffer_manager leaves in front of every chunk
+const std::size_t red_zone = lazy::memory::detail::red_zone;
+
+// the tests that count how much of a block is spent only hold without a red zone
+const bool exact_layout = red_zone == 0;
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( counts_allocations_and_bytes )
+{
+    typedef lazy::memory::instrumented_manager<> manager_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer), 8);
+    void* a = manager.allocate(3);
+    manager.allocate(16, 16);
+    manager.deallocate(a, 3);
+
+    const lazy::memory::allocation_statistics stats = manager.statistics();
+    BOOST_REQUIRE_EQUAL(stats.allocations, 2);
+    BOOST_REQUIRE_EQUAL(stats.deallocations, 1);
+    BOOST_REQUIRE_EQUAL(stats.bytes_requested, 19);
+    BOOST_REQUIRE_EQUAL(stats.bytes_released, 3);
+    // the first chunk is padded by its successor, which could not be rolled back
+    BOOST_REQUIRE_EQUAL(stats.bytes_consumed, manager.used());
+    BOOST_REQUIRE_GT(stats.bytes_consumed, stats.bytes_requested);
+    BOOST_REQUIRE_EQUAL(stats.used, manager.used());
+    BOOST_REQUIRE_EQUAL(stats.buffer_size, sizeof(buffer));
+    BOOST_REQUIRE_EQUAL(stats.histogram[1], 1);
+    BOOST_REQUIRE_EQUAL(stats.histogram[4], 1);
+}
+
+BOOST_AUTO_TEST_CASE( tracks_the_peak )
+{
+    typedef lazy::memory::instrumented_manager<> manager_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    void* p = manager.allocate(100);
+    BOOST_REQUIRE(manager.try_expand(p, 100, 300));
+    manager.deallocate(p, 300);
+
+    lazy::memory::allocation_statistics stats = manager.statistics();
+    BOOST_REQUIRE_EQUAL(stats.used, 0);
+    BOOST_REQUIRE_EQUAL(stats.peak_used, 300 + red_zone);
+    BOOST_REQUIRE_EQUAL(stats.expansions, 1);
+
+    manager.reset_statistics();
+    stats = manager.statistics();
+    BOOST_REQUIRE_EQUAL(stats.allocations, 0);
+    BOOST_REQUIRE_EQUAL(stats.peak_used, 0);
+}
+
+BOOST_AUTO_TEST_CASE( counts_failures )
+{
+    typedef lazy::memory::instrumented_manager<> manager_type;
+
+    char buffer[64];
+    manager_type manager(buffer, sizeof(buffer));
+    BOOST_REQUIRE_THROW(manager.allocate(128), std::bad_alloc);
+    BOOST_REQUIRE_EQUAL(manager.statistics().failures, 1);
+    BOOST_REQUIRE_EQUAL(manager.statistics().allocations, 0);
+}
+
+BOOST_AUTO_TEST_CASE( counts_blocks_left_behind_on_growth,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::instrumented_manager<> manager_type;
+
+    char buffer[64];
+    manager_type manager(buffer, sizeof(buffer), lazy::memory::growth_policy::heap(256));
+    manager.allocate(48);
+    manager.allocate(32);
+
+    // the tail of the buffer is spent once the manager moves on to the next block
+    const lazy::memory::allocation_statistics stats = manager.statistics();
+    BOOST_REQUIRE_EQUAL(stats.bytes_requested, 80);
+    BOOST_REQUIRE_EQUAL(stats.bytes_consumed, 96);
+    BOOST_REQUIRE_EQUAL(stats.buffer_size, manager.buffer_size());
+}
+
+BOOST_AUTO_TEST_CASE( recycled_slots_consume_nothing,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::instrumented_manager<lazy::memory::pool_manager> manager_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    void* a = manager.allocate(24, 8);
+    manager.allocate(24, 8);
+    manager.deallocate(a, 24);
+    manager.allocate(24, 8);
+
+    const lazy::memory::allocation_statistics stats = manager.statistics();
+    BOOST_REQUIRE_EQUAL(stats.allocations, 3);
+    BOOST_REQUIRE_EQUAL(stats.bytes_requested, 72);
+    BOOST_REQUIRE_EQUAL(stats.bytes_consumed, 48);
+}
+
+BOOST_AUTO_TEST_CASE( breaks_down_by_type )
+{
+    typedef lazy::memory::instrumented_manager<> manager_type;
+    typedef std::pair<const int, int> value_type;
+    typedef lazy::memory::buffer_allocator<value_type, manager_type> allocator_type;
+    typedef std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, allocator_type> map_type;
+
+    char buffer[64 * 1024];
+    manager_type manager(buffer, sizeof(buffer));
+    {
+        map_type m(0, std::hash<int>(), std::equal_to<int>(), allocator_type(manager));
+        for (int i = 0; i < 100; ++i) {
+            m[i] = i;
+        }
+    }
+
+    // nodes and bucket arrays are different types
+    const lazy::memory::allocation_statistics stats = manager.statistics();
+    BOOST_REQUIRE_EQUAL(stats.type_count, 2);
+    lazy::memory::allocation_statistics::size_type allocations = 0;
+    lazy::memory::allocation_statistics::size_type bytes = 0;
+    for (lazy::memory::allocation_statistics::size_type i = 0; i < stats.type_count; ++i) {
+        BOOST_REQUIRE(stats.types[i].type);
+        BOOST_REQUIRE_EQUAL(stats.types[i].allocations, stats.types[i].deallocations);
+        allocations += stats.types[i].allocations;
+        bytes += stats.types[i].bytes_requested;
+    }
+    BOOST_REQUIRE_EQUAL(allocations, stats.allocations);
+    BOOST_REQUIRE_EQUAL(bytes, stats.bytes_requested);
+}
+
+BOOST_AUTO_TEST_CASE( lumps_types_that_do_not_fit )
+{
+    typedef lazy::memory::instrumented_manager<> manager_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    const lazy::memory::allocation_statistics::size_type max_types =
+        lazy::memory::allocation_statistics::max_types;
+    lazy::memory::buffer_allocator<char, manager_type> c(manager);
+    lazy::memory::buffer_allocator<short, manager_type> s(manager);
+    lazy::memory::buffer_allocator<int, manager_type> i(manager);
+    lazy::memory::buffer_allocator<long, manager_type> l(manager);
+    lazy::memory::buffer_allocator<float, manager_type> f(manager);
+    lazy::memory::buffer_allocator<double, manager_type> d(manager);
+    lazy::memory::buffer_allocator<long double, manager_type> ld(manager);
+    lazy::memory::buffer_allocator<bool, manager_type> b(manager);
+    lazy::memory::buffer_allocator<unsigned char, manager_type> uc(manager);
+    lazy::memory::buffer_allocator<unsigned short, manager_type> us(manager);
+    lazy::memory::buffer_allocator<unsigned int, manager_type> ui(manager);
+    lazy::memory::buffer_allocator<unsigned long, manager_type> ul(manager);
+    lazy::memory::buffer_allocator<signed char, manager_type> sc(manager);
+    lazy::memory::buffer_allocator<long long, manager_type> ll(manager);
+    lazy::memory::buffer_allocator<unsigned long long, manager_type> ull(manager);
+    lazy::memory::buffer_allocator<wchar_t, manager_type> w(manager);
+    lazy::memory::buffer_allocator<char16_t, manager_type> c16(manager);
+    c.allocate(1); s.allocate(1); i.allocate(1); l.allocate(1); f.allocate(1); d.allocate(1);
+    ld.allocate(1); b.allocate(1); uc.allocate(1); us.allocate(1); ui.allocate(1);
+    ul.allocate(1); sc.allocate(1); ll.allocate(1); ull.allocate(1);
+    // the last entry is kept for the rest
+    BOOST_REQUIRE_EQUAL(manager.statistics().type_count, max_types - 1);
+    w.allocate(1);
+    c16.allocate(1);
+
+    const lazy::memory::allocation_statistics stats = manager.statistics();
+    BOOST_REQUIRE_EQUAL(stats.type_count, max_types);
+    BOOST_REQUIRE(!stats.types[max_types - 1].type);
+    BOOST_REQUIRE_EQUAL(stats.types[max_types - 1].allocations, 2);
+}
+
+BOOST_AUTO_TEST_CASE( works_with_concurrent_managers )
+{
+    typedef lazy::memory::instrumented_manager<lazy::memory::concurrent_buffer_manager> manager_type;
+
+    alignas(64) char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    manager.allocate(1);
+    BOOST_REQUIRE_EQUAL(manager.statistics().bytes_consumed, manager.alignment());
+}
+
+BOOST_AUTO_TEST_CASE( writes_one_metric_per_line )
+{
+    typedef lazy::memory::instrumented_manager<> manager_type;
+    typedef lazy::memory::buffer_allocator<int, manager_type> allocator_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    allocator.allocate(4);
+
+    std::ostringstream os;
+    lazy::memory::write_statistics(os, manager.statistics(), "arena.");
+    const std::string text = os.str();
+    BOOST_REQUIRE(text.find("arena.allocations 1\n") != std::string::npos);
+    BOOST_REQUIRE(text.find("arena.bytes_requested 16\n") != std::string::npos);
+    BOOST_REQUIRE(text.find("arena.histogram.16 1\n") != std::string::npos);
+    BOOST_REQUIRE(text.find("arena.type.int.allocations 1\n") != std::string::npos);
+}
+
+// EOF
@@ -0,0 +1,218 @@
+#include "lazy/memory/mapped_buffer_manager.h"
+#include "lazy/memory/buffer_allocator.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE MappedBufferManagerTest
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <map>
+#include <new>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+#include <type_traits>
+
+namespace {
+
+// the NUMA policy the kernel has for an address
+int numa_policy_of(void* p)
+{
+    int mode = -1;
+    unsigned long mask[lazy::memory::detail::max_numa_nodes /
+        lazy::memory::detail::numa_mask_bits] = {};
+    syscall(SYS_get_mempolicy, &mode, mask, lazy::memory::detail::max_numa_nodes + 1, p,
+        MPOL_F_ADDR);
+    return mode;
+}
+
+// the red zone buffer_manager leaves in front of every chunk
+const std::size_t red_zone = lazy::memory::detail::red_zone;
+
+// the tests that commit exactly so many steps need chunks to be packed without a red zone
+// between them
+const bool exact_layout = red_zone == 0;
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( commits_as_the_cursor_advances )
+{
+    typedef lazy::memory::mapped_buffer_manager manager_type;
+    static_assert(!std::is_convertible<manager_type&, lazy::memory::buffer_manager&>::value,
+        "allocating through a buffer_manager reference would skip the commit");
+
+    const std::size_t commit_size = 64 * 1024;
+    manager_type manager(0, 1024 * 1024 * 1024, lazy::memory::mapping_policy::pages(commit_size));
+    BOOST_REQUIRE_EQUAL(manager.buffer_size(), 1024 * 1024 * 1024);
+    BOOST_REQUIRE_EQUAL(manager.committed(), 0);
+
+    char* p = static_cast<char*>(manager.allocate(100));
+    BOOST_REQUIRE_EQUAL(manager.committed(), commit_size);
+    std::memset(p, 1, 100);
+
+    // a chunk straddling the committed part commits whole steps past it
+    char* q = static_cast<char*>(manager.allocate(commit_size));
+    BOOST_REQUIRE_EQUAL(manager.committed(), 2 * commit_size);
+    std::memset(q, 1, commit_size);
+}
+
+BOOST_AUTO_TEST_CASE( try_expand_commits )
+{
+    typedef lazy::memory::mapped_buffer_manager manager_type;
+
+    const std::size_t commit_size = 64 * 1024;
+    manager_type manager(0, 1024 * 1024, lazy::memory::mapping_policy::pages(commit_size));
+    char* p = static_cast<char*>(manager.allocate(100));
+    const std::size_t n = 3 * commit_size - red_zone;
+    BOOST_REQUIRE(manager.try_expand(p, 100, n));
+    BOOST_REQUIRE_EQUAL(manager.committed(), 3 * commit_size);
+    std::memset(p, 1, n);
+    BOOST_REQUIRE(!manager.try_expand(p, n, 2 * 1024 * 1024));
+}
+
+BOOST_AUTO_TEST_CASE( allocate_batch_commits,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::mapped_buffer_manager manager_type;
+
+    const std::size_t commit_size = 64 * 1024;
+    manager_type manager(0, 1024 * 1024, lazy::memory::mapping_policy::pages(commit_size));
+    void* chunks[4];
+    manager.allocate_batch(chunks, 4, commit_size, 8);
+    BOOST_REQUIRE_EQUAL(manager.committed(), 4 * commit_size);
+    for (int i = 0; i < 4; ++i) {
+        std::memset(chunks[i], 1, commit_size);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( throws_once_the_reservation_runs_out )
+{
+    typedef lazy::memory::mapped_buffer_manager manager_type;
+
+    manager_type manager(0, 1);
+    BOOST_REQUIRE_EQUAL(manager.buffer_size() % sysconf(_SC_PAGESIZE), 0);
+    BOOST_REQUIRE_NO_THROW(manager.allocate(manager.buffer_size() - red_zone));
+    BOOST_REQUIRE_THROW(manager.allocate(1), std::bad_alloc);
+    BOOST_REQUIRE_EQUAL(manager.committed(), manager.buffer_size());
+}
+
+BOOST_AUTO_TEST_CASE( reset_hands_pages_back )
+{
+    typedef lazy::memory::mapped_buffer_manager manager_type;
+
+    manager_type manager(0, 1024 * 1024);
+    char* p = static_cast<char*>(manager.allocate(4096));
+    std::memset(p, 1, 4096);
+    manager.reset();
+    BOOST_REQUIRE_EQUAL(manager.available(), manager.buffer_size());
+
+    // the pages stay committed, and read back as zeros after MADV_DONTNEED
+    char* q = static_cast<char*>(manager.allocate(4096));
+    BOOST_REQUIRE_EQUAL(q, p);
+    BOOST_REQUIRE_EQUAL(q[0], 0);
+    BOOST_REQUIRE_EQUAL(q[4095], 0);
+}
+
+BOOST_AUTO_TEST_CASE( trim_hands_back_pages_past_the_cursor )
+{
+    typedef lazy::memory::mapped_buffer_manager manager_type;
+
+    const std::size_t page = sysconf(_SC_PAGESIZE);
+    manager_type manager(0, 1024 * 1024);
+    const manager_type::marker m = manager.mark();
+    char* p = static_cast<char*>(manager.allocate(page));
+    char* q = static_cast<char*>(manager.allocate(page));
+    std::memset(p, 1, page);
+    std::memset(q, 1, page);
+    manager.rewind(m);
+    manager.allocate(1);
+    manager.trim();
+    // peek at memory the manager took back
+    lazy::memory::detail::unpoison(p, 2 * page);
+    BOOST_REQUIRE_EQUAL(p[1], 1);
+    BOOST_REQUIRE_EQUAL(q[0], 0);
+}
+
+BOOST_AUTO_TEST_CASE( huge_pages_are_aligned )
+{
+    typedef lazy::memory::mapped_buffer_manager manager_type;
+
+    const std::size_t huge_page_size = 2 * 1024 * 1024;
+    manager_type manager(0, 3 * huge_page_size, lazy::memory::mapping_policy::transparent());
+    BOOST_REQUIRE_EQUAL(manager.buffer_size(), 3 * huge_page_size);
+    // the mapping starts on a huge page, just before the first chunk's red zone
+    char* p = static_cast<char*>(manager.allocate(1)) - red_zone;
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % huge_page_size, 0);
+    // everything committed is accessible, whether it was handed out or not
+    lazy::memory::detail::unpoison(p, manager.committed());
+    std::memset(p, 1, manager.committed());
+
+    // falls back to transparent huge pages where there is no huge page pool
+    lazy::memory::mapping_policy policy = lazy::memory::mapping_policy::huge();
+    policy.release = lazy::memory::mapping_policy::release_free;
+    manager_type huge(0, 1, policy);
+    BOOST_REQUIRE_EQUAL(huge.buffer_size(), huge_page_size);
+    BOOST_REQUIRE(huge.huge_pages() != lazy::memory::mapping_policy::explicit_huge_pages ||
+        (reinterpret_cast<uintptr_t>(huge.allocate(1)) - red_zone) % huge_page_size == 0);
+    huge.reset();
+}
+
+BOOST_AUTO_TEST_CASE( stl_containers )
+{
+    typedef lazy::memory::mapped_buffer_manager manager_type;
+    typedef std::pair<const int, int> value_type;
+    typedef lazy::memory::buffer_allocator<value_type, manager_type> allocator_type;
+    typedef std::map<int, int, std::less<int>, allocator_type> map_type;
+    typedef lazy::memory::buffer_allocator<int, manager_type> vector_allocator_type;
+    typedef std::vector<int, vector_allocator_type> vector_type;
+
+    manager_type manager(0, 64 * 1024 * 1024);
+    {
+        map_type m((std::less<int>()), allocator_type(manager));
+        vector_type v((vector_allocator_type(manager)));
+        for (int i = 0; i < 100000; ++i) {
+            m[i] = i;
+            v.push_back(i);
+        }
+        BOOST_REQUIRE_EQUAL(m.size(), 100000);
+        BOOST_REQUIRE_EQUAL(v[99999], 99999);
+        BOOST_REQUIRE_GE(manager.committed(), manager.used());
+        BOOST_REQUIRE_LT(manager.committed(), manager.buffer_size());
+    }
+    manager.reset();
+}
+
+BOOST_AUTO_TEST_CASE( numa_placement )
+{
+    typedef lazy::memory::mapped_buffer_manager manager_type;
+    typedef lazy::memory::mapping_policy policy_type;
+
+    const unsigned long long nodes = lazy::memory::detail::numa_nodes();
+    manager_type first_touch(0, 1024 * 1024);
+    BOOST_REQUIRE_EQUAL(first_touch.numa(), policy_type::numa_first_touch);
+    BOOST_REQUIRE_EQUAL(first_touch.numa_nodes(), 0);
+
+    // node 0 is there on every machine, but the kernel may still refuse
+    manager_type bound(0, 1024 * 1024, policy_type::on_node(0));
+    char* p = static_cast<char*>(bound.allocate(4096));
+    std::memset(p, 1, 4096);
+    if (bound.numa() == policy_type::numa_bind) {
+        BOOST_REQUIRE_EQUAL(bound.numa_nodes(), 1);
+        BOOST_REQUIRE_EQUAL(numa_policy_of(p), MPOL_BIND);
+    } else {
+        BOOST_REQUIRE_EQUAL(bound.numa(), policy_type::numa_first_touch);
+    }
+
+    // nodes that aren't there are ignored
+    manager_type missing(0, 1024 * 1024, policy_type::on_node(63));
+    if (!(nodes >> 63)) {
+        BOOST_REQUIRE_EQUAL(missing.numa(), policy_type::numa_first_touch);
+        BOOST_REQUIRE_EQUAL(missing.numa_nodes(), 0);
+    }
+    std::memset(missing.allocate(4096), 1, 4096);
+
+    manager_type interleaved(0, 1024 * 1024, policy_type::interleaved());
+    BOOST_REQUIRE_EQUAL(interleaved.numa_nodes() & ~nodes, 0);
+    std::memset(interleaved.allocate(64 * 1024), 1, 64 * 1024);
+}
+
+// EOF
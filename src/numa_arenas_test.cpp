@@ -0,0 +1,95 @@
+#include "lazy/memory/buffer_allocator.h"
+#include "lazy/memory/numa_arenas.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE NumaArenasTest
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int num_threads = 4;
+
+// the NUMA policy the kernel has for an address
+int numa_policy_of(void* p)
+{
+    int mode = -1;
+    unsigned long mask[lazy::memory::detail::max_numa_nodes /
+        lazy::memory::detail::numa_mask_bits] = {};
+    syscall(SYS_get_mempolicy, &mode, mask, lazy::memory::detail::max_numa_nodes + 1, p,
+        MPOL_F_ADDR);
+    return mode;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( an_arena_per_node )
+{
+    typedef lazy::memory::numa_arenas<> arenas_type;
+
+    arenas_type arenas(1000);
+    BOOST_REQUIRE_EQUAL(arenas.node_count(), lazy::memory::detail::numa_node_count());
+    BOOST_REQUIRE(arenas.node_count() >= 1);
+    BOOST_REQUIRE_EQUAL(arenas.arena_size() % sysconf(_SC_PAGESIZE), 0);
+    BOOST_REQUIRE(arenas.arena_size() >= 1000);
+    BOOST_REQUIRE(arenas.node_count() > 1 || !arenas.bound());
+    const unsigned long long nodes = lazy::memory::detail::numa_nodes();
+    for (size_t node = 0; node < arenas.node_count(); ++node) {
+        // nodes this process may not allocate from have no arena to bind
+        BOOST_REQUIRE_EQUAL(arenas.has_arena(node), ((nodes >> node) & 1) != 0);
+        if (!arenas.has_arena(node)) {
+            continue;
+        }
+        void* p = arenas.arena(node).allocate(512);
+        std::memset(p, 1, 512);
+        BOOST_REQUIRE(!arenas.bound() || arenas.bound(node));
+        if (arenas.bound(node)) {
+            BOOST_REQUIRE_EQUAL(numa_policy_of(p), MPOL_BIND);
+        }
+    }
+    BOOST_REQUIRE(!arenas.has_arena(arenas.node_count()));
+    BOOST_REQUIRE(arenas.has_arena(arenas.local_node()));
+    BOOST_REQUIRE_EQUAL(&arenas.local(), &arenas.arena(arenas.local_node()));
+}
+
+BOOST_AUTO_TEST_CASE( arenas_of_any_manager )
+{
+    typedef lazy::memory::numa_arenas<lazy::memory::buffer_manager> arenas_type;
+
+    arenas_type arenas(4096, 64);
+    BOOST_REQUIRE_EQUAL(arenas.local().alignment(), 64);
+    BOOST_REQUIRE_EQUAL(arenas.local().buffer_size(), arenas.arena_size());
+}
+
+BOOST_AUTO_TEST_CASE( workers_allocate_from_their_node )
+{
+    typedef lazy::memory::numa_arenas<> arenas_type;
+    typedef lazy::memory::buffer_allocator<int, lazy::memory::concurrent_buffer_manager>
+        allocator_type;
+    typedef std::vector<int, allocator_type> vector_type;
+
+    arenas_type arenas(16 * 1024 * 1024);
+    std::vector<std::thread> threads;
+    std::vector<int> sums(num_threads, 0);
+    for (int t = 0; t < num_threads; ++t) {
+        threads.push_back(std::thread([&arenas, &sums, t] {
+            vector_type vec((allocator_type(arenas.local())));
+            for (int i = 0; i < 10000; ++i) {
+                vec.push_back(i);
+            }
+            for (size_t i = 0; i < vec.size(); ++i) {
+                sums[t] += vec[i];
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    for (int t = 0; t < num_threads; ++t) {
+        BOOST_REQUIRE_EQUAL(sums[t], 10000 * 9999 / 2);
+    }
+}
+
+// EOF
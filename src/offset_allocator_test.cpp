@@ -0,0 +1,140 @@
+#include "lazy/memory/offset_allocator.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE OffsetAllocatorTest
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+typedef std::pair<int, int> entry_type;
+typedef lazy::memory::offset_allocator<entry_type> table_allocator_type;
+typedef std::vector<entry_type, table_allocator_type> table_type;
+
+typedef lazy::memory::offset_allocator<int> int_allocator_type;
+typedef std::vector<int, int_allocator_type> row_type;
+typedef lazy::memory::offset_allocator<row_type> row_allocator_type;
+typedef std::vector<row_type, row_allocator_type> rows_type;
+
+bool key_less(const entry_type& a, const entry_type& b)
+{
+    return a.first < b.first;
+}
+
+// builds a sorted lookup table at the start of the buffer, past the red zone if there is
+// one, and returns where it ended up
+table_type* build_table(lazy::memory::buffer_manager& manager)
+{
+    table_type* table = new (manager.allocate(sizeof(table_type), alignof(table_type)))
+        table_type(table_allocator_type(manager));
+    for (int i = 0; i < 1000; ++i) {
+        table->push_back(entry_type((i * 7919) % 1000, i));
+    }
+    std::sort(table->begin(), table->end(), &key_less);
+    return table;
+}
+
+int lookup(const table_type& table, int key)
+{
+    table_type::const_iterator it = std::lower_bound(table.begin(), table.end(),
+        entry_type(key, 0), &key_less);
+    return it != table.end() && it->first == key ? it->second : -1;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( offset_ptr_is_relative_to_itself )
+{
+    int values[4] = { 1, 2, 3, 4 };
+    lazy::memory::offset_ptr<int> p(values);
+    BOOST_REQUIRE_EQUAL(p.get(), values);
+    BOOST_REQUIRE_EQUAL(p[2], 3);
+    BOOST_REQUIRE_EQUAL(*++p, 2);
+    BOOST_REQUIRE_EQUAL((p + 2) - p, 2);
+    BOOST_REQUIRE(p < p + 1);
+
+    // copies point at the same thing from wherever they are
+    lazy::memory::offset_ptr<int> q;
+    BOOST_REQUIRE(!q);
+    BOOST_REQUIRE(q == nullptr);
+    q = p;
+    BOOST_REQUIRE(q == p);
+    lazy::memory::offset_ptr<const int> c(q);
+    BOOST_REQUIRE_EQUAL(*c, 2);
+}
+
+BOOST_AUTO_TEST_CASE( vector_survives_being_moved )
+{
+    alignas(16) char buffer[64 * 1024];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    const std::size_t offset = reinterpret_cast<char*>(build_table(manager)) - buffer;
+
+    // copy the buffer somewhere else and wipe the original, padding and all
+    lazy::memory::detail::unpoison(buffer, sizeof(buffer));
+    std::vector<char> copy(buffer, buffer + manager.used());
+    std::memset(buffer, 0, sizeof(buffer));
+    const table_type& table = *reinterpret_cast<const table_type*>(&copy[offset]);
+    BOOST_REQUIRE_EQUAL(table.size(), 1000);
+    BOOST_REQUIRE(&table[0] >= reinterpret_cast<const entry_type*>(&copy[0]));
+    BOOST_REQUIRE_EQUAL(lookup(table, (42 * 7919) % 1000), 42);
+    BOOST_REQUIRE_EQUAL(lookup(table, 1000), -1);
+}
+
+BOOST_AUTO_TEST_CASE( nested_vectors_survive_being_moved )
+{
+    alignas(16) char buffer[64 * 1024];
+    lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+    rows_type* rows = new (manager.allocate(sizeof(rows_type), alignof(rows_type)))
+        rows_type(row_allocator_type(manager));
+    for (int i = 0; i < 10; ++i) {
+        rows->push_back(row_type(i, i, int_allocator_type(manager)));
+    }
+
+    lazy::memory::detail::unpoison(buffer, sizeof(buffer));
+    std::vector<char> copy(buffer, buffer + manager.used());
+    std::memset(buffer, 0, sizeof(buffer));
+    const rows_type& moved =
+        *reinterpret_cast<const rows_type*>(&copy[reinterpret_cast<char*>(rows) - buffer]);
+    BOOST_REQUIRE_EQUAL(moved.size(), 10);
+    for (int i = 0; i < 10; ++i) {
+        BOOST_REQUIRE_EQUAL(moved[i].size(), static_cast<std::size_t>(i));
+        BOOST_REQUIRE_EQUAL(std::count(moved[i].begin(), moved[i].end(), i), i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( vector_survives_a_round_trip_through_a_file )
+{
+    alignas(16) char buffer[64 * 1024];
+    std::size_t used = 0;
+    std::size_t offset = 0;
+    {
+        lazy::memory::buffer_manager manager(buffer, sizeof(buffer));
+        offset = reinterpret_cast<char*>(build_table(manager)) - buffer;
+        used = manager.used();
+    }
+
+    char path[] = "/tmp/offset_allocator_test.XXXXXX";
+    const int fd = mkstemp(path);
+    BOOST_REQUIRE(fd >= 0);
+    unlink(path);
+    BOOST_REQUIRE_EQUAL(write(fd, buffer, used), static_cast<ssize_t>(used));
+
+    void* mapping = mmap(0, used, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    BOOST_REQUIRE(mapping != MAP_FAILED);
+    const table_type& table =
+        *reinterpret_cast<const table_type*>(static_cast<const char*>(mapping) + offset);
+    BOOST_REQUIRE_EQUAL(table.size(), 1000);
+    BOOST_REQUIRE_EQUAL(lookup(table, (999 * 7919) % 1000), 999);
+    munmap(mapping, used);
+}
+
+// EOF
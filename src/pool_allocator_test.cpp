@@ -0,0 +1,377 @@
+#include "lazy/memory/pool_allocator.h"
+#include "lazy/memory/node_traits.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE PoolAllocatorTest
+#include <boost/test/unit_test.hpp>
+#include <list>
+#include <cstring>
+#include <ext/slist>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <functional>
+#include <stdint.h>
+
+namespace {
+
+// the tests that count exactly how much of the buffer slots take only hold without a red
+// zone in front of each chunk
+const bool exact_layout = lazy::memory::detail::red_zone == 0;
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( slots_are_recycled )
+{
+    typedef lazy::memory::pool_manager manager_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    void* a = manager.allocate(24, 8);
+    void* b = manager.allocate(24, 8);
+    BOOST_REQUIRE(a != b);
+    manager.deallocate(a, 24);
+    BOOST_REQUIRE_EQUAL(manager.free_slots(24), 1);
+    // anything rounding up to the same slot size gets the free slot
+    BOOST_REQUIRE_EQUAL(manager.allocate(20, 4), a);
+    BOOST_REQUIRE_EQUAL(manager.free_slots(24), 0);
+
+    // other size classes don't
+    manager.deallocate(b, 24);
+    void* c = manager.allocate(32, 8);
+    BOOST_REQUIRE(c != b);
+    BOOST_REQUIRE_EQUAL(manager.free_slots(24), 1);
+}
+
+BOOST_AUTO_TEST_CASE( slots_are_aligned_for_their_size )
+{
+    typedef lazy::memory::pool_manager manager_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    BOOST_REQUIRE_NO_THROW(manager.allocate(1, 1));
+    void* p = manager.allocate(32, 32);
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % 32, 0);
+    manager.deallocate(p, 32);
+    BOOST_REQUIRE_EQUAL(manager.allocate(32, 32), p);
+}
+
+BOOST_AUTO_TEST_CASE( slots_are_aligned_as_asked )
+{
+    typedef lazy::memory::pool_manager manager_type;
+
+    char buffer[4096];
+    manager_type manager(buffer, sizeof(buffer));
+    void* slots[8];
+    for (int i = 0; i < 8; ++i) {
+        slots[i] = manager.allocate(40, 8);
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(slots[i]) % 8, 0);
+    }
+    for (int i = 0; i < 8; ++i) {
+        manager.deallocate(slots[i], 40);
+    }
+    // a free slot that isn't aligned enough is passed over for a fresh one
+    for (int i = 0; i < 8; ++i) {
+        void* p = manager.allocate(40, 16);
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % 16, 0);
+    }
+    void* chunks[4];
+    manager.allocate_batch(chunks, 4, 8, 64);
+    for (int i = 0; i < 4; ++i) {
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(chunks[i]) % 64, 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( slots_only_pay_for_the_alignment_asked_for,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::pool_manager manager_type;
+
+    alignas(64) char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    BOOST_REQUIRE_EQUAL(manager.allocate(8, 8), static_cast<void*>(buffer));
+    BOOST_REQUIRE_EQUAL(manager.allocate(64, 8), static_cast<void*>(buffer + 8));
+    BOOST_REQUIRE_EQUAL(manager.used(), 72);
+}
+
+BOOST_AUTO_TEST_CASE( misaligned_free_slot_does_not_block_the_list )
+{
+    typedef lazy::memory::pool_manager manager_type;
+
+    char buffer[4096];
+    manager_type manager(buffer, sizeof(buffer));
+    // 40 byte slots carved with 8 byte alignment land on and off 16 byte boundaries
+    void* aligned = 0;
+    void* misaligned = 0;
+    while (!aligned || !misaligned) {
+        void* p = manager.allocate(40, 8);
+        if (reinterpret_cast<uintptr_t>(p) % 16 == 0) {
+            aligned = aligned ? aligned : p;
+        } else {
+            misaligned = misaligned ? misaligned : p;
+        }
+    }
+    manager.deallocate(aligned, 40);
+    manager.deallocate(misaligned, 40);
+
+    // the aligned slot behind the misaligned one at the head is still found
+    const size_t used = manager.used();
+    BOOST_REQUIRE_EQUAL(manager.allocate(40, 16), aligned);
+    BOOST_REQUIRE_EQUAL(manager.used(), used);
+    BOOST_REQUIRE_EQUAL(manager.free_slots(40), 1);
+    BOOST_REQUIRE_EQUAL(manager.allocate(40, 8), misaligned);
+}
+
+BOOST_AUTO_TEST_CASE( try_expand_within_the_size_class )
+{
+    typedef lazy::memory::pool_manager manager_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    char* p = static_cast<char*>(manager.allocate(17, 8));
+    manager.deallocate(p, 17);
+    // a recycled slot only has the bytes asked for accessible
+    BOOST_REQUIRE_EQUAL(manager.allocate(17, 8), static_cast<void*>(p));
+    BOOST_REQUIRE(manager.try_expand(p, 17, 24));
+    std::memset(p, 1, 24);
+    BOOST_REQUIRE(!manager.try_expand(p, 24, 25));
+    BOOST_REQUIRE(manager.try_expand(p, 24, 20));
+    std::memset(p, 2, 20);
+}
+
+BOOST_AUTO_TEST_CASE( big_chunks_come_from_the_buffer,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::pool_manager manager_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    void* p = manager.allocate(512, 8);
+    BOOST_REQUIRE_EQUAL(manager.available(), 512);
+    manager.deallocate(p, 512);
+    BOOST_REQUIRE_EQUAL(manager.available(), 1024);
+}
+
+BOOST_AUTO_TEST_CASE( rewind_drops_free_slots )
+{
+    typedef lazy::memory::pool_manager manager_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    const manager_type::marker m = manager.mark();
+    void* a = manager.allocate(16, 8);
+    manager.deallocate(a, 16);
+    BOOST_REQUIRE_EQUAL(manager.free_slots(16), 1);
+    manager.rewind(m);
+    BOOST_REQUIRE_EQUAL(manager.free_slots(16), 0);
+    BOOST_REQUIRE_EQUAL(manager.available(), 1024);
+    BOOST_REQUIRE_EQUAL(manager.allocate(16, 8), a);
+}
+
+BOOST_AUTO_TEST_CASE( allocate_batch_takes_free_slots_first )
+{
+    typedef lazy::memory::pool_manager manager_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    void* a = manager.allocate(24, 8);
+    manager.deallocate(a, 24);
+    void* chunks[4];
+    manager.allocate_batch(chunks, 4, 20, 4);
+    BOOST_REQUIRE_EQUAL(chunks[0], a);
+    BOOST_REQUIRE_EQUAL(manager.free_slots(24), 0);
+    for (int i = 1; i < 4; ++i) {
+        BOOST_REQUIRE(chunks[i] != a);
+        BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(chunks[i]) % 8, 0);
+    }
+    // batched slots go back on the free list like any other
+    manager.deallocate(chunks[2], 24);
+    BOOST_REQUIRE_EQUAL(manager.allocate(24, 8), chunks[2]);
+}
+
+BOOST_AUTO_TEST_CASE( reserve_tops_up_free_slots,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::pool_manager manager_type;
+
+    char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    void* a = manager.allocate(16, 8);
+    manager.deallocate(a, 16);
+    manager.reserve(16, 4);
+    BOOST_REQUIRE_EQUAL(manager.free_slots(16), 4);
+    BOOST_REQUIRE_EQUAL(manager.used(), 4 * 16);
+    manager.reserve(16, 2);
+    BOOST_REQUIRE_EQUAL(manager.free_slots(16), 4);
+
+    // the reserved slots come out first and in address order
+    void* previous = manager.allocate(16, 8);
+    for (int i = 0; i < 2; ++i) {
+        void* next = manager.allocate(16, 8);
+        BOOST_REQUIRE_EQUAL(static_cast<char*>(next) - static_cast<char*>(previous), 16);
+        previous = next;
+    }
+    BOOST_REQUIRE_EQUAL(manager.allocate(16, 8), a);
+    BOOST_REQUIRE_EQUAL(manager.used(), 4 * 16);
+}
+
+BOOST_AUTO_TEST_CASE( stl_map_bulk_load_after_reserve )
+{
+    typedef int key_type;
+    typedef int data_type;
+    typedef std::pair<const key_type, data_type> value_type;
+    typedef lazy::memory::pool_allocator<value_type> allocator_type;
+    typedef std::map<key_type, data_type, std::less<key_type>, allocator_type> map_type;
+
+    const size_t num_objects = 1000;
+    const size_t buffer_size = 64 * 1024;
+    char buffer[buffer_size];
+    lazy::memory::pool_manager manager(buffer, sizeof(buffer));
+    manager.reserve(lazy::memory::node_traits<map_type>::node_size, num_objects);
+    const size_t used = manager.used();
+    allocator_type allocator(manager);
+    map_type m((std::less<key_type>()), allocator);
+    for (size_t i = 0; i < num_objects; ++i) {
+        BOOST_REQUIRE_NO_THROW(m.insert(value_type(i, i)));
+    }
+    // every node came off the free list
+    BOOST_REQUIRE_EQUAL(manager.used(), used);
+    BOOST_REQUIRE_EQUAL(manager.free_slots(lazy::memory::node_traits<map_type>::node_size), 0);
+}
+
+#if defined(LAZY_MEMORY_ASAN)
+BOOST_AUTO_TEST_CASE( free_slots_are_poisoned )
+{
+    typedef lazy::memory::pool_manager manager_type;
+
+    alignas(64) char buffer[1024];
+    manager_type manager(buffer, sizeof(buffer));
+    char* a = static_cast<char*>(manager.allocate(24, 8));
+    BOOST_REQUIRE(!__asan_region_is_poisoned(a, 24));
+    manager.deallocate(a, 24);
+    BOOST_REQUIRE(__asan_address_is_poisoned(a));
+    BOOST_REQUIRE_EQUAL(manager.free_slots(24), 1);
+    BOOST_REQUIRE_EQUAL(manager.allocate(24, 8), a);
+    BOOST_REQUIRE(!__asan_region_is_poisoned(a, 24));
+
+    manager.reserve(24, 2);
+    BOOST_REQUIRE_EQUAL(manager.free_slots(24), 2);
+    char* b = static_cast<char*>(manager.allocate(24, 8));
+    BOOST_REQUIRE(!__asan_region_is_poisoned(b, 24));
+}
+#endif
+
+BOOST_AUTO_TEST_CASE( stl_list_churn )
+{
+    typedef int data_type;
+    typedef lazy::memory::pool_allocator<data_type> allocator_type;
+    typedef std::list<data_type, allocator_type> list_type;
+
+    // room for a few dozen nodes, and a queue that never holds more than 16 of them
+    const size_t buffer_size = 1024;
+    char buffer[buffer_size];
+    lazy::memory::pool_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    list_type l(allocator);
+    for (int i = 0; i < 100000; ++i) {
+        BOOST_REQUIRE_NO_THROW(l.push_back(i));
+        if (l.size() > 16) {
+            BOOST_REQUIRE_EQUAL(l.front(), i - 16);
+            l.pop_front();
+        }
+    }
+    BOOST_REQUIRE_EQUAL(l.size(), 16);
+}
+
+BOOST_AUTO_TEST_CASE( stl_list_churn_drains_buffer_allocator )
+{
+    typedef int data_type;
+    typedef lazy::memory::buffer_allocator<data_type> allocator_type;
+    typedef std::list<data_type, allocator_type> list_type;
+
+    // the same workload runs out of memory without the pool
+    const size_t buffer_size = 1024;
+    char buffer[buffer_size];
+    lazy::memory::pool_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    list_type l(allocator);
+    BOOST_REQUIRE_THROW(
+        for (int i = 0; i < 100000; ++i) {
+            l.push_back(i);
+            if (l.size() > 16) {
+                l.pop_front();
+            }
+        },
+        std::bad_alloc);
+}
+
+BOOST_AUTO_TEST_CASE( stl_slist_churn )
+{
+    typedef int data_type;
+    typedef lazy::memory::pool_allocator<data_type> allocator_type;
+    typedef __gnu_cxx::slist<data_type, allocator_type> list_type;
+
+    const size_t buffer_size = 1024;
+    char buffer[buffer_size];
+    lazy::memory::pool_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    list_type l(allocator);
+    for (int i = 0; i < 100000; ++i) {
+        BOOST_REQUIRE_NO_THROW(l.push_front(i));
+        BOOST_REQUIRE_NO_THROW(l.push_front(i));
+        l.pop_front();
+        l.pop_front();
+    }
+    BOOST_REQUIRE(l.empty());
+}
+
+BOOST_AUTO_TEST_CASE( stl_map_churn )
+{
+    typedef int key_type;
+    typedef int data_type;
+    typedef std::pair<const key_type, data_type> value_type;
+    typedef lazy::memory::pool_allocator<value_type> allocator_type;
+    typedef std::map<key_type, data_type, std::less<key_type>, allocator_type> map_type;
+
+    const size_t buffer_size = 8 * 1024;
+    char buffer[buffer_size];
+    lazy::memory::pool_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    std::less<key_type> cmp;
+    map_type m(cmp, allocator);
+    for (int i = 0; i < 100000; ++i) {
+        BOOST_REQUIRE_NO_THROW(m.insert(value_type(i, i)));
+        if (i >= 64) {
+            BOOST_REQUIRE_EQUAL(m.erase(i - 64), 1);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(m.size(), 64);
+    BOOST_REQUIRE_EQUAL(m.begin()->first, 100000 - 64);
+}
+
+BOOST_AUTO_TEST_CASE( stl_unordered_map_churn )
+{
+    typedef int key_type;
+    typedef int data_type;
+    typedef std::pair<const key_type, data_type> value_type;
+    typedef lazy::memory::pool_allocator<value_type> allocator_type;
+    typedef std::unordered_map<key_type, data_type, std::hash<key_type>, std::equal_to<key_type>, allocator_type> map_type;
+
+    const size_t buffer_size = 16 * 1024;
+    char buffer[buffer_size];
+    lazy::memory::pool_manager manager(buffer, sizeof(buffer));
+    allocator_type allocator(manager);
+    std::hash<key_type> hasher;
+    std::equal_to<key_type> cmp;
+    // enough buckets up front so the bucket array is never reallocated
+    map_type m(256, hasher, cmp, allocator);
+    for (int i = 0; i < 100000; ++i) {
+        BOOST_REQUIRE_NO_THROW(m.insert(value_type(i, i)));
+        if (i >= 64) {
+            BOOST_REQUIRE_EQUAL(m.erase(i - 64), 1);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(m.size(), 64);
+}
+
+// EOF
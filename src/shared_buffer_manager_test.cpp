@@ -0,0 +1,189 @@
+#include "lazy/memory/shared_buffer_manager.h"
+#include "lazy/memory/offset_allocator.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE SharedBufferManagerTest
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+typedef lazy::memory::offset_allocator<int, lazy::memory::shared_buffer_manager> allocator_type;
+typedef std::vector<int, allocator_type> vector_type;
+
+const std::size_t segment_size = 1024 * 1024;
+
+// a name nobody else is using
+std::string segment_name(const char* test)
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "/lazy_%s_%d", test, static_cast<int>(getpid()));
+    return name;
+}
+
+// runs f in a child process and returns whether it exited with 0
+template <typename F>
+bool in_child(F f)
+{
+    const pid_t pid = fork();
+    if (pid == 0) {
+        _exit(f() ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+struct build_table
+{
+    const char* name;
+
+    bool operator()() const
+    {
+        lazy::memory::shared_segment segment(name, segment_size);
+        lazy::memory::shared_buffer_manager manager(segment.address(), segment.size());
+        vector_type* v = new (manager.allocate(sizeof(vector_type), alignof(vector_type)))
+            vector_type(allocator_type(manager));
+        for (int i = 0; i < 1000; ++i) {
+            v->push_back(i);
+        }
+        manager.set_root(v);
+        return true;
+    }
+};
+
+struct allocate_chunks
+{
+    const char* path;
+    char id;
+
+    bool operator()() const
+    {
+        lazy::memory::shared_segment segment(path, segment_size, lazy::memory::shared_segment::file);
+        lazy::memory::shared_buffer_manager manager(segment.address(), segment.size());
+        for (int i = 0; i < 1000; ++i) {
+            char* p = static_cast<char*>(manager.allocate(16));
+            std::fill(p, p + 16, id);
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( formats_once_and_attaches_after )
+{
+    alignas(64) char segment[4096] = {};
+    lazy::memory::shared_buffer_manager first(segment, sizeof(segment), 32);
+    void* p = first.allocate(10);
+    BOOST_REQUIRE_EQUAL(reinterpret_cast<uintptr_t>(p) % 32, 0);
+
+    // the second manager picks up where the first left off, with its alignment
+    lazy::memory::shared_buffer_manager second(segment, sizeof(segment));
+    BOOST_REQUIRE_EQUAL(second.alignment(), 32);
+    BOOST_REQUIRE_EQUAL(second.available(), first.available());
+    void* q = second.allocate(10);
+    BOOST_REQUIRE_EQUAL(static_cast<char*>(q) - static_cast<char*>(p), 32);
+    second.deallocate(q, 10);
+    BOOST_REQUIRE_EQUAL(second.available(), first.available());
+    BOOST_REQUIRE(first.try_expand(p, 10, 64));
+    BOOST_REQUIRE_EQUAL(first.used(), second.used());
+}
+
+BOOST_AUTO_TEST_CASE( rejects_foreign_segments )
+{
+    alignas(64) char segment[4096];
+    std::fill(segment, segment + sizeof(segment), 'x');
+    BOOST_REQUIRE_THROW(lazy::memory::shared_buffer_manager(segment, sizeof(segment)),
+        std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE( oversized_request_leaves_the_cursor_alone )
+{
+    alignas(64) char segment[4096] = {};
+    lazy::memory::shared_buffer_manager manager(segment, sizeof(segment), 16);
+    char* p = static_cast<char*>(manager.allocate(64));
+    // adding this to the cursor would wrap it around to the first chunk
+    BOOST_REQUIRE_THROW(manager.allocate(static_cast<size_t>(-1) - 63), std::bad_alloc);
+    BOOST_REQUIRE_EQUAL(manager.allocate(16), static_cast<void*>(p + 64));
+}
+
+BOOST_AUTO_TEST_CASE( failed_request_keeps_the_tail )
+{
+    alignas(64) char segment[4096] = {};
+    lazy::memory::shared_buffer_manager manager(segment, sizeof(segment), 16);
+    const size_t left = manager.available();
+    char* p = static_cast<char*>(manager.allocate(left - 96));
+    BOOST_REQUIRE_THROW(manager.allocate(128), std::bad_alloc);
+    BOOST_REQUIRE_EQUAL(manager.available(), 96);
+    void* q = manager.allocate(48);
+    BOOST_REQUIRE_EQUAL(q, static_cast<void*>(p + left - 96));
+    // the last chunk can still be given back
+    manager.deallocate(q, 48);
+    BOOST_REQUIRE_EQUAL(manager.available(), 96);
+}
+
+BOOST_AUTO_TEST_CASE( empty_manager_runs_out )
+{
+    lazy::memory::shared_buffer_manager manager(0, 0);
+    BOOST_REQUIRE_EQUAL(manager.available(), 0);
+    BOOST_REQUIRE_THROW(manager.allocate(1), std::bad_alloc);
+    BOOST_REQUIRE(!manager.root());
+}
+
+BOOST_AUTO_TEST_CASE( another_process_builds_the_table )
+{
+    const std::string name = segment_name("table");
+    build_table builder = { name.c_str() };
+    BOOST_REQUIRE(in_child(builder));
+
+    // mapped wherever it lands in this process
+    lazy::memory::shared_segment segment(name.c_str(), segment_size);
+    lazy::memory::shared_segment::remove(name.c_str());
+    lazy::memory::shared_buffer_manager manager(segment.address(), segment.size());
+    const vector_type* v = static_cast<const vector_type*>(manager.root());
+    BOOST_REQUIRE(v);
+    BOOST_REQUIRE_EQUAL(v->size(), 1000);
+    BOOST_REQUIRE_EQUAL((*v)[999], 999);
+}
+
+BOOST_AUTO_TEST_CASE( processes_allocate_concurrently )
+{
+    char path[] = "/tmp/shared_buffer_manager_test.XXXXXX";
+    const int fd = mkstemp(path);
+    BOOST_REQUIRE(fd >= 0);
+    close(fd);
+    lazy::memory::shared_segment segment(path, segment_size, lazy::memory::shared_segment::file);
+    lazy::memory::shared_buffer_manager manager(segment.address(), segment.size(), 16);
+    const std::size_t before = manager.used();
+
+    allocate_chunks a = { path, 'a' };
+    allocate_chunks b = { path, 'b' };
+    const pid_t pid = fork();
+    if (pid == 0) {
+        _exit(a() ? 0 : 1);
+    }
+    BOOST_REQUIRE(b());
+    int status = 0;
+    waitpid(pid, &status, 0);
+    BOOST_REQUIRE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    lazy::memory::shared_segment::remove(path, lazy::memory::shared_segment::file);
+
+    // every chunk was handed to exactly one process
+    BOOST_REQUIRE_EQUAL(manager.used() - before, 2000 * 16);
+    const char* chunks = static_cast<const char*>(segment.address()) + before;
+    BOOST_REQUIRE_EQUAL(std::count(chunks, chunks + 2000 * 16, 'a'), 1000 * 16);
+    BOOST_REQUIRE_EQUAL(std::count(chunks, chunks + 2000 * 16, 'b'), 1000 * 16);
+    for (std::size_t i = 0; i < 2000; ++i) {
+        BOOST_REQUIRE_EQUAL(std::count(chunks + i * 16, chunks + i * 16 + 16, chunks[i * 16]), 16);
+    }
+}
+
+// EOF
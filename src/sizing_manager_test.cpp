@@ -0,0 +1,184 @@
+#include "lazy/memory/sizing_manager.h"
+#include "lazy/memory/buffer_allocator.h"
+#include "lazy/memory/node_traits.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE SizingManagerTest
+#include <boost/test/unit_test.hpp>
+#include <functional>
+#include <list>
+#include <map>
+#include <new>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+typedef std::pair<const int, std::string> value_type;
+
+// the red zone buffer_manager leaves in front of every chunk
+const std::size_t red_zone = lazy::memory::detail::red_zone;
+
+// node sizes only add up to what the containers allocate without a red zone between them
+const bool exact_layout = red_zone == 0;
+
+// a workload with rebinding, padding, rollback and abandoned vector storage
+template <typename Manager>
+void workload(Manager& manager)
+{
+    typedef lazy::memory::buffer_allocator<value_type, Manager> allocator_type;
+    typedef std::map<int, std::string, std::less<int>, allocator_type> map_type;
+    typedef lazy::memory::buffer_allocator<double, Manager> vector_allocator_type;
+    typedef std::vector<double, vector_allocator_type> vector_type;
+
+    map_type m((std::less<int>()), allocator_type(manager));
+    vector_type v((vector_allocator_type(manager)));
+    for (int i = 0; i < 50; ++i) {
+        m[i] = "x";
+        v.push_back(i);
+        static_cast<void>(manager.allocate(3, 1));
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( moves_the_cursor_like_buffer_manager )
+{
+    char buffer[1024];
+    lazy::memory::buffer_manager real(buffer, sizeof(buffer));
+    lazy::memory::sizing_manager sizer(buffer, sizeof(buffer));
+
+    real.allocate(3, 1);
+    sizer.allocate(3, 1);
+    void* a = real.allocate(16, 8);
+    void* b = sizer.allocate(16, 8);
+    BOOST_REQUIRE_EQUAL(sizer.used(), real.used());
+    BOOST_REQUIRE_EQUAL(sizer.available(), real.available());
+
+    real.deallocate(a, 16);
+    sizer.deallocate(b, 16);
+    BOOST_REQUIRE_EQUAL(sizer.used(), real.used());
+    BOOST_REQUIRE_EQUAL(sizer.allocations(), 2);
+    BOOST_REQUIRE_EQUAL(sizer.required_alignment(), 8);
+    BOOST_REQUIRE_EQUAL(sizer.padding_bytes(), sizer.used() - 3);
+}
+
+BOOST_AUTO_TEST_CASE( only_the_last_chunk_is_rolled_back )
+{
+    lazy::memory::sizing_manager sizer(0, 0);
+    void* a = sizer.allocate(10);
+    void* b = sizer.allocate(20);
+    sizer.deallocate(a, 10);
+    BOOST_REQUIRE_EQUAL(sizer.used(), 30 + 2 * red_zone);
+    sizer.deallocate(b, 20);
+    BOOST_REQUIRE_EQUAL(sizer.used(), 10 + red_zone);
+    BOOST_REQUIRE_EQUAL(sizer.required_size(), 30 + 2 * red_zone);
+}
+
+BOOST_AUTO_TEST_CASE( try_expand_stays_within_the_chunk )
+{
+    lazy::memory::sizing_manager sizer(0, 0);
+    void* a = sizer.allocate(8);
+    BOOST_REQUIRE(sizer.try_expand(a, 8, 4));
+    BOOST_REQUIRE_EQUAL(sizer.used(), 4 + red_zone);
+    BOOST_REQUIRE(!sizer.try_expand(a, 4, 1 << 20));
+    void* b = sizer.allocate(8);
+    BOOST_REQUIRE(!sizer.try_expand(a, 4, 8));
+    sizer.deallocate(b, 8);
+}
+
+BOOST_AUTO_TEST_CASE( required_size_is_exact )
+{
+    lazy::memory::sizing_manager sizer(0, 0);
+    workload(sizer);
+    const std::size_t required = sizer.required_size();
+    BOOST_REQUIRE_GT(required, 0);
+    BOOST_REQUIRE_LE(sizer.required_alignment(), 16);
+
+    // the workload fits in a buffer of exactly that size, and not in anything smaller
+    alignas(16) char buffer[64 * 1024];
+    BOOST_REQUIRE_LE(required, sizeof(buffer));
+    {
+        lazy::memory::buffer_manager manager(buffer, required);
+        BOOST_REQUIRE_NO_THROW(workload(manager));
+        BOOST_REQUIRE_EQUAL(manager.available(), 0);
+    }
+    {
+        lazy::memory::buffer_manager manager(buffer, required - 1);
+        BOOST_REQUIRE_THROW(workload(manager), std::bad_alloc);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( reset_starts_from_scratch )
+{
+    lazy::memory::sizing_manager sizer(0, 0);
+    void* a = sizer.allocate(10);
+    sizer.reset();
+    BOOST_REQUIRE_EQUAL(sizer.required_size(), 0);
+    void* b = sizer.allocate(10);
+    // a is from before the reset, so it can't be rolled back
+    sizer.deallocate(a, 10);
+    BOOST_REQUIRE_EQUAL(sizer.used(), 10 + red_zone);
+    sizer.deallocate(b, 10);
+    BOOST_REQUIRE_EQUAL(sizer.used(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( node_sizes_match_what_containers_allocate,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::buffer_allocator<int, lazy::memory::sizing_manager> int_allocator_type;
+    typedef lazy::memory::buffer_allocator<value_type, lazy::memory::sizing_manager> allocator_type;
+    typedef std::list<int, int_allocator_type> list_type;
+    typedef std::set<int, std::less<int>, int_allocator_type> set_type;
+    typedef std::map<int, std::string, std::less<int>, allocator_type> map_type;
+
+    const std::size_t n = 100;
+    {
+        lazy::memory::sizing_manager sizer(0, 0);
+        list_type l((int_allocator_type(sizer)));
+        l.resize(n);
+        BOOST_REQUIRE_EQUAL(sizer.required_size(), n * lazy::memory::node_traits<list_type>::node_size);
+    }
+    {
+        lazy::memory::sizing_manager sizer(0, 0);
+        set_type s((std::less<int>()), int_allocator_type(sizer));
+        for (std::size_t i = 0; i < n; ++i) {
+            s.insert(static_cast<int>(i));
+        }
+        BOOST_REQUIRE_EQUAL(sizer.required_size(), n * lazy::memory::node_traits<set_type>::node_size);
+    }
+    {
+        lazy::memory::sizing_manager sizer(0, 0);
+        map_type m((std::less<int>()), allocator_type(sizer));
+        for (std::size_t i = 0; i < n; ++i) {
+            m[static_cast<int>(i)];
+        }
+        BOOST_REQUIRE_EQUAL(sizer.required_size(), n * lazy::memory::node_traits<map_type>::node_size);
+        BOOST_REQUIRE_EQUAL(lazy::memory::node_traits<map_type>::node_alignment, alignof(value_type));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( hash_node_sizes_match_what_containers_allocate,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::buffer_allocator<value_type, lazy::memory::sizing_manager> allocator_type;
+    typedef std::unordered_map<int, std::string, std::hash<int>, std::equal_to<int>,
+        allocator_type> map_type;
+    typedef lazy::memory::node_traits<map_type> traits_type;
+
+    const std::size_t n = 100;
+    lazy::memory::sizing_manager sizer(0, 0);
+    map_type m(n, std::hash<int>(), std::equal_to<int>(), allocator_type(sizer));
+    const std::size_t buckets = m.bucket_count();
+    for (std::size_t i = 0; i < n; ++i) {
+        m[static_cast<int>(i)];
+    }
+    BOOST_REQUIRE_EQUAL(m.bucket_count(), buckets);
+    BOOST_REQUIRE_EQUAL(sizer.required_size(),
+        buckets * traits_type::bucket_size + n * traits_type::node_size);
+}
+
+// EOF
@@ -0,0 +1,115 @@
+#include "lazy/memory/static_buffer.h"
+#include "lazy/memory/buffer_allocator.h"
+#include "lazy/memory/pool_allocator.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE StaticBufferTest
+#include <boost/test/unit_test.hpp>
+#include <list>
+#include <stdexcept>
+#include <vector>
+#include <stdint.h>
+
+namespace {
+
+bool is_aligned(const void* p, size_t alignment)
+{
+    return (reinterpret_cast<uintptr_t>(p) % alignment) == 0;
+}
+
+// the tests that fill the storage to the last byte need chunks to be packed without a red
+// zone between them
+const bool exact_layout = lazy::memory::detail::red_zone == 0;
+
+// a container with its arena embedded, like a small vector
+struct small_vector
+{
+    typedef lazy::memory::buffer_allocator<int> allocator_type;
+
+    small_vector() : vec((allocator_type(arena))) {}
+
+    lazy::memory::static_buffer<16 * sizeof(int), alignof(int)> arena;
+    std::vector<int, allocator_type> vec;
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( capacity_is_a_constant )
+{
+    typedef lazy::memory::static_buffer<256, 64> buffer_type;
+    static_assert(buffer_type::capacity == 256, "capacity is known at compile time");
+    static_assert(buffer_type::storage_alignment == 64, "so is the alignment");
+
+    buffer_type buffer;
+    BOOST_REQUIRE_EQUAL(buffer.buffer_size(), buffer_type::capacity);
+    BOOST_REQUIRE_EQUAL(buffer.max_size(), buffer_type::capacity);
+    BOOST_REQUIRE_EQUAL(buffer.available(), buffer_type::capacity);
+    BOOST_REQUIRE(is_aligned(buffer.data(), 64));
+}
+
+BOOST_AUTO_TEST_CASE( allocates_from_its_own_storage,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    lazy::memory::static_buffer<64> buffer(8);
+    void* p = buffer.allocate(16);
+    BOOST_REQUIRE_EQUAL(p, buffer.data());
+    BOOST_REQUIRE(is_aligned(buffer.allocate(1), 8));
+    BOOST_REQUIRE_THROW(buffer.allocate(64), std::bad_alloc);
+}
+
+BOOST_AUTO_TEST_CASE( grows_past_its_storage )
+{
+    lazy::memory::static_buffer<64> buffer(lazy::memory::growth_policy::heap(256));
+    void* p = buffer.allocate(128);
+    BOOST_REQUIRE(p);
+    BOOST_REQUIRE(static_cast<char*>(p) >= static_cast<char*>(buffer.data()) + 64 ||
+        static_cast<char*>(p) + 128 <= static_cast<char*>(buffer.data()));
+    BOOST_REQUIRE_GT(buffer.buffer_size(), static_cast<size_t>(64));
+}
+
+BOOST_AUTO_TEST_CASE( stl_vector,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    typedef lazy::memory::buffer_allocator<int> allocator_type;
+
+    lazy::memory::static_buffer<4 * sizeof(int), alignof(int)> buffer;
+    allocator_type allocator(buffer);
+    std::vector<int, allocator_type> vec(allocator);
+    BOOST_REQUIRE_NO_THROW(vec.reserve(4));
+    for (int i = 0; i < 4; ++i) {
+        BOOST_REQUIRE_NO_THROW(vec.push_back(i));
+    }
+    BOOST_REQUIRE_EQUAL(static_cast<void*>(vec.data()), buffer.data());
+    // vector knows max_size() and gives up before it asks for more
+    BOOST_REQUIRE_THROW(vec.push_back(4), std::length_error);
+}
+
+BOOST_AUTO_TEST_CASE( stl_list_with_pool )
+{
+    typedef lazy::memory::pool_allocator<int> allocator_type;
+    typedef lazy::memory::static_buffer<1024, alignof(std::max_align_t),
+        lazy::memory::pool_manager> buffer_type;
+
+    buffer_type buffer;
+    allocator_type allocator(buffer);
+    std::list<int, allocator_type> l(allocator);
+    for (int i = 0; i < 10000; ++i) {
+        BOOST_REQUIRE_NO_THROW(l.push_back(i));
+        BOOST_REQUIRE_NO_THROW(l.pop_front());
+    }
+    BOOST_REQUIRE(l.empty());
+}
+
+BOOST_AUTO_TEST_CASE( embedded_in_a_container,
+    *boost::unit_test::enable_if<exact_layout>() )
+{
+    small_vector v;
+    v.vec.reserve(16);
+    for (int i = 0; i < 16; ++i) {
+        v.vec.push_back(i);
+    }
+    BOOST_REQUIRE_EQUAL(static_cast<void*>(v.vec.data()), v.arena.data());
+    BOOST_REQUIRE_EQUAL(v.arena.available(), 0);
+}
+
+// EOF
@@ -0,0 +1,182 @@
+#include "lazy/memory/buffer_allocator.h"
+#include "lazy/memory/thread_cache_manager.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE ThreadCacheManagerTest
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const int num_threads = 8;
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( small_chunks_come_from_the_thread_region )
+{
+    typedef lazy::memory::thread_cache_manager manager_type;
+
+    std::vector<char> buffer(64 * 1024);
+    manager_type manager(&buffer[0], buffer.size(), 8, 4096);
+    const size_t available = manager.available();
+
+    char* a = static_cast<char*>(manager.allocate(16));
+    BOOST_REQUIRE_EQUAL(manager.available(), available - 4096);
+    char* b = static_cast<char*>(manager.allocate(16));
+    BOOST_REQUIRE_EQUAL(b, a + 16);
+    BOOST_REQUIRE_EQUAL(manager.available(), available - 4096);
+
+    // the last chunk can be given back and resized
+    manager.deallocate(b, 16);
+    BOOST_REQUIRE_EQUAL(manager.allocate(16), static_cast<void*>(b));
+    BOOST_REQUIRE(manager.try_expand(b, 16, 64));
+    BOOST_REQUIRE(!manager.try_expand(a, 16, 64));
+
+    // a chunk that doesn't fit in what's left makes the thread take a new region
+    for (int i = 0; i < 4096 / 512; ++i) {
+        BOOST_REQUIRE_NO_THROW(manager.allocate(512));
+    }
+    BOOST_REQUIRE_EQUAL(manager.available(), available - 2 * 4096);
+
+    // big chunks go straight to the buffer
+    BOOST_REQUIRE_NO_THROW(manager.allocate(2048));
+    BOOST_REQUIRE_EQUAL(manager.available(), available - 2 * 4096 - 2048);
+}
+
+BOOST_AUTO_TEST_CASE( managers_do_not_share_regions )
+{
+    typedef lazy::memory::thread_cache_manager manager_type;
+
+    std::vector<char> buffer1(16 * 1024);
+    std::vector<char> buffer2(16 * 1024);
+    manager_type manager1(&buffer1[0], buffer1.size(), 8, 1024);
+    manager_type manager2(&buffer2[0], buffer2.size(), 8, 1024);
+    for (int i = 0; i < 10; ++i) {
+        char* p1 = static_cast<char*>(manager1.allocate(8));
+        char* p2 = static_cast<char*>(manager2.allocate(8));
+        BOOST_REQUIRE(p1 >= &buffer1[0] && p1 < &buffer1[0] + buffer1.size());
+        BOOST_REQUIRE(p2 >= &buffer2[0] && p2 < &buffer2[0] + buffer2.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE( many_managers_keep_their_regions )
+{
+    typedef lazy::memory::thread_cache_manager manager_type;
+
+    const int num_managers = 6;
+    std::vector<char> buffers[num_managers];
+    manager_type* managers[num_managers];
+    for (int i = 0; i < num_managers; ++i) {
+        buffers[i].resize(16 * 1024);
+        managers[i] = new manager_type(&buffers[i][0], buffers[i].size(), 8, 1024);
+    }
+    // switching between them doesn't make the thread give up its chunks
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < num_managers; ++i) {
+            BOOST_REQUIRE_NO_THROW(managers[i]->allocate(8));
+            BOOST_REQUIRE_EQUAL(managers[i]->used(), 1024);
+        }
+    }
+    for (int i = 0; i < num_managers; ++i) {
+        delete managers[i];
+    }
+
+    // and regions of managers that are gone don't pile up
+    for (int i = 0; i < 100; ++i) {
+        manager_type manager(&buffers[0][0], buffers[0].size(), 8, 1024);
+        BOOST_REQUIRE_NO_THROW(manager.allocate(8));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( exhausted_buffer_throws )
+{
+    typedef lazy::memory::thread_cache_manager manager_type;
+
+    std::vector<char> buffer(4096);
+    manager_type manager(&buffer[0], buffer.size(), 8, 1024);
+    BOOST_REQUIRE_THROW(
+        for (int i = 0; i < 1000; ++i) {
+            manager.allocate(64);
+        },
+        std::bad_alloc);
+}
+
+BOOST_AUTO_TEST_CASE( threads_get_disjoint_chunks )
+{
+    typedef lazy::memory::thread_cache_manager manager_type;
+
+    const size_t chunks_per_thread = 10000;
+    std::vector<char> buffer(num_threads * chunks_per_thread * 128);
+    manager_type manager(&buffer[0], buffer.size(), 8);
+    std::vector<std::vector<std::pair<char*, size_t> > > chunks(num_threads);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.push_back(std::thread([&manager, &chunks, t, chunks_per_thread]() {
+            for (size_t i = 0; i < chunks_per_thread; ++i) {
+                const size_t n = 1 + (i * 7 + t) % 48;
+                char* p = static_cast<char*>(manager.allocate(n));
+                std::memset(p, t, n);
+                chunks[t].push_back(std::make_pair(p, n));
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    std::vector<std::pair<char*, size_t> > all;
+    for (int t = 0; t < num_threads; ++t) {
+        for (size_t i = 0; i < chunks[t].size(); ++i) {
+            const std::pair<char*, size_t>& chunk = chunks[t][i];
+            BOOST_REQUIRE(std::count(chunk.first, chunk.first + chunk.second, char(t)) ==
+                static_cast<std::ptrdiff_t>(chunk.second));
+            all.push_back(chunk);
+        }
+    }
+    std::sort(all.begin(), all.end());
+    for (size_t i = 1; i < all.size(); ++i) {
+        BOOST_REQUIRE(all[i - 1].first + all[i - 1].second <= all[i].first);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( threads_share_buffer_allocator )
+{
+    typedef int key_type;
+    typedef int data_type;
+    typedef std::pair<const key_type, data_type> value_type;
+    typedef lazy::memory::thread_cache_manager manager_type;
+    typedef lazy::memory::buffer_allocator<value_type, manager_type> allocator_type;
+    typedef std::map<key_type, data_type, std::less<key_type>, allocator_type> map_type;
+
+    std::vector<char> buffer(num_threads * 1024 * 1024);
+    manager_type manager(&buffer[0], buffer.size());
+    allocator_type allocator(manager);
+    std::vector<size_t> sizes(num_threads);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.push_back(std::thread([&allocator, &sizes, t]() {
+            std::less<key_type> cmp;
+            map_type m(cmp, allocator);
+            for (int i = 0; i < 1000; ++i) {
+                m.insert(value_type(i, t));
+            }
+            sizes[t] = m.size();
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    for (int t = 0; t < num_threads; ++t) {
+        BOOST_REQUIRE_EQUAL(sizes[t], 1000);
+    }
+}
+
+// EOF
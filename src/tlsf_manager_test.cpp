@@ -0,0 +1,247 @@
+#include "lazy/memory/buffer_allocator.h"
+#include "lazy/memory/static_buffer.h"
+#include "lazy/memory/tlsf_manager.h"
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_MODULE TlsfManagerTest
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef lazy::memory::tlsf_manager manager_type;
+
+bool is_aligned(const void* p, size_t alignment)
+{
+    return (reinterpret_cast<uintptr_t>(p) % alignment) == 0;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( freed_chunks_are_reused )
+{
+    alignas(64) char buffer[4096];
+    manager_type manager(buffer, sizeof(buffer));
+    void* a = manager.allocate(100);
+    void* b = manager.allocate(200);
+    BOOST_REQUIRE(is_aligned(a, manager_type::granularity));
+    BOOST_REQUIRE(is_aligned(b, manager_type::granularity));
+    BOOST_REQUIRE(static_cast<char*>(b) >= static_cast<char*>(a) + 100);
+    manager.deallocate(a, 100);
+    BOOST_REQUIRE_EQUAL(manager.allocate(90), a);
+    manager.deallocate(a, 90);
+    manager.deallocate(b, 200);
+    BOOST_REQUIRE_EQUAL(manager.available(), manager.max_size());
+}
+
+BOOST_AUTO_TEST_CASE( neighbours_are_merged )
+{
+    alignas(64) char buffer[4096];
+    manager_type manager(buffer, sizeof(buffer));
+    BOOST_REQUIRE_EQUAL(manager.free_blocks(), 1);
+    void* a = manager.allocate(64);
+    void* b = manager.allocate(64);
+    void* c = manager.allocate(64);
+    void* d = manager.allocate(64);
+    manager.deallocate(a, 64);
+    manager.deallocate(c, 64);
+    BOOST_REQUIRE_EQUAL(manager.free_blocks(), 3);
+
+    // b merges with both a and c
+    manager.deallocate(b, 64);
+    BOOST_REQUIRE_EQUAL(manager.free_blocks(), 2);
+    BOOST_REQUIRE_EQUAL(manager.allocate(64 * 3 + 2 * sizeof(void*) * 2), a);
+    manager.deallocate(a, 64 * 3 + 2 * sizeof(void*) * 2);
+
+    // d merges with c and the rest of the buffer
+    manager.deallocate(d, 64);
+    BOOST_REQUIRE_EQUAL(manager.free_blocks(), 1);
+    BOOST_REQUIRE_EQUAL(manager.available(), manager.max_size());
+}
+
+BOOST_AUTO_TEST_CASE( exhaust_and_recover )
+{
+    alignas(64) char buffer[4096];
+    manager_type manager(buffer, sizeof(buffer));
+    const size_t max_size = manager.max_size();
+    BOOST_REQUIRE(max_size > 0);
+    BOOST_REQUIRE(max_size < sizeof(buffer));
+    BOOST_REQUIRE(!manager.try_allocate(max_size + 1));
+    BOOST_REQUIRE(!manager.try_allocate(static_cast<size_t>(-1)));
+    void* a = manager.allocate(max_size);
+    BOOST_REQUIRE_EQUAL(manager.available(), 0);
+    BOOST_REQUIRE_THROW(manager.allocate(1), std::bad_alloc);
+    BOOST_REQUIRE(!manager.try_allocate(1));
+    manager.deallocate(a, max_size);
+    BOOST_REQUIRE_EQUAL(manager.available(), max_size);
+    BOOST_REQUIRE_EQUAL(manager.used(), sizeof(buffer) - max_size);
+}
+
+BOOST_AUTO_TEST_CASE( buffer_too_small_for_a_block )
+{
+    alignas(64) char buffer[64];
+    manager_type manager(buffer, sizeof(buffer));
+    BOOST_REQUIRE_EQUAL(manager.max_size(), 0);
+    BOOST_REQUIRE_EQUAL(manager.available(), 0);
+    BOOST_REQUIRE_EQUAL(manager.free_blocks(), 0);
+    BOOST_REQUIRE(!manager.try_allocate(1));
+    BOOST_REQUIRE_THROW(manager.allocate(1), std::bad_alloc);
+}
+
+BOOST_AUTO_TEST_CASE( chunks_are_aligned )
+{
+    alignas(64) char buffer[8192];
+    {
+        manager_type manager(buffer + 8, sizeof(buffer) - 8);
+        std::vector<void*> chunks;
+        for (size_t alignment = 1; alignment <= 1024; alignment *= 2) {
+            void* p = manager.allocate(24, alignment);
+            BOOST_REQUIRE(is_aligned(p, alignment));
+            std::memset(p, 0, 24);
+            chunks.push_back(p);
+        }
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            manager.deallocate(chunks[i], 24);
+        }
+        BOOST_REQUIRE_EQUAL(manager.free_blocks(), 1);
+        BOOST_REQUIRE_EQUAL(manager.available(), manager.max_size());
+    }
+
+    manager_type aligned(buffer, sizeof(buffer), 64);
+    BOOST_REQUIRE_EQUAL(aligned.alignment(), 64);
+    for (int i = 0; i < 8; ++i) {
+        BOOST_REQUIRE(is_aligned(aligned.allocate(1), 64));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( expand_into_free_neighbour )
+{
+    alignas(64) char buffer[4096];
+    manager_type manager(buffer, sizeof(buffer));
+    char* a = static_cast<char*>(manager.allocate(32));
+    char* b = static_cast<char*>(manager.allocate(32));
+    std::memset(a, 'a', 32);
+
+    // b is in the way
+    BOOST_REQUIRE(!manager.try_expand(a, 32, 64));
+    manager.deallocate(b, 32);
+    BOOST_REQUIRE(manager.try_expand(a, 32, 256));
+    BOOST_REQUIRE_EQUAL(a[31], 'a');
+    BOOST_REQUIRE_EQUAL(manager.free_blocks(), 1);
+
+    // shrinking gives the tail back
+    const size_t available = manager.available();
+    BOOST_REQUIRE(manager.try_expand(a, 256, 64));
+    BOOST_REQUIRE(manager.available() > available);
+    BOOST_REQUIRE_EQUAL(manager.free_blocks(), 1);
+    BOOST_REQUIRE(!manager.try_expand(a, 64, manager.max_size() + 1));
+    manager.deallocate(a, 64);
+    BOOST_REQUIRE_EQUAL(manager.available(), manager.max_size());
+}
+
+BOOST_AUTO_TEST_CASE( mixed_sizes_in_any_order )
+{
+    alignas(64) char buffer[64 * 1024];
+    manager_type manager(buffer, sizeof(buffer));
+    const size_t slots = 64;
+    std::vector<unsigned char*> chunks(slots, static_cast<unsigned char*>(0));
+    std::vector<size_t> sizes(slots, 0);
+    uint32_t seed = 12345;
+    for (int i = 0; i < 20000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        const size_t slot = (seed >> 8) % slots;
+        if (chunks[slot]) {
+            for (size_t j = 0; j < sizes[slot]; ++j) {
+                BOOST_REQUIRE_EQUAL(chunks[slot][j], static_cast<unsigned char>(slot));
+            }
+            manager.deallocate(chunks[slot], sizes[slot]);
+            chunks[slot] = 0;
+        } else {
+            sizes[slot] = 1 + (seed >> 16) % 700;
+            chunks[slot] = static_cast<unsigned char*>(manager.allocate(sizes[slot]));
+            std::memset(chunks[slot], static_cast<int>(slot), sizes[slot]);
+        }
+    }
+    for (size_t slot = 0; slot < slots; ++slot) {
+        if (chunks[slot]) {
+            manager.deallocate(chunks[slot], sizes[slot]);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(manager.free_blocks(), 1);
+    BOOST_REQUIRE_EQUAL(manager.available(), manager.max_size());
+}
+
+BOOST_AUTO_TEST_CASE( reset_frees_everything )
+{
+    alignas(64) char buffer[4096];
+    manager_type manager(buffer, sizeof(buffer));
+    manager.allocate(100);
+    manager.allocate(200);
+    manager.reset();
+    BOOST_REQUIRE_EQUAL(manager.free_blocks(), 1);
+    BOOST_REQUIRE_EQUAL(manager.available(), manager.max_size());
+}
+
+BOOST_AUTO_TEST_CASE( containers_run_in_a_fixed_footprint )
+{
+    typedef lazy::memory::buffer_allocator<int, manager_type> int_allocator;
+    typedef lazy::memory::buffer_allocator<char, manager_type> char_allocator;
+    typedef std::basic_string<char, std::char_traits<char>, char_allocator> string_type;
+
+    // far more than a high-water mark could take out of the buffer
+    alignas(64) char buffer[32 * 1024];
+    manager_type manager(buffer, sizeof(buffer));
+    for (int round = 0; round < 200; ++round) {
+        std::vector<int, int_allocator> vec((int_allocator(manager)));
+        string_type str((char_allocator(manager)));
+        for (int i = 0; i < 1000; ++i) {
+            vec.push_back(i);
+            if (i % 2 == 0) {
+                str.push_back(static_cast<char>('a' + i % 26));
+            }
+        }
+        BOOST_REQUIRE_EQUAL(vec[999], 999);
+        BOOST_REQUIRE_EQUAL(str.size(), 500);
+    }
+    BOOST_REQUIRE_EQUAL(manager.free_blocks(), 1);
+    BOOST_REQUIRE_EQUAL(manager.available(), manager.max_size());
+}
+
+BOOST_AUTO_TEST_CASE( static_buffer_of_tlsf )
+{
+    typedef lazy::memory::static_buffer<4096, 64, manager_type> arena_type;
+    typedef lazy::memory::buffer_allocator<int, manager_type> allocator_type;
+
+    arena_type arena;
+    std::vector<int, allocator_type> vec((allocator_type(arena)));
+    vec.assign(100, 7);
+    vec.clear();
+    vec.shrink_to_fit();
+    BOOST_REQUIRE_EQUAL(arena.available(), arena.max_size());
+}
+
+#if defined(LAZY_MEMORY_ASAN)
+BOOST_AUTO_TEST_CASE( free_blocks_are_poisoned )
+{
+    alignas(64) char buffer[4096];
+    {
+        manager_type manager(buffer, sizeof(buffer));
+        char* a = static_cast<char*>(manager.allocate(20));
+        char* b = static_cast<char*>(manager.allocate(64));
+        BOOST_REQUIRE(!__asan_region_is_poisoned(a, 20));
+        BOOST_REQUIRE(__asan_address_is_poisoned(a + 20));
+        BOOST_REQUIRE(__asan_address_is_poisoned(b + 64 + 2 * sizeof(void*) * 3));
+        manager.deallocate(a, 20);
+        BOOST_REQUIRE(__asan_address_is_poisoned(a + 2 * sizeof(void*)));
+        BOOST_REQUIRE(manager.try_expand(b, 64, 128));
+        BOOST_REQUIRE(!__asan_region_is_poisoned(b, 128));
+        manager.deallocate(b, 128);
+    }
+    BOOST_REQUIRE(!__asan_region_is_poisoned(buffer, sizeof(buffer)));
+}
+#endif
+
+// EOF